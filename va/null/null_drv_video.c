@@ -0,0 +1,2135 @@
+/*
+ * null_drv_video.c - VA null (software reference) driver
+ *
+ * Copyright (c) 2025 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL INTEL AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * The null driver implements the whole driver vtable on top of plain CPU
+ * memory. No picture is ever decoded, encoded or processed; the driver only
+ * keeps track of the objects and honours the VA-API object semantics, so
+ * that the libva dispatch layer (including va_trace) can be exercised and
+ * profiled on machines without any video hardware.
+ *
+ * Use it with LIBVA_DRIVER_NAME=null and LIBVA_DRIVERS_PATH pointing to the
+ * directory holding null_drv_video.so. Any DRM node can back the display,
+ * e.g. the one exposed by the vgem kernel module on GPU-less hosts.
+ *
+ * Synthetic latencies can be configured through the environment:
+ * .LIBVA_NULL_SUBMIT_LATENCY_US: time spent inside vaEndPicture()
+ * .LIBVA_NULL_SYNC_LATENCY_US: time after vaEndPicture() before the
+ *                              render target (and coded buffer) completes
+ */
+
+#define _GNU_SOURCE 1
+#include "sysdeps.h"
+#include "va.h"
+#include "va_backend.h"
+#include "va_backend_vpp.h"
+#include "va_internal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#if defined(__linux__)
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+#define NULL_DRIVER_INIT_FUNC_(major, minor) __vaDriverInit_##major##_##minor
+#define NULL_DRIVER_INIT_FUNC(major, minor) NULL_DRIVER_INIT_FUNC_(major, minor)
+
+#define NULL_VENDOR_STRING      "VA null driver " VA_VERSION_S
+
+#define NULL_MAX_PROFILES           16
+#define NULL_MAX_ENTRYPOINTS        4
+#define NULL_MAX_CONFIG_ATTRIBUTES  16
+#define NULL_MAX_SUBPIC_FORMATS     1
+#define NULL_MAX_DISPLAY_ATTRIBUTES 1
+
+#define NULL_MIN_SURFACE_SIZE       16
+#define NULL_MAX_SURFACE_SIZE       16384
+
+#define NULL_CONFIG_ID_BASE         0x01000000
+#define NULL_CONTEXT_ID_BASE        0x02000000
+#define NULL_SURFACE_ID_BASE        0x04000000
+#define NULL_BUFFER_ID_BASE         0x08000000
+#define NULL_IMAGE_ID_BASE          0x0a000000
+#define NULL_SUBPIC_ID_BASE         0x10000000
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+#define NULL_ALIGN(v, a)            (((v) + (a) - 1) & ~((a) - 1))
+
+#define NULL_DRIVER_DATA(ctx)       ((struct null_driver_data *)(ctx)->pDriverData)
+
+struct null_heap {
+    void **objects;
+    int capacity;
+    int id_base;
+    int next_free;
+};
+
+struct null_config {
+    VAProfile profile;
+    VAEntrypoint entrypoint;
+    VAConfigAttrib attribs[NULL_MAX_CONFIG_ATTRIBUTES];
+    int num_attribs;
+};
+
+struct null_context {
+    VAConfigID config_id;
+    VAProfile profile;
+    VAEntrypoint entrypoint;
+    int picture_width;
+    int picture_height;
+    int flag;
+    VASurfaceID render_target;
+    VABufferID coded_buf;
+    int in_picture;
+};
+
+struct null_surface {
+    unsigned int rt_format;
+    VAImage layout;             /* plane layout of data */
+    unsigned char *data;
+    uint64_t ready_ns;          /* CLOCK_MONOTONIC time of completion */
+    VAImageID derived_image;
+    int locked;
+};
+
+struct null_buffer {
+    VABufferType type;
+    unsigned int size;
+    unsigned int num_elements;
+    unsigned char *data;
+    int owns_data;
+    int mapped;
+    uint64_t ready_ns;
+};
+
+struct null_image {
+    VAImage image;
+    VASurfaceID derived_surface;
+};
+
+struct null_subpic {
+    VAImageID image;
+};
+
+struct null_driver_data {
+    pthread_mutex_t lock;
+
+    struct null_heap config_heap;
+    struct null_heap context_heap;
+    struct null_heap surface_heap;
+    struct null_heap buffer_heap;
+    struct null_heap image_heap;
+    struct null_heap subpic_heap;
+
+    uint64_t submit_latency_ns;
+    uint64_t sync_latency_ns;
+};
+
+static const VAImageFormat null_image_formats[] = {
+    { VA_FOURCC_NV12, VA_LSB_FIRST, 12, },
+    { VA_FOURCC_I420, VA_LSB_FIRST, 12, },
+    { VA_FOURCC_YV12, VA_LSB_FIRST, 12, },
+    { VA_FOURCC_P010, VA_LSB_FIRST, 24, },
+    { VA_FOURCC_YUY2, VA_LSB_FIRST, 16, },
+    { VA_FOURCC_444P, VA_LSB_FIRST, 24, },
+    { VA_FOURCC_Y800, VA_LSB_FIRST, 8, },
+    { VA_FOURCC_BGRA, VA_LSB_FIRST, 32, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000 },
+    { VA_FOURCC_BGRX, VA_LSB_FIRST, 32, 24, 0x00ff0000, 0x0000ff00, 0x000000ff, 0x00000000 },
+    { VA_FOURCC_RGBA, VA_LSB_FIRST, 32, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000 },
+    { VA_FOURCC_RGBX, VA_LSB_FIRST, 32, 24, 0x000000ff, 0x0000ff00, 0x00ff0000, 0x00000000 },
+};
+
+static const VAImageFormat null_subpic_formats[NULL_MAX_SUBPIC_FORMATS] = {
+    { VA_FOURCC_BGRA, VA_LSB_FIRST, 32, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000 },
+};
+
+static const struct {
+    VAProfile profile;
+    VAEntrypoint entrypoints[NULL_MAX_ENTRYPOINTS];
+    int num_entrypoints;
+    unsigned int rt_formats;
+} null_profiles[] = {
+    { VAProfileMPEG2Simple,             { VAEntrypointVLD }, 1, VA_RT_FORMAT_YUV420 },
+    { VAProfileMPEG2Main,               { VAEntrypointVLD, VAEntrypointEncSlice }, 2, VA_RT_FORMAT_YUV420 },
+    { VAProfileH264ConstrainedBaseline, { VAEntrypointVLD, VAEntrypointEncSlice }, 2, VA_RT_FORMAT_YUV420 },
+    { VAProfileH264Main,                { VAEntrypointVLD, VAEntrypointEncSlice }, 2, VA_RT_FORMAT_YUV420 },
+    { VAProfileH264High,                { VAEntrypointVLD, VAEntrypointEncSlice }, 2, VA_RT_FORMAT_YUV420 },
+    { VAProfileHEVCMain,                { VAEntrypointVLD, VAEntrypointEncSlice }, 2, VA_RT_FORMAT_YUV420 },
+    { VAProfileHEVCMain10,              { VAEntrypointVLD, VAEntrypointEncSlice }, 2, VA_RT_FORMAT_YUV420 | VA_RT_FORMAT_YUV420_10 },
+    { VAProfileVP8Version0_3,           { VAEntrypointVLD, VAEntrypointEncSlice }, 2, VA_RT_FORMAT_YUV420 },
+    { VAProfileVP9Profile0,             { VAEntrypointVLD, VAEntrypointEncSlice }, 2, VA_RT_FORMAT_YUV420 },
+    { VAProfileVP9Profile2,             { VAEntrypointVLD }, 1, VA_RT_FORMAT_YUV420 | VA_RT_FORMAT_YUV420_10 },
+    { VAProfileAV1Profile0,             { VAEntrypointVLD, VAEntrypointEncSlice }, 2, VA_RT_FORMAT_YUV420 | VA_RT_FORMAT_YUV420_10 },
+    { VAProfileJPEGBaseline,            { VAEntrypointVLD, VAEntrypointEncPicture }, 2, VA_RT_FORMAT_YUV420 | VA_RT_FORMAT_YUV422 | VA_RT_FORMAT_YUV444 | VA_RT_FORMAT_YUV400 },
+    { VAProfileNone,                    { VAEntrypointVideoProc }, 1, VA_RT_FORMAT_YUV420 | VA_RT_FORMAT_YUV420_10 | VA_RT_FORMAT_YUV422 | VA_RT_FORMAT_YUV444 | VA_RT_FORMAT_RGB32 },
+};
+
+static uint64_t null_get_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void null_sleep_until(uint64_t deadline_ns)
+{
+    uint64_t now = null_get_time_ns();
+    struct timespec ts;
+
+    if (deadline_ns <= now)
+        return;
+
+    ts.tv_sec = (deadline_ns - now) / 1000000000ull;
+    ts.tv_nsec = (deadline_ns - now) % 1000000000ull;
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+static uint64_t null_get_latency_env(const char *name)
+{
+    const char *value = secure_getenv(name);
+
+    if (!value)
+        return 0;
+
+    return strtoull(value, NULL, 0) * 1000ull;
+}
+
+/* Object heaps: object ID = id_base + slot index */
+static int null_heap_init(struct null_heap *heap, int id_base)
+{
+    heap->objects = NULL;
+    heap->capacity = 0;
+    heap->id_base = id_base;
+    heap->next_free = 0;
+    return 0;
+}
+
+static void null_heap_destroy(struct null_heap *heap, void (*destroy)(void *))
+{
+    int i;
+
+    for (i = 0; i < heap->capacity; i++) {
+        if (heap->objects[i])
+            destroy(heap->objects[i]);
+    }
+    free(heap->objects);
+    heap->objects = NULL;
+    heap->capacity = 0;
+}
+
+static VAGenericID null_heap_insert(struct null_heap *heap, void *object)
+{
+    int i;
+
+    for (i = heap->next_free; i < heap->capacity; i++) {
+        if (!heap->objects[i])
+            break;
+    }
+
+    if (i == heap->capacity) {
+        int capacity = heap->capacity ? heap->capacity * 2 : 64;
+        void **objects = realloc(heap->objects, capacity * sizeof(*objects));
+
+        if (!objects)
+            return VA_INVALID_ID;
+
+        memset(objects + heap->capacity, 0,
+               (capacity - heap->capacity) * sizeof(*objects));
+        heap->objects = objects;
+        heap->capacity = capacity;
+    }
+
+    heap->objects[i] = object;
+    heap->next_free = i + 1;
+    return heap->id_base + i;
+}
+
+static void *null_heap_lookup(struct null_heap *heap, VAGenericID id)
+{
+    int i = (int)id - heap->id_base;
+
+    if (id == VA_INVALID_ID || i < 0 || i >= heap->capacity)
+        return NULL;
+
+    return heap->objects[i];
+}
+
+static void *null_heap_remove(struct null_heap *heap, VAGenericID id)
+{
+    void *object = null_heap_lookup(heap, id);
+    int i = (int)id - heap->id_base;
+
+    if (!object)
+        return NULL;
+
+    heap->objects[i] = NULL;
+    if (i < heap->next_free)
+        heap->next_free = i;
+    return object;
+}
+
+#define NULL_LOOKUP(drv, type, id) \
+    ((struct null_##type *)null_heap_lookup(&(drv)->type##_heap, id))
+
+/* the parameter structure held by a buffer, NULL when the buffer is too small for it */
+#define NULL_BUFFER_PARAM(buffer, type) \
+    ((size_t)(buffer)->size * (buffer)->num_elements >= sizeof(type) ? (const type *)(buffer)->data : NULL)
+
+static void null_free_object(void *object)
+{
+    free(object);
+}
+
+static void null_free_surface(void *object)
+{
+    struct null_surface *surface = object;
+
+    free(surface->data);
+    free(surface);
+}
+
+static void null_free_buffer(void *object)
+{
+    struct null_buffer *buffer = object;
+
+    if (buffer->owns_data)
+        free(buffer->data);
+    free(buffer);
+}
+
+/*
+ * Fill in the plane layout (pitches, offsets and data_size) of an image with
+ * the given fourcc. Returns 0 when the fourcc is not supported.
+ */
+static int null_get_image_layout(unsigned int fourcc, int width, int height, VAImage *image)
+{
+    unsigned int i, w = NULL_ALIGN(width, 2), h = NULL_ALIGN(height, 2);
+    unsigned int luma_pitch = NULL_ALIGN(w, 64);
+
+    memset(image->pitches, 0, sizeof(image->pitches));
+    memset(image->offsets, 0, sizeof(image->offsets));
+
+    for (i = 0; i < ARRAY_SIZE(null_image_formats); i++) {
+        if (null_image_formats[i].fourcc == fourcc) {
+            image->format = null_image_formats[i];
+            break;
+        }
+    }
+    if (i == ARRAY_SIZE(null_image_formats))
+        return 0;
+
+    image->width = width;
+    image->height = height;
+
+    switch (fourcc) {
+    case VA_FOURCC_NV12:
+        image->num_planes = 2;
+        image->pitches[0] = image->pitches[1] = luma_pitch;
+        image->offsets[1] = luma_pitch * h;
+        image->data_size = image->offsets[1] + luma_pitch * h / 2;
+        break;
+    case VA_FOURCC_P010:
+        image->num_planes = 2;
+        image->pitches[0] = image->pitches[1] = luma_pitch * 2;
+        image->offsets[1] = luma_pitch * 2 * h;
+        image->data_size = image->offsets[1] + luma_pitch * h;
+        break;
+    case VA_FOURCC_I420:
+    case VA_FOURCC_YV12:
+        image->num_planes = 3;
+        image->pitches[0] = luma_pitch;
+        image->pitches[1] = image->pitches[2] = luma_pitch / 2;
+        image->offsets[1] = luma_pitch * h;
+        image->offsets[2] = image->offsets[1] + luma_pitch / 2 * h / 2;
+        image->data_size = image->offsets[2] + luma_pitch / 2 * h / 2;
+        break;
+    case VA_FOURCC_444P:
+        image->num_planes = 3;
+        image->pitches[0] = image->pitches[1] = image->pitches[2] = luma_pitch;
+        image->offsets[1] = luma_pitch * h;
+        image->offsets[2] = luma_pitch * h * 2;
+        image->data_size = luma_pitch * h * 3;
+        break;
+    case VA_FOURCC_YUY2:
+        image->num_planes = 1;
+        image->pitches[0] = NULL_ALIGN(w * 2, 64);
+        image->data_size = image->pitches[0] * h;
+        break;
+    case VA_FOURCC_Y800:
+        image->num_planes = 1;
+        image->pitches[0] = luma_pitch;
+        image->data_size = luma_pitch * h;
+        break;
+    default: /* 32bpp RGB */
+        image->num_planes = 1;
+        image->pitches[0] = NULL_ALIGN(w * 4, 64);
+        image->data_size = image->pitches[0] * h;
+        break;
+    }
+
+    return 1;
+}
+
+/* Return the number of bytes per row and number of rows of the given plane */
+static void null_get_plane_size(const VAImage *image, int plane, int width, int height,
+                                unsigned int *row_bytes, unsigned int *rows)
+{
+    *row_bytes = width;
+    *rows = height;
+
+    switch (image->format.fourcc) {
+    case VA_FOURCC_NV12:
+        if (plane > 0)
+            *rows = (height + 1) / 2;
+        break;
+    case VA_FOURCC_P010:
+        *row_bytes = width * 2;
+        if (plane > 0)
+            *rows = (height + 1) / 2;
+        break;
+    case VA_FOURCC_I420:
+    case VA_FOURCC_YV12:
+        if (plane > 0) {
+            *row_bytes = (width + 1) / 2;
+            *rows = (height + 1) / 2;
+        }
+        break;
+    case VA_FOURCC_YUY2:
+        *row_bytes = width * 2;
+        break;
+    case VA_FOURCC_444P:
+    case VA_FOURCC_Y800:
+        break;
+    default:
+        *row_bytes = width * 4;
+        break;
+    }
+}
+
+static void null_copy_planes(const VAImage *dst_layout, unsigned char *dst,
+                             const VAImage *src_layout, const unsigned char *src,
+                             int width, int height)
+{
+    unsigned int plane, row, row_bytes, rows;
+
+    for (plane = 0; plane < dst_layout->num_planes; plane++) {
+        const unsigned char *s = src + src_layout->offsets[plane];
+        unsigned char *d = dst + dst_layout->offsets[plane];
+
+        null_get_plane_size(dst_layout, plane, width, height, &row_bytes, &rows);
+        for (row = 0; row < rows; row++) {
+            memcpy(d, s, row_bytes);
+            s += src_layout->pitches[plane];
+            d += dst_layout->pitches[plane];
+        }
+    }
+}
+
+static unsigned int null_get_default_fourcc(unsigned int rt_format)
+{
+    switch (rt_format) {
+    case VA_RT_FORMAT_YUV420:
+        return VA_FOURCC_NV12;
+    case VA_RT_FORMAT_YUV420_10:
+        return VA_FOURCC_P010;
+    case VA_RT_FORMAT_YUV422:
+        return VA_FOURCC_YUY2;
+    case VA_RT_FORMAT_YUV444:
+        return VA_FOURCC_444P;
+    case VA_RT_FORMAT_YUV400:
+        return VA_FOURCC_Y800;
+    case VA_RT_FORMAT_RGB32:
+        return VA_FOURCC_BGRA;
+    default:
+        return 0;
+    }
+}
+
+static int null_find_profile(VAProfile profile)
+{
+    int i;
+
+    for (i = 0; i < (int)ARRAY_SIZE(null_profiles); i++) {
+        if (null_profiles[i].profile == profile)
+            return i;
+    }
+    return -1;
+}
+
+static VAStatus null_check_profile_entrypoint(VAProfile profile, VAEntrypoint entrypoint, int *index)
+{
+    int i = null_find_profile(profile), j;
+
+    if (i < 0)
+        return VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
+
+    for (j = 0; j < null_profiles[i].num_entrypoints; j++) {
+        if (null_profiles[i].entrypoints[j] == entrypoint) {
+            if (index)
+                *index = i;
+            return VA_STATUS_SUCCESS;
+        }
+    }
+    return VA_STATUS_ERROR_UNSUPPORTED_ENTRYPOINT;
+}
+
+static VAStatus null_Terminate(VADriverContextP ctx)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+
+    null_heap_destroy(&drv->subpic_heap, null_free_object);
+    null_heap_destroy(&drv->image_heap, null_free_object);
+    null_heap_destroy(&drv->buffer_heap, null_free_buffer);
+    null_heap_destroy(&drv->surface_heap, null_free_surface);
+    null_heap_destroy(&drv->context_heap, null_free_object);
+    null_heap_destroy(&drv->config_heap, null_free_object);
+    pthread_mutex_destroy(&drv->lock);
+
+    free(drv);
+    ctx->pDriverData = NULL;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_QueryConfigProfiles(
+    VADriverContextP ctx,
+    VAProfile *profile_list,
+    int *num_profiles)
+{
+    int i;
+
+    for (i = 0; i < (int)ARRAY_SIZE(null_profiles); i++)
+        profile_list[i] = null_profiles[i].profile;
+    *num_profiles = i;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_QueryConfigEntrypoints(
+    VADriverContextP ctx,
+    VAProfile profile,
+    VAEntrypoint *entrypoint_list,
+    int *num_entrypoints)
+{
+    int i = null_find_profile(profile), j;
+
+    if (i < 0) {
+        *num_entrypoints = 0;
+        return VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
+    }
+
+    for (j = 0; j < null_profiles[i].num_entrypoints; j++)
+        entrypoint_list[j] = null_profiles[i].entrypoints[j];
+    *num_entrypoints = j;
+    return VA_STATUS_SUCCESS;
+}
+
+static uint32_t null_get_attribute_value(int profile_index, VAEntrypoint entrypoint, VAConfigAttribType type)
+{
+    int encode = entrypoint == VAEntrypointEncSlice || entrypoint == VAEntrypointEncPicture;
+
+    switch (type) {
+    case VAConfigAttribRTFormat:
+        return null_profiles[profile_index].rt_formats;
+    case VAConfigAttribMaxPictureWidth:
+    case VAConfigAttribMaxPictureHeight:
+        return NULL_MAX_SURFACE_SIZE;
+    case VAConfigAttribRateControl:
+        return encode ? (VA_RC_CQP | VA_RC_CBR | VA_RC_VBR) : VA_ATTRIB_NOT_SUPPORTED;
+    case VAConfigAttribEncPackedHeaders:
+        return encode ? VA_ENC_PACKED_HEADER_NONE : VA_ATTRIB_NOT_SUPPORTED;
+    case VAConfigAttribEncMaxRefFrames:
+        return encode ? (1 | (1 << 16)) : VA_ATTRIB_NOT_SUPPORTED;
+    case VAConfigAttribEncMaxSlices:
+        return encode ? 1 : VA_ATTRIB_NOT_SUPPORTED;
+    case VAConfigAttribDecSliceMode:
+        return entrypoint == VAEntrypointVLD ? VA_DEC_SLICE_MODE_NORMAL : VA_ATTRIB_NOT_SUPPORTED;
+    default:
+        return VA_ATTRIB_NOT_SUPPORTED;
+    }
+}
+
+static VAStatus null_GetConfigAttributes(
+    VADriverContextP ctx,
+    VAProfile profile,
+    VAEntrypoint entrypoint,
+    VAConfigAttrib *attrib_list,
+    int num_attribs)
+{
+    VAStatus va_status;
+    int i, index;
+
+    va_status = null_check_profile_entrypoint(profile, entrypoint, &index);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
+
+    for (i = 0; i < num_attribs; i++)
+        attrib_list[i].value = null_get_attribute_value(index, entrypoint, attrib_list[i].type);
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_CreateConfig(
+    VADriverContextP ctx,
+    VAProfile profile,
+    VAEntrypoint entrypoint,
+    VAConfigAttrib *attrib_list,
+    int num_attribs,
+    VAConfigID *config_id)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_config *config;
+    VAStatus va_status;
+    int i, index;
+
+    va_status = null_check_profile_entrypoint(profile, entrypoint, &index);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
+
+    if (num_attribs > NULL_MAX_CONFIG_ATTRIBUTES)
+        return VA_STATUS_ERROR_MAX_NUM_EXCEEDED;
+
+    config = calloc(1, sizeof(*config));
+    if (!config)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+    config->profile = profile;
+    config->entrypoint = entrypoint;
+    config->attribs[0].type = VAConfigAttribRTFormat;
+    config->attribs[0].value = VA_RT_FORMAT_YUV420;
+    config->num_attribs = 1;
+
+    for (i = 0; i < num_attribs; i++) {
+        uint32_t supported = null_get_attribute_value(index, entrypoint, attrib_list[i].type);
+
+        if (attrib_list[i].type == VAConfigAttribRTFormat) {
+            if (!(attrib_list[i].value & supported)) {
+                free(config);
+                return VA_STATUS_ERROR_UNSUPPORTED_RT_FORMAT;
+            }
+            config->attribs[0].value = attrib_list[i].value;
+            continue;
+        }
+        if (config->num_attribs < NULL_MAX_CONFIG_ATTRIBUTES)
+            config->attribs[config->num_attribs++] = attrib_list[i];
+    }
+
+    pthread_mutex_lock(&drv->lock);
+    *config_id = null_heap_insert(&drv->config_heap, config);
+    pthread_mutex_unlock(&drv->lock);
+
+    if (*config_id == VA_INVALID_ID) {
+        free(config);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_DestroyConfig(VADriverContextP ctx, VAConfigID config_id)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_config *config;
+
+    pthread_mutex_lock(&drv->lock);
+    config = null_heap_remove(&drv->config_heap, config_id);
+    pthread_mutex_unlock(&drv->lock);
+
+    if (!config)
+        return VA_STATUS_ERROR_INVALID_CONFIG;
+
+    free(config);
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_QueryConfigAttributes(
+    VADriverContextP ctx,
+    VAConfigID config_id,
+    VAProfile *profile,
+    VAEntrypoint *entrypoint,
+    VAConfigAttrib *attrib_list,
+    int *num_attribs)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_config *config;
+    VAStatus va_status = VA_STATUS_SUCCESS;
+    int i;
+
+    pthread_mutex_lock(&drv->lock);
+    config = NULL_LOOKUP(drv, config, config_id);
+    if (config) {
+        *profile = config->profile;
+        *entrypoint = config->entrypoint;
+        for (i = 0; i < config->num_attribs; i++)
+            attrib_list[i] = config->attribs[i];
+        *num_attribs = config->num_attribs;
+    } else
+        va_status = VA_STATUS_ERROR_INVALID_CONFIG;
+    pthread_mutex_unlock(&drv->lock);
+
+    return va_status;
+}
+
+static VAStatus null_CreateSurfaces2(
+    VADriverContextP ctx,
+    unsigned int format,
+    unsigned int width,
+    unsigned int height,
+    VASurfaceID *surfaces,
+    unsigned int num_surfaces,
+    VASurfaceAttrib *attrib_list,
+    unsigned int num_attribs)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    unsigned int fourcc = null_get_default_fourcc(format);
+    VAStatus va_status = VA_STATUS_SUCCESS;
+    VAImage layout;
+    unsigned int i;
+
+    if (width < 1 || height < 1 ||
+        width > NULL_MAX_SURFACE_SIZE || height > NULL_MAX_SURFACE_SIZE)
+        return VA_STATUS_ERROR_RESOLUTION_NOT_SUPPORTED;
+
+    for (i = 0; attrib_list && i < num_attribs; i++) {
+        if (!(attrib_list[i].flags & VA_SURFACE_ATTRIB_SETTABLE))
+            continue;
+
+        switch (attrib_list[i].type) {
+        case VASurfaceAttribPixelFormat:
+            fourcc = attrib_list[i].value.value.i;
+            break;
+        case VASurfaceAttribMemoryType:
+            if (attrib_list[i].value.value.i != VA_SURFACE_ATTRIB_MEM_TYPE_VA)
+                return VA_STATUS_ERROR_UNSUPPORTED_MEMORY_TYPE;
+            break;
+        case VASurfaceAttribExternalBufferDescriptor:
+            return VA_STATUS_ERROR_UNSUPPORTED_MEMORY_TYPE;
+        default:
+            break;
+        }
+    }
+
+    if (!fourcc || !null_get_image_layout(fourcc, width, height, &layout))
+        return VA_STATUS_ERROR_UNSUPPORTED_RT_FORMAT;
+
+    for (i = 0; i < num_surfaces; i++) {
+        struct null_surface *surface = calloc(1, sizeof(*surface));
+
+        if (surface)
+            surface->data = calloc(1, layout.data_size);
+        if (!surface || !surface->data) {
+            free(surface);
+            va_status = VA_STATUS_ERROR_ALLOCATION_FAILED;
+            break;
+        }
+
+        surface->rt_format = format;
+        surface->layout = layout;
+        surface->derived_image = VA_INVALID_ID;
+
+        pthread_mutex_lock(&drv->lock);
+        surfaces[i] = null_heap_insert(&drv->surface_heap, surface);
+        pthread_mutex_unlock(&drv->lock);
+
+        if (surfaces[i] == VA_INVALID_ID) {
+            null_free_surface(surface);
+            va_status = VA_STATUS_ERROR_ALLOCATION_FAILED;
+            break;
+        }
+    }
+
+    if (va_status != VA_STATUS_SUCCESS) {
+        pthread_mutex_lock(&drv->lock);
+        while (i-- > 0) {
+            null_free_surface(null_heap_remove(&drv->surface_heap, surfaces[i]));
+            surfaces[i] = VA_INVALID_SURFACE;
+        }
+        pthread_mutex_unlock(&drv->lock);
+    }
+
+    return va_status;
+}
+
+static VAStatus null_CreateSurfaces(
+    VADriverContextP ctx,
+    int width,
+    int height,
+    int format,
+    int num_surfaces,
+    VASurfaceID *surfaces)
+{
+    if (num_surfaces <= 0 || !surfaces)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    return null_CreateSurfaces2(ctx, format, width, height,
+                                surfaces, num_surfaces, NULL, 0);
+}
+
+static VAStatus null_DestroySurfaces(
+    VADriverContextP ctx,
+    VASurfaceID *surface_list,
+    int num_surfaces)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    VAStatus va_status = VA_STATUS_SUCCESS;
+    int i;
+
+    pthread_mutex_lock(&drv->lock);
+    for (i = 0; i < num_surfaces; i++) {
+        struct null_surface *surface = null_heap_remove(&drv->surface_heap, surface_list[i]);
+
+        if (!surface) {
+            va_status = VA_STATUS_ERROR_INVALID_SURFACE;
+            continue;
+        }
+        null_free_surface(surface);
+    }
+    pthread_mutex_unlock(&drv->lock);
+
+    return va_status;
+}
+
+static VAStatus null_QuerySurfaceAttributes(
+    VADriverContextP ctx,
+    VAConfigID config_id,
+    VASurfaceAttrib *attrib_list,
+    unsigned int *num_attribs)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    VASurfaceAttrib attribs[ARRAY_SIZE(null_image_formats) + 5];
+    struct null_config *config;
+    unsigned int i, n = 0;
+    unsigned int rt_format;
+
+    pthread_mutex_lock(&drv->lock);
+    config = NULL_LOOKUP(drv, config, config_id);
+    rt_format = config ? config->attribs[0].value : 0;
+    pthread_mutex_unlock(&drv->lock);
+
+    if (!config)
+        return VA_STATUS_ERROR_INVALID_CONFIG;
+
+    for (i = 0; i < ARRAY_SIZE(null_image_formats); i++) {
+        unsigned int fourcc = null_image_formats[i].fourcc;
+        unsigned int rt = 0;
+
+        switch (fourcc) {
+        case VA_FOURCC_NV12:
+        case VA_FOURCC_I420:
+        case VA_FOURCC_YV12:
+            rt = VA_RT_FORMAT_YUV420;
+            break;
+        case VA_FOURCC_P010:
+            rt = VA_RT_FORMAT_YUV420_10;
+            break;
+        case VA_FOURCC_YUY2:
+            rt = VA_RT_FORMAT_YUV422;
+            break;
+        case VA_FOURCC_444P:
+            rt = VA_RT_FORMAT_YUV444;
+            break;
+        case VA_FOURCC_Y800:
+            rt = VA_RT_FORMAT_YUV400;
+            break;
+        default:
+            rt = VA_RT_FORMAT_RGB32;
+            break;
+        }
+        if (!(rt & rt_format))
+            continue;
+
+        attribs[n].type = VASurfaceAttribPixelFormat;
+        attribs[n].flags = VA_SURFACE_ATTRIB_GETTABLE | VA_SURFACE_ATTRIB_SETTABLE;
+        attribs[n].value.type = VAGenericValueTypeInteger;
+        attribs[n].value.value.i = fourcc;
+        n++;
+    }
+
+    attribs[n].type = VASurfaceAttribMinWidth;
+    attribs[n].flags = VA_SURFACE_ATTRIB_GETTABLE;
+    attribs[n].value.type = VAGenericValueTypeInteger;
+    attribs[n++].value.value.i = NULL_MIN_SURFACE_SIZE;
+    attribs[n].type = VASurfaceAttribMinHeight;
+    attribs[n].flags = VA_SURFACE_ATTRIB_GETTABLE;
+    attribs[n].value.type = VAGenericValueTypeInteger;
+    attribs[n++].value.value.i = NULL_MIN_SURFACE_SIZE;
+    attribs[n].type = VASurfaceAttribMaxWidth;
+    attribs[n].flags = VA_SURFACE_ATTRIB_GETTABLE;
+    attribs[n].value.type = VAGenericValueTypeInteger;
+    attribs[n++].value.value.i = NULL_MAX_SURFACE_SIZE;
+    attribs[n].type = VASurfaceAttribMaxHeight;
+    attribs[n].flags = VA_SURFACE_ATTRIB_GETTABLE;
+    attribs[n].value.type = VAGenericValueTypeInteger;
+    attribs[n++].value.value.i = NULL_MAX_SURFACE_SIZE;
+    attribs[n].type = VASurfaceAttribMemoryType;
+    attribs[n].flags = VA_SURFACE_ATTRIB_GETTABLE | VA_SURFACE_ATTRIB_SETTABLE;
+    attribs[n].value.type = VAGenericValueTypeInteger;
+    attribs[n++].value.value.i = VA_SURFACE_ATTRIB_MEM_TYPE_VA;
+
+    if (!attrib_list) {
+        *num_attribs = n;
+        return VA_STATUS_SUCCESS;
+    }
+    if (*num_attribs < n) {
+        *num_attribs = n;
+        return VA_STATUS_ERROR_MAX_NUM_EXCEEDED;
+    }
+
+    memcpy(attrib_list, attribs, n * sizeof(*attribs));
+    *num_attribs = n;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_CreateContext(
+    VADriverContextP ctx,
+    VAConfigID config_id,
+    int picture_width,
+    int picture_height,
+    int flag,
+    VASurfaceID *render_targets,
+    int num_render_targets,
+    VAContextID *context)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_context *obj_context;
+    struct null_config *config;
+    int i;
+
+    obj_context = calloc(1, sizeof(*obj_context));
+    if (!obj_context)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+    pthread_mutex_lock(&drv->lock);
+    config = NULL_LOOKUP(drv, config, config_id);
+    if (!config) {
+        pthread_mutex_unlock(&drv->lock);
+        free(obj_context);
+        return VA_STATUS_ERROR_INVALID_CONFIG;
+    }
+
+    for (i = 0; render_targets && i < num_render_targets; i++) {
+        if (!NULL_LOOKUP(drv, surface, render_targets[i])) {
+            pthread_mutex_unlock(&drv->lock);
+            free(obj_context);
+            return VA_STATUS_ERROR_INVALID_SURFACE;
+        }
+    }
+
+    obj_context->config_id = config_id;
+    obj_context->profile = config->profile;
+    obj_context->entrypoint = config->entrypoint;
+    obj_context->picture_width = picture_width;
+    obj_context->picture_height = picture_height;
+    obj_context->flag = flag;
+    obj_context->render_target = VA_INVALID_SURFACE;
+    obj_context->coded_buf = VA_INVALID_ID;
+
+    *context = null_heap_insert(&drv->context_heap, obj_context);
+    pthread_mutex_unlock(&drv->lock);
+
+    if (*context == VA_INVALID_ID) {
+        free(obj_context);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_DestroyContext(VADriverContextP ctx, VAContextID context)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_context *obj_context;
+
+    pthread_mutex_lock(&drv->lock);
+    obj_context = null_heap_remove(&drv->context_heap, context);
+    pthread_mutex_unlock(&drv->lock);
+
+    if (!obj_context)
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+
+    free(obj_context);
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_create_buffer(
+    struct null_driver_data *drv,
+    VABufferType type,
+    unsigned int size,
+    unsigned int num_elements,
+    void *data,
+    unsigned char *external,
+    VABufferID *buf_id)
+{
+    struct null_buffer *buffer;
+    size_t alloc_size = (size_t)size * num_elements;
+
+    buffer = calloc(1, sizeof(*buffer));
+    if (!buffer)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+    buffer->type = type;
+    buffer->size = size;
+    buffer->num_elements = num_elements;
+
+    if (external) {
+        buffer->data = external;
+    } else {
+        /* coded buffers start with the segment list header */
+        if (type == VAEncCodedBufferType)
+            alloc_size += sizeof(VACodedBufferSegment);
+
+        buffer->data = calloc(1, alloc_size ? alloc_size : 1);
+        if (!buffer->data) {
+            free(buffer);
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        }
+        buffer->owns_data = 1;
+
+        if (type == VAEncCodedBufferType) {
+            VACodedBufferSegment *segment = (VACodedBufferSegment *)buffer->data;
+
+            segment->buf = buffer->data + sizeof(*segment);
+        } else if (data)
+            memcpy(buffer->data, data, alloc_size);
+    }
+
+    pthread_mutex_lock(&drv->lock);
+    *buf_id = null_heap_insert(&drv->buffer_heap, buffer);
+    pthread_mutex_unlock(&drv->lock);
+
+    if (*buf_id == VA_INVALID_ID) {
+        null_free_buffer(buffer);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_CreateBuffer(
+    VADriverContextP ctx,
+    VAContextID context,
+    VABufferType type,
+    unsigned int size,
+    unsigned int num_elements,
+    void *data,
+    VABufferID *buf_id)
+{
+    if (!buf_id)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    return null_create_buffer(NULL_DRIVER_DATA(ctx), type, size, num_elements,
+                              data, NULL, buf_id);
+}
+
+static VAStatus null_BufferSetNumElements(
+    VADriverContextP ctx,
+    VABufferID buf_id,
+    unsigned int num_elements)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_buffer *buffer;
+    VAStatus va_status = VA_STATUS_SUCCESS;
+
+    pthread_mutex_lock(&drv->lock);
+    buffer = NULL_LOOKUP(drv, buffer, buf_id);
+    if (!buffer)
+        va_status = VA_STATUS_ERROR_INVALID_BUFFER;
+    else if (num_elements > buffer->num_elements)
+        va_status = VA_STATUS_ERROR_INVALID_PARAMETER;
+    else
+        buffer->num_elements = num_elements;
+    pthread_mutex_unlock(&drv->lock);
+
+    return va_status;
+}
+
+static VAStatus null_MapBuffer2(
+    VADriverContextP ctx,
+    VABufferID buf_id,
+    void **pbuf,
+    uint32_t flags)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_buffer *buffer;
+    uint64_t ready_ns = 0;
+
+    pthread_mutex_lock(&drv->lock);
+    buffer = NULL_LOOKUP(drv, buffer, buf_id);
+    if (buffer) {
+        buffer->mapped++;
+        *pbuf = buffer->data;
+        ready_ns = buffer->ready_ns;
+    }
+    pthread_mutex_unlock(&drv->lock);
+
+    if (!buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    /* mapping a coded buffer waits for the encode to complete */
+    null_sleep_until(ready_ns);
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_MapBuffer(VADriverContextP ctx, VABufferID buf_id, void **pbuf)
+{
+    return null_MapBuffer2(ctx, buf_id, pbuf, VA_MAPBUFFER_FLAG_DEFAULT);
+}
+
+static VAStatus null_UnmapBuffer(VADriverContextP ctx, VABufferID buf_id)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_buffer *buffer;
+    VAStatus va_status = VA_STATUS_SUCCESS;
+
+    pthread_mutex_lock(&drv->lock);
+    buffer = NULL_LOOKUP(drv, buffer, buf_id);
+    if (!buffer)
+        va_status = VA_STATUS_ERROR_INVALID_BUFFER;
+    else if (buffer->mapped > 0)
+        buffer->mapped--;
+    pthread_mutex_unlock(&drv->lock);
+
+    return va_status;
+}
+
+static VAStatus null_DestroyBuffer(VADriverContextP ctx, VABufferID buffer_id)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_buffer *buffer;
+
+    pthread_mutex_lock(&drv->lock);
+    buffer = null_heap_remove(&drv->buffer_heap, buffer_id);
+    pthread_mutex_unlock(&drv->lock);
+
+    if (!buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    null_free_buffer(buffer);
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_BufferInfo(
+    VADriverContextP ctx,
+    VABufferID buf_id,
+    VABufferType *type,
+    unsigned int *size,
+    unsigned int *num_elements)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_buffer *buffer;
+
+    pthread_mutex_lock(&drv->lock);
+    buffer = NULL_LOOKUP(drv, buffer, buf_id);
+    if (buffer) {
+        *type = buffer->type;
+        *size = buffer->size;
+        *num_elements = buffer->num_elements;
+    }
+    pthread_mutex_unlock(&drv->lock);
+
+    return buffer ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_INVALID_BUFFER;
+}
+
+static VAStatus null_BeginPicture(
+    VADriverContextP ctx,
+    VAContextID context,
+    VASurfaceID render_target)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_context *obj_context;
+    VAStatus va_status = VA_STATUS_SUCCESS;
+
+    pthread_mutex_lock(&drv->lock);
+    obj_context = NULL_LOOKUP(drv, context, context);
+    if (!obj_context)
+        va_status = VA_STATUS_ERROR_INVALID_CONTEXT;
+    else if (!NULL_LOOKUP(drv, surface, render_target))
+        va_status = VA_STATUS_ERROR_INVALID_SURFACE;
+    else {
+        obj_context->render_target = render_target;
+        obj_context->coded_buf = VA_INVALID_ID;
+        obj_context->in_picture = 1;
+    }
+    pthread_mutex_unlock(&drv->lock);
+
+    return va_status;
+}
+
+/* Return the coded buffer referenced by an encode picture parameter buffer */
+static VABufferID null_get_coded_buf(VAProfile profile, const struct null_buffer *buffer)
+{
+#define NULL_CODED_BUF(type) \
+    (NULL_BUFFER_PARAM(buffer, type) ? NULL_BUFFER_PARAM(buffer, type)->coded_buf : VA_INVALID_ID)
+
+    switch (profile) {
+    case VAProfileMPEG2Simple:
+    case VAProfileMPEG2Main:
+        return NULL_CODED_BUF(VAEncPictureParameterBufferMPEG2);
+    case VAProfileH264ConstrainedBaseline:
+    case VAProfileH264Main:
+    case VAProfileH264High:
+        return NULL_CODED_BUF(VAEncPictureParameterBufferH264);
+    case VAProfileHEVCMain:
+    case VAProfileHEVCMain10:
+        return NULL_CODED_BUF(VAEncPictureParameterBufferHEVC);
+    case VAProfileVP8Version0_3:
+        return NULL_CODED_BUF(VAEncPictureParameterBufferVP8);
+    case VAProfileVP9Profile0:
+        return NULL_CODED_BUF(VAEncPictureParameterBufferVP9);
+    case VAProfileAV1Profile0:
+        return NULL_CODED_BUF(VAEncPictureParameterBufferAV1);
+    case VAProfileJPEGBaseline:
+        return NULL_CODED_BUF(VAEncPictureParameterBufferJPEG);
+    default:
+        return VA_INVALID_ID;
+    }
+#undef NULL_CODED_BUF
+}
+
+static void null_process_picture(
+    struct null_driver_data *drv,
+    struct null_context *obj_context,
+    const VAProcPipelineParameterBuffer *pipeline)
+{
+    struct null_surface *src = NULL_LOOKUP(drv, surface, pipeline->surface);
+    struct null_surface *dst = NULL_LOOKUP(drv, surface, obj_context->render_target);
+    int width, height;
+
+    if (!src || !dst || src->layout.format.fourcc != dst->layout.format.fourcc)
+        return;
+
+    width = src->layout.width < dst->layout.width ? src->layout.width : dst->layout.width;
+    height = src->layout.height < dst->layout.height ? src->layout.height : dst->layout.height;
+    null_copy_planes(&dst->layout, dst->data, &src->layout, src->data, width, height);
+}
+
+static VAStatus null_RenderPicture(
+    VADriverContextP ctx,
+    VAContextID context,
+    VABufferID *buffers,
+    int num_buffers)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_context *obj_context;
+    const VAProcPipelineParameterBuffer *pipeline;
+    VAStatus va_status = VA_STATUS_SUCCESS;
+    int i;
+
+    pthread_mutex_lock(&drv->lock);
+    obj_context = NULL_LOOKUP(drv, context, context);
+    if (!obj_context || !obj_context->in_picture) {
+        pthread_mutex_unlock(&drv->lock);
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+    }
+
+    for (i = 0; i < num_buffers; i++) {
+        struct null_buffer *buffer = NULL_LOOKUP(drv, buffer, buffers[i]);
+
+        if (!buffer) {
+            va_status = VA_STATUS_ERROR_INVALID_BUFFER;
+            break;
+        }
+
+        switch (buffer->type) {
+        case VAEncPictureParameterBufferType:
+            obj_context->coded_buf = null_get_coded_buf(obj_context->profile, buffer);
+            break;
+        case VAProcPipelineParameterBufferType:
+            pipeline = NULL_BUFFER_PARAM(buffer, VAProcPipelineParameterBuffer);
+            if (pipeline)
+                null_process_picture(drv, obj_context, pipeline);
+            break;
+        default:
+            break;
+        }
+    }
+    pthread_mutex_unlock(&drv->lock);
+
+    return va_status;
+}
+
+static VAStatus null_EndPicture(VADriverContextP ctx, VAContextID context)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_context *obj_context;
+    struct null_surface *surface;
+    struct null_buffer *coded_buf;
+    uint64_t now = null_get_time_ns();
+
+    pthread_mutex_lock(&drv->lock);
+    obj_context = NULL_LOOKUP(drv, context, context);
+    if (!obj_context || !obj_context->in_picture) {
+        pthread_mutex_unlock(&drv->lock);
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+    }
+    obj_context->in_picture = 0;
+
+    surface = NULL_LOOKUP(drv, surface, obj_context->render_target);
+    if (surface)
+        surface->ready_ns = now + drv->submit_latency_ns + drv->sync_latency_ns;
+
+    coded_buf = NULL_LOOKUP(drv, buffer, obj_context->coded_buf);
+    if (coded_buf && coded_buf->type == VAEncCodedBufferType) {
+        VACodedBufferSegment *segment = (VACodedBufferSegment *)coded_buf->data;
+
+        /* report a tiny zero-filled bitstream */
+        segment->size = coded_buf->size < 64 ? coded_buf->size : 64;
+        segment->bit_offset = 0;
+        segment->status = 0;
+        segment->next = NULL;
+        coded_buf->ready_ns = now + drv->submit_latency_ns + drv->sync_latency_ns;
+    }
+    pthread_mutex_unlock(&drv->lock);
+
+    null_sleep_until(now + drv->submit_latency_ns);
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_SubmitPicture(
+    VADriverContextP ctx,
+    VAContextID context,
+    VASurfaceID render_target,
+    VABufferID *buffers,
+    int num_buffers)
+{
+    VAStatus va_status, end_status;
+
+    va_status = null_BeginPicture(ctx, context, render_target);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
+
+    va_status = null_RenderPicture(ctx, context, buffers, num_buffers);
+    end_status = null_EndPicture(ctx, context);
+    return va_status != VA_STATUS_SUCCESS ? va_status : end_status;
+}
+
+static VAStatus null_get_surface_ready_time(
+    struct null_driver_data *drv,
+    VASurfaceID surface_id,
+    uint64_t *ready_ns)
+{
+    struct null_surface *surface;
+
+    pthread_mutex_lock(&drv->lock);
+    surface = NULL_LOOKUP(drv, surface, surface_id);
+    if (surface)
+        *ready_ns = surface->ready_ns;
+    pthread_mutex_unlock(&drv->lock);
+
+    return surface ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_INVALID_SURFACE;
+}
+
+static VAStatus null_SyncSurface2(
+    VADriverContextP ctx,
+    VASurfaceID surface,
+    uint64_t timeout_ns)
+{
+    uint64_t ready_ns, now;
+    VAStatus va_status;
+
+    va_status = null_get_surface_ready_time(NULL_DRIVER_DATA(ctx), surface, &ready_ns);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
+
+    now = null_get_time_ns();
+    if (ready_ns > now && timeout_ns != VA_TIMEOUT_INFINITE &&
+        ready_ns - now > timeout_ns) {
+        null_sleep_until(now + timeout_ns);
+        return VA_STATUS_ERROR_TIMEDOUT;
+    }
+
+    null_sleep_until(ready_ns);
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_SyncSurface(VADriverContextP ctx, VASurfaceID render_target)
+{
+    return null_SyncSurface2(ctx, render_target, VA_TIMEOUT_INFINITE);
+}
+
+static VAStatus null_SyncBuffer(
+    VADriverContextP ctx,
+    VABufferID buf_id,
+    uint64_t timeout_ns)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_buffer *buffer;
+    uint64_t ready_ns = 0, now;
+
+    pthread_mutex_lock(&drv->lock);
+    buffer = NULL_LOOKUP(drv, buffer, buf_id);
+    if (buffer)
+        ready_ns = buffer->ready_ns;
+    pthread_mutex_unlock(&drv->lock);
+
+    if (!buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    now = null_get_time_ns();
+    if (ready_ns > now && timeout_ns != VA_TIMEOUT_INFINITE &&
+        ready_ns - now > timeout_ns) {
+        null_sleep_until(now + timeout_ns);
+        return VA_STATUS_ERROR_TIMEDOUT;
+    }
+
+    null_sleep_until(ready_ns);
+    return VA_STATUS_SUCCESS;
+}
+
+#if defined(__linux__)
+/* a timer expiring when the object is ready serves as completion fd */
+static VAStatus null_get_timer_fd(uint64_t ready_ns, int *fd)
+{
+    struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+    int tfd;
+
+    tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (tfd < 0)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    /* a zero expiration would disarm the timer, any past time fires now */
+    if (!ready_ns)
+        ready_ns = 1;
+    its.it_value.tv_sec = ready_ns / 1000000000ull;
+    its.it_value.tv_nsec = ready_ns % 1000000000ull;
+    if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        close(tfd);
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+    }
+
+    *fd = tfd;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_GetSurfaceSyncFd(
+    VADriverContextP ctx,
+    VASurfaceID surface,
+    int *fd)
+{
+    uint64_t ready_ns;
+    VAStatus va_status;
+
+    va_status = null_get_surface_ready_time(NULL_DRIVER_DATA(ctx), surface, &ready_ns);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
+
+    return null_get_timer_fd(ready_ns, fd);
+}
+
+static VAStatus null_GetBufferSyncFd(
+    VADriverContextP ctx,
+    VABufferID buf_id,
+    int *fd)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_buffer *buffer;
+    uint64_t ready_ns = 0;
+
+    pthread_mutex_lock(&drv->lock);
+    buffer = NULL_LOOKUP(drv, buffer, buf_id);
+    if (buffer)
+        ready_ns = buffer->ready_ns;
+    pthread_mutex_unlock(&drv->lock);
+
+    if (!buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+
+    return null_get_timer_fd(ready_ns, fd);
+}
+#endif
+
+static VAStatus null_QuerySurfaceStatus(
+    VADriverContextP ctx,
+    VASurfaceID render_target,
+    VASurfaceStatus *status)
+{
+    uint64_t ready_ns;
+    VAStatus va_status;
+
+    va_status = null_get_surface_ready_time(NULL_DRIVER_DATA(ctx), render_target, &ready_ns);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
+
+    *status = ready_ns > null_get_time_ns() ? VASurfaceRendering : VASurfaceReady;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_QuerySurfaceError(
+    VADriverContextP ctx,
+    VASurfaceID render_target,
+    VAStatus error_status,
+    void **error_info)
+{
+    static VASurfaceDecodeMBErrors no_errors = { -1, };
+    uint64_t ready_ns;
+    VAStatus va_status;
+
+    va_status = null_get_surface_ready_time(NULL_DRIVER_DATA(ctx), render_target, &ready_ns);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
+
+    *error_info = &no_errors;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_QueryImageFormats(
+    VADriverContextP ctx,
+    VAImageFormat *format_list,
+    int *num_formats)
+{
+    memcpy(format_list, null_image_formats, sizeof(null_image_formats));
+    *num_formats = ARRAY_SIZE(null_image_formats);
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_create_image(
+    struct null_driver_data *drv,
+    VAImageFormat *format,
+    int width,
+    int height,
+    struct null_surface *derived,
+    VASurfaceID derived_surface,
+    VAImage *image)
+{
+    struct null_image *obj_image;
+    VAStatus va_status;
+
+    obj_image = calloc(1, sizeof(*obj_image));
+    if (!obj_image)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+    if (derived)
+        obj_image->image = derived->layout;
+    else if (!null_get_image_layout(format->fourcc, width, height, &obj_image->image)) {
+        free(obj_image);
+        return VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
+    }
+    obj_image->derived_surface = derived_surface;
+
+    va_status = null_create_buffer(drv, VAImageBufferType, obj_image->image.data_size, 1,
+                                   NULL, derived ? derived->data : NULL,
+                                   &obj_image->image.buf);
+    if (va_status != VA_STATUS_SUCCESS) {
+        free(obj_image);
+        return va_status;
+    }
+
+    pthread_mutex_lock(&drv->lock);
+    obj_image->image.image_id = null_heap_insert(&drv->image_heap, obj_image);
+    pthread_mutex_unlock(&drv->lock);
+
+    if (obj_image->image.image_id == VA_INVALID_ID) {
+        pthread_mutex_lock(&drv->lock);
+        null_free_buffer(null_heap_remove(&drv->buffer_heap, obj_image->image.buf));
+        pthread_mutex_unlock(&drv->lock);
+        free(obj_image);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+
+    *image = obj_image->image;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_CreateImage(
+    VADriverContextP ctx,
+    VAImageFormat *format,
+    int width,
+    int height,
+    VAImage *image)
+{
+    if (!format || !image || width <= 0 || height <= 0)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    return null_create_image(NULL_DRIVER_DATA(ctx), format, width, height,
+                             NULL, VA_INVALID_SURFACE, image);
+}
+
+static VAStatus null_DeriveImage(
+    VADriverContextP ctx,
+    VASurfaceID surface_id,
+    VAImage *image)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_surface *surface;
+    VAStatus va_status;
+
+    pthread_mutex_lock(&drv->lock);
+    surface = NULL_LOOKUP(drv, surface, surface_id);
+    pthread_mutex_unlock(&drv->lock);
+
+    if (!surface)
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    if (surface->derived_image != VA_INVALID_ID)
+        return VA_STATUS_ERROR_SURFACE_BUSY;
+
+    va_status = null_create_image(drv, &surface->layout.format,
+                                  surface->layout.width, surface->layout.height,
+                                  surface, surface_id, image);
+    if (va_status == VA_STATUS_SUCCESS)
+        surface->derived_image = image->image_id;
+
+    return va_status;
+}
+
+static VAStatus null_DestroyImage(VADriverContextP ctx, VAImageID image)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_image *obj_image;
+    struct null_surface *surface;
+
+    pthread_mutex_lock(&drv->lock);
+    obj_image = null_heap_remove(&drv->image_heap, image);
+    if (obj_image) {
+        surface = NULL_LOOKUP(drv, surface, obj_image->derived_surface);
+        if (surface && surface->derived_image == image)
+            surface->derived_image = VA_INVALID_ID;
+
+        null_free_buffer(null_heap_remove(&drv->buffer_heap, obj_image->image.buf));
+    }
+    pthread_mutex_unlock(&drv->lock);
+
+    if (!obj_image)
+        return VA_STATUS_ERROR_INVALID_IMAGE;
+
+    free(obj_image);
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_SetImagePalette(
+    VADriverContextP ctx,
+    VAImageID image,
+    unsigned char *palette)
+{
+    return VA_STATUS_ERROR_UNIMPLEMENTED;
+}
+
+/* Copy between a surface and an image; direction 0 is surface to image */
+static VAStatus null_transfer_image(
+    VADriverContextP ctx,
+    VASurfaceID surface_id,
+    VAImageID image_id,
+    int width,
+    int height,
+    int direction)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_surface *surface;
+    struct null_image *obj_image;
+    struct null_buffer *buffer = NULL;
+    VAStatus va_status = VA_STATUS_SUCCESS;
+
+    pthread_mutex_lock(&drv->lock);
+    surface = NULL_LOOKUP(drv, surface, surface_id);
+    obj_image = NULL_LOOKUP(drv, image, image_id);
+    if (obj_image)
+        buffer = NULL_LOOKUP(drv, buffer, obj_image->image.buf);
+
+    if (!surface)
+        va_status = VA_STATUS_ERROR_INVALID_SURFACE;
+    else if (!obj_image || !buffer)
+        va_status = VA_STATUS_ERROR_INVALID_IMAGE;
+    else if (surface->derived_image != VA_INVALID_ID)
+        va_status = VA_STATUS_ERROR_SURFACE_BUSY;
+    else if (obj_image->image.format.fourcc != surface->layout.format.fourcc)
+        va_status = VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
+    else {
+        if (width > surface->layout.width)
+            width = surface->layout.width;
+        if (width > obj_image->image.width)
+            width = obj_image->image.width;
+        if (height > surface->layout.height)
+            height = surface->layout.height;
+        if (height > obj_image->image.height)
+            height = obj_image->image.height;
+
+        if (direction == 0)
+            null_copy_planes(&obj_image->image, buffer->data,
+                             &surface->layout, surface->data, width, height);
+        else
+            null_copy_planes(&surface->layout, surface->data,
+                             &obj_image->image, buffer->data, width, height);
+    }
+    pthread_mutex_unlock(&drv->lock);
+
+    return va_status;
+}
+
+static VAStatus null_GetImage(
+    VADriverContextP ctx,
+    VASurfaceID surface,
+    int x,
+    int y,
+    unsigned int width,
+    unsigned int height,
+    VAImageID image)
+{
+    if (x != 0 || y != 0)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    return null_transfer_image(ctx, surface, image, width, height, 0);
+}
+
+static VAStatus null_PutImage(
+    VADriverContextP ctx,
+    VASurfaceID surface,
+    VAImageID image,
+    int src_x,
+    int src_y,
+    unsigned int src_width,
+    unsigned int src_height,
+    int dest_x,
+    int dest_y,
+    unsigned int dest_width,
+    unsigned int dest_height)
+{
+    if (src_x != 0 || src_y != 0 || dest_x != 0 || dest_y != 0 ||
+        src_width != dest_width || src_height != dest_height)
+        return VA_STATUS_ERROR_UNIMPLEMENTED;
+
+    return null_transfer_image(ctx, surface, image, dest_width, dest_height, 1);
+}
+
+static VAStatus null_QuerySubpictureFormats(
+    VADriverContextP ctx,
+    VAImageFormat *format_list,
+    unsigned int *flags,
+    unsigned int *num_formats)
+{
+    unsigned int i;
+
+    for (i = 0; i < NULL_MAX_SUBPIC_FORMATS; i++) {
+        format_list[i] = null_subpic_formats[i];
+        if (flags)
+            flags[i] = 0;
+    }
+    *num_formats = NULL_MAX_SUBPIC_FORMATS;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_CreateSubpicture(
+    VADriverContextP ctx,
+    VAImageID image,
+    VASubpictureID *subpicture)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_subpic *obj_subpic;
+
+    obj_subpic = calloc(1, sizeof(*obj_subpic));
+    if (!obj_subpic)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    obj_subpic->image = image;
+
+    pthread_mutex_lock(&drv->lock);
+    if (!NULL_LOOKUP(drv, image, image)) {
+        pthread_mutex_unlock(&drv->lock);
+        free(obj_subpic);
+        return VA_STATUS_ERROR_INVALID_IMAGE;
+    }
+    *subpicture = null_heap_insert(&drv->subpic_heap, obj_subpic);
+    pthread_mutex_unlock(&drv->lock);
+
+    if (*subpicture == VA_INVALID_ID) {
+        free(obj_subpic);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_DestroySubpicture(VADriverContextP ctx, VASubpictureID subpicture)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_subpic *obj_subpic;
+
+    pthread_mutex_lock(&drv->lock);
+    obj_subpic = null_heap_remove(&drv->subpic_heap, subpicture);
+    pthread_mutex_unlock(&drv->lock);
+
+    if (!obj_subpic)
+        return VA_STATUS_ERROR_INVALID_SUBPICTURE;
+
+    free(obj_subpic);
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_lookup_subpicture(VADriverContextP ctx, VASubpictureID subpicture)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_subpic *obj_subpic;
+
+    pthread_mutex_lock(&drv->lock);
+    obj_subpic = NULL_LOOKUP(drv, subpic, subpicture);
+    pthread_mutex_unlock(&drv->lock);
+
+    return obj_subpic ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_INVALID_SUBPICTURE;
+}
+
+static VAStatus null_SetSubpictureImage(
+    VADriverContextP ctx,
+    VASubpictureID subpicture,
+    VAImageID image)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_subpic *obj_subpic;
+    VAStatus va_status = VA_STATUS_SUCCESS;
+
+    pthread_mutex_lock(&drv->lock);
+    obj_subpic = NULL_LOOKUP(drv, subpic, subpicture);
+    if (!obj_subpic)
+        va_status = VA_STATUS_ERROR_INVALID_SUBPICTURE;
+    else if (!NULL_LOOKUP(drv, image, image))
+        va_status = VA_STATUS_ERROR_INVALID_IMAGE;
+    else
+        obj_subpic->image = image;
+    pthread_mutex_unlock(&drv->lock);
+
+    return va_status;
+}
+
+static VAStatus null_SetSubpictureChromakey(
+    VADriverContextP ctx,
+    VASubpictureID subpicture,
+    unsigned int chromakey_min,
+    unsigned int chromakey_max,
+    unsigned int chromakey_mask)
+{
+    return null_lookup_subpicture(ctx, subpicture);
+}
+
+static VAStatus null_SetSubpictureGlobalAlpha(
+    VADriverContextP ctx,
+    VASubpictureID subpicture,
+    float global_alpha)
+{
+    return null_lookup_subpicture(ctx, subpicture);
+}
+
+static VAStatus null_AssociateSubpicture(
+    VADriverContextP ctx,
+    VASubpictureID subpicture,
+    VASurfaceID *target_surfaces,
+    int num_surfaces,
+    short src_x,
+    short src_y,
+    unsigned short src_width,
+    unsigned short src_height,
+    short dest_x,
+    short dest_y,
+    unsigned short dest_width,
+    unsigned short dest_height,
+    unsigned int flags)
+{
+    return null_lookup_subpicture(ctx, subpicture);
+}
+
+static VAStatus null_DeassociateSubpicture(
+    VADriverContextP ctx,
+    VASubpictureID subpicture,
+    VASurfaceID *target_surfaces,
+    int num_surfaces)
+{
+    return null_lookup_subpicture(ctx, subpicture);
+}
+
+static VAStatus null_QueryDisplayAttributes(
+    VADriverContextP ctx,
+    VADisplayAttribute *attr_list,
+    int *num_attributes)
+{
+    if (num_attributes)
+        *num_attributes = 0;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_GetDisplayAttributes(
+    VADriverContextP ctx,
+    VADisplayAttribute *attr_list,
+    int num_attributes)
+{
+    return VA_STATUS_ERROR_UNIMPLEMENTED;
+}
+
+static VAStatus null_SetDisplayAttributes(
+    VADriverContextP ctx,
+    VADisplayAttribute *attr_list,
+    int num_attributes)
+{
+    return VA_STATUS_ERROR_UNIMPLEMENTED;
+}
+
+static VAStatus null_LockSurface(
+    VADriverContextP ctx,
+    VASurfaceID surface_id,
+    unsigned int *fourcc,
+    unsigned int *luma_stride,
+    unsigned int *chroma_u_stride,
+    unsigned int *chroma_v_stride,
+    unsigned int *luma_offset,
+    unsigned int *chroma_u_offset,
+    unsigned int *chroma_v_offset,
+    unsigned int *buffer_name,
+    void **buffer)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_surface *surface;
+    const VAImage *layout;
+
+    pthread_mutex_lock(&drv->lock);
+    surface = NULL_LOOKUP(drv, surface, surface_id);
+    if (surface)
+        surface->locked++;
+    pthread_mutex_unlock(&drv->lock);
+
+    if (!surface)
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+
+    layout = &surface->layout;
+    *fourcc = layout->format.fourcc;
+    *luma_stride = layout->pitches[0];
+    *chroma_u_stride = layout->pitches[1];
+    *chroma_v_stride = layout->num_planes > 2 ? layout->pitches[2] : layout->pitches[1];
+    *luma_offset = layout->offsets[0];
+    *chroma_u_offset = layout->offsets[1];
+    *chroma_v_offset = layout->num_planes > 2 ? layout->offsets[2] : layout->offsets[1] + 1;
+    if (buffer_name)
+        *buffer_name = 0;
+    if (buffer)
+        *buffer = surface->data;
+
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_UnlockSurface(VADriverContextP ctx, VASurfaceID surface_id)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    struct null_surface *surface;
+
+    pthread_mutex_lock(&drv->lock);
+    surface = NULL_LOOKUP(drv, surface, surface_id);
+    if (surface && surface->locked > 0)
+        surface->locked--;
+    pthread_mutex_unlock(&drv->lock);
+
+    return surface ? VA_STATUS_SUCCESS : VA_STATUS_ERROR_INVALID_SURFACE;
+}
+
+static VAStatus null_ExportSurfaceHandle(
+    VADriverContextP ctx,
+    VASurfaceID surface_id,
+    uint32_t mem_type,
+    uint32_t flags,
+    void *descriptor)
+{
+    return VA_STATUS_ERROR_UNSUPPORTED_MEMORY_TYPE;
+}
+
+static VAStatus null_Copy(
+    VADriverContextP ctx,
+    VACopyObject *dst,
+    VACopyObject *src,
+    VACopyOption option)
+{
+    struct null_driver_data *drv = NULL_DRIVER_DATA(ctx);
+    VAStatus va_status = VA_STATUS_SUCCESS;
+
+    if (!dst || !src || dst->obj_type != src->obj_type)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    pthread_mutex_lock(&drv->lock);
+    if (src->obj_type == VACopyObjectSurface) {
+        struct null_surface *s = NULL_LOOKUP(drv, surface, src->object.surface_id);
+        struct null_surface *d = NULL_LOOKUP(drv, surface, dst->object.surface_id);
+
+        if (!s || !d)
+            va_status = VA_STATUS_ERROR_INVALID_SURFACE;
+        else if (s->layout.format.fourcc != d->layout.format.fourcc)
+            va_status = VA_STATUS_ERROR_INVALID_PARAMETER;
+        else
+            null_copy_planes(&d->layout, d->data, &s->layout, s->data,
+                             s->layout.width < d->layout.width ? s->layout.width : d->layout.width,
+                             s->layout.height < d->layout.height ? s->layout.height : d->layout.height);
+    } else if (src->obj_type == VACopyObjectBuffer) {
+        struct null_buffer *s = NULL_LOOKUP(drv, buffer, src->object.buffer_id);
+        struct null_buffer *d = NULL_LOOKUP(drv, buffer, dst->object.buffer_id);
+        size_t s_size, d_size;
+
+        if (!s || !d)
+            va_status = VA_STATUS_ERROR_INVALID_BUFFER;
+        else {
+            s_size = (size_t)s->size * s->num_elements;
+            d_size = (size_t)d->size * d->num_elements;
+            memcpy(d->data, s->data, s_size < d_size ? s_size : d_size);
+        }
+    } else
+        va_status = VA_STATUS_ERROR_INVALID_PARAMETER;
+    pthread_mutex_unlock(&drv->lock);
+
+    return va_status;
+}
+
+static VAStatus null_QueryVideoProcFilters(
+    VADriverContextP ctx,
+    VAContextID context,
+    VAProcFilterType *filters,
+    unsigned int *num_filters)
+{
+    if (!num_filters)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    *num_filters = 0;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus null_QueryVideoProcFilterCaps(
+    VADriverContextP ctx,
+    VAContextID context,
+    VAProcFilterType type,
+    void *filter_caps,
+    unsigned int *num_filter_caps)
+{
+    return VA_STATUS_ERROR_UNSUPPORTED_FILTER;
+}
+
+static VAStatus null_QueryVideoProcPipelineCaps(
+    VADriverContextP ctx,
+    VAContextID context,
+    VABufferID *filters,
+    unsigned int num_filters,
+    VAProcPipelineCaps *pipeline_caps)
+{
+    if (!pipeline_caps)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    if (num_filters > 0)
+        return VA_STATUS_ERROR_UNSUPPORTED_FILTER;
+
+    pipeline_caps->pipeline_flags = 0;
+    pipeline_caps->filter_flags = 0;
+    pipeline_caps->num_forward_references = 0;
+    pipeline_caps->num_backward_references = 0;
+    pipeline_caps->rotation_flags = 0;
+    pipeline_caps->blend_flags = 0;
+    pipeline_caps->mirror_flags = 0;
+    pipeline_caps->num_additional_outputs = 0;
+    pipeline_caps->num_input_pixel_formats = 0;
+    pipeline_caps->num_output_pixel_formats = 0;
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus DLL_EXPORT NULL_DRIVER_INIT_FUNC(VA_MAJOR_VERSION, VA_MINOR_VERSION)(VADriverContextP ctx);
+
+VAStatus NULL_DRIVER_INIT_FUNC(VA_MAJOR_VERSION, VA_MINOR_VERSION)(VADriverContextP ctx)
+{
+    struct VADriverVTable * const vtable = ctx->vtable;
+    struct VADriverVTableVPP * const vtable_vpp = ctx->vtable_vpp;
+    struct null_driver_data *drv;
+
+    drv = calloc(1, sizeof(*drv));
+    if (!drv)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+    pthread_mutex_init(&drv->lock, NULL);
+    null_heap_init(&drv->config_heap, NULL_CONFIG_ID_BASE);
+    null_heap_init(&drv->context_heap, NULL_CONTEXT_ID_BASE);
+    null_heap_init(&drv->surface_heap, NULL_SURFACE_ID_BASE);
+    null_heap_init(&drv->buffer_heap, NULL_BUFFER_ID_BASE);
+    null_heap_init(&drv->image_heap, NULL_IMAGE_ID_BASE);
+    null_heap_init(&drv->subpic_heap, NULL_SUBPIC_ID_BASE);
+
+    drv->submit_latency_ns = null_get_latency_env("LIBVA_NULL_SUBMIT_LATENCY_US");
+    drv->sync_latency_ns = null_get_latency_env("LIBVA_NULL_SYNC_LATENCY_US");
+
+    ctx->pDriverData = drv;
+    ctx->version_major = VA_MAJOR_VERSION;
+    ctx->version_minor = VA_MINOR_VERSION;
+    ctx->max_profiles = NULL_MAX_PROFILES;
+    ctx->max_entrypoints = NULL_MAX_ENTRYPOINTS;
+    ctx->max_attributes = NULL_MAX_CONFIG_ATTRIBUTES;
+    ctx->max_image_formats = ARRAY_SIZE(null_image_formats);
+    ctx->max_subpic_formats = NULL_MAX_SUBPIC_FORMATS;
+    ctx->max_display_attributes = NULL_MAX_DISPLAY_ATTRIBUTES;
+    ctx->str_vendor = NULL_VENDOR_STRING;
+
+    vtable->vaTerminate = null_Terminate;
+    vtable->vaQueryConfigProfiles = null_QueryConfigProfiles;
+    vtable->vaQueryConfigEntrypoints = null_QueryConfigEntrypoints;
+    vtable->vaGetConfigAttributes = null_GetConfigAttributes;
+    vtable->vaCreateConfig = null_CreateConfig;
+    vtable->vaDestroyConfig = null_DestroyConfig;
+    vtable->vaQueryConfigAttributes = null_QueryConfigAttributes;
+    vtable->vaCreateSurfaces = null_CreateSurfaces;
+    vtable->vaDestroySurfaces = null_DestroySurfaces;
+    vtable->vaCreateContext = null_CreateContext;
+    vtable->vaDestroyContext = null_DestroyContext;
+    vtable->vaCreateBuffer = null_CreateBuffer;
+    vtable->vaBufferSetNumElements = null_BufferSetNumElements;
+    vtable->vaMapBuffer = null_MapBuffer;
+    vtable->vaUnmapBuffer = null_UnmapBuffer;
+    vtable->vaDestroyBuffer = null_DestroyBuffer;
+    vtable->vaBeginPicture = null_BeginPicture;
+    vtable->vaRenderPicture = null_RenderPicture;
+    vtable->vaEndPicture = null_EndPicture;
+    vtable->vaSyncSurface = null_SyncSurface;
+    vtable->vaQuerySurfaceStatus = null_QuerySurfaceStatus;
+    vtable->vaQuerySurfaceError = null_QuerySurfaceError;
+    vtable->vaPutSurface = NULL;
+    vtable->vaQueryImageFormats = null_QueryImageFormats;
+    vtable->vaCreateImage = null_CreateImage;
+    vtable->vaDeriveImage = null_DeriveImage;
+    vtable->vaDestroyImage = null_DestroyImage;
+    vtable->vaSetImagePalette = null_SetImagePalette;
+    vtable->vaGetImage = null_GetImage;
+    vtable->vaPutImage = null_PutImage;
+    vtable->vaQuerySubpictureFormats = null_QuerySubpictureFormats;
+    vtable->vaCreateSubpicture = null_CreateSubpicture;
+    vtable->vaDestroySubpicture = null_DestroySubpicture;
+    vtable->vaSetSubpictureImage = null_SetSubpictureImage;
+    vtable->vaSetSubpictureChromakey = null_SetSubpictureChromakey;
+    vtable->vaSetSubpictureGlobalAlpha = null_SetSubpictureGlobalAlpha;
+    vtable->vaAssociateSubpicture = null_AssociateSubpicture;
+    vtable->vaDeassociateSubpicture = null_DeassociateSubpicture;
+    vtable->vaQueryDisplayAttributes = null_QueryDisplayAttributes;
+    vtable->vaGetDisplayAttributes = null_GetDisplayAttributes;
+    vtable->vaSetDisplayAttributes = null_SetDisplayAttributes;
+    vtable->vaBufferInfo = null_BufferInfo;
+    vtable->vaLockSurface = null_LockSurface;
+    vtable->vaUnlockSurface = null_UnlockSurface;
+    vtable->vaCreateSurfaces2 = null_CreateSurfaces2;
+    vtable->vaQuerySurfaceAttributes = null_QuerySurfaceAttributes;
+    vtable->vaExportSurfaceHandle = null_ExportSurfaceHandle;
+    vtable->vaSyncSurface2 = null_SyncSurface2;
+    vtable->vaSyncBuffer = null_SyncBuffer;
+    vtable->vaCopy = null_Copy;
+    vtable->vaMapBuffer2 = null_MapBuffer2;
+    vtable->vaSubmitPicture = null_SubmitPicture;
+#if defined(__linux__)
+    vtable->vaGetSurfaceSyncFd = null_GetSurfaceSyncFd;
+    vtable->vaGetBufferSyncFd = null_GetBufferSyncFd;
+#endif
+
+    vtable_vpp->vaQueryVideoProcFilters = null_QueryVideoProcFilters;
+    vtable_vpp->vaQueryVideoProcFilterCaps = null_QueryVideoProcFilterCaps;
+    vtable_vpp->vaQueryVideoProcPipelineCaps = null_QueryVideoProcPipelineCaps;
+
+    return VA_STATUS_SUCCESS;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2025 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * va_trace_decode renders a log captured with LIBVA_TRACE_FORMAT=binary
+ * as the text log LIBVA_TRACE would have written. It is built with its own
+ * copy of va_trace.c so the buffer printers are shared with libva.
+ */
+
+#include "sysdeps.h"
+#include "va.h"
+#include "va_backend.h"
+#include "va_internal.h"
+#include "va_trace.h"
+#include <stdarg.h>
+#include <unistd.h>
+
+static const char *program_name = "va_trace_decode";
+
+/* va.c helpers used by va_trace.c, not exported by libva */
+void va_errorMessage(VADisplay dpy, const char *msg, ...)
+{
+    va_list args;
+
+    fprintf(stderr, "%s error: ", program_name);
+    va_start(args, msg);
+    vfprintf(stderr, msg, args);
+    va_end(args);
+}
+
+void va_infoMessage(VADisplay dpy, const char *msg, ...)
+{
+    va_list args;
+
+    fprintf(stderr, "%s: ", program_name);
+    va_start(args, msg);
+    vfprintf(stderr, msg, args);
+    va_end(args);
+}
+
+int va_parseConfig(char *env, char *env_value)
+{
+    return 1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: %s [-o output] binary_log\n", program_name);
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = NULL;
+    FILE *in = NULL;
+    FILE *out = stdout;
+    int ret = 1;
+    int c;
+
+    while ((c = getopt(argc, argv, "o:h")) != -1) {
+        switch (c) {
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            usage();
+            return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage();
+        return 1;
+    }
+
+    in = fopen(argv[optind], "rb");
+    if (!in) {
+        va_errorMessage(NULL, "can't open %s\n", argv[optind]);
+        return 1;
+    }
+
+    if (output) {
+        out = fopen(output, "w");
+        if (!out) {
+            va_errorMessage(NULL, "can't open %s\n", output);
+            fclose(in);
+            return 1;
+        }
+    }
+
+    if (va_TraceDecode(in, out) == 0)
+        ret = 0;
+    else
+        va_errorMessage(NULL, "%s is not a complete binary trace log\n", argv[optind]);
+
+    if (out != stdout)
+        fclose(out);
+    fclose(in);
+
+    return ret;
+}
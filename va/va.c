@@ -30,6 +30,10 @@
 #include "va_backend_vpp.h"
 #include "va_internal.h"
 #include "va_trace.h"
+#include "va_stats.h"
+#include "va_caps.h"
+#include "va_pool.h"
+#include "va_sync.h"
 
 #include <assert.h>
 #include <stdarg.h>
@@ -43,7 +47,9 @@
 #define ENV_VAR_SEPARATOR ";"
 #else
 #include <dlfcn.h>
+#include <pthread.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #define DRIVER_EXTENSION    "_drv_video.so"
 #define DRIVER_PATH_STRING  "%s/%s%s"
 #define ENV_VAR_SEPARATOR ":"
@@ -61,19 +67,84 @@
 
 
 /*
- * read a config "env" for libva.conf or from environment setting
- * libva.conf has higher priority
- * return 0: the "env" is set, and the value is copied into env_value
- *        1: the env is not set
+ * libva.conf is parsed once into a small hash table, on the first lookup.
+ * va_reloadConfig() drops the table when the last initialized display
+ * terminates, so that the next vaInitialize() reads the file again.
  */
-int va_parseConfig(char *env, char *env_value)
+#define VA_CONFIG_HASH_SIZE     64
+
+struct va_config_entry {
+    struct va_config_entry *next;
+    char *key;
+    char *value;
+};
+
+static struct va_config_entry *va_config_table[VA_CONFIG_HASH_SIZE];
+static int va_config_loaded = 0;
+static unsigned int va_config_displays = 0; /* initialized displays */
+
+#if defined(_WIN32)
+static SRWLOCK va_config_lock = SRWLOCK_INIT;
+#define VA_CONFIG_LOCK()    AcquireSRWLockExclusive(&va_config_lock)
+#define VA_CONFIG_UNLOCK()  ReleaseSRWLockExclusive(&va_config_lock)
+#else
+static pthread_mutex_t va_config_lock = PTHREAD_MUTEX_INITIALIZER;
+#define VA_CONFIG_LOCK()    pthread_mutex_lock(&va_config_lock)
+#define VA_CONFIG_UNLOCK()  pthread_mutex_unlock(&va_config_lock)
+#endif
+
+static unsigned int va_config_hash(const char *key)
 {
+    unsigned int hash = 2166136261u;
+
+    for (; *key; key++) {
+        hash ^= (unsigned char)*key;
+        hash *= 16777619u;
+    }
+
+    return hash % VA_CONFIG_HASH_SIZE;
+}
+
+static struct va_config_entry *va_config_find(const char *key)
+{
+    struct va_config_entry *entry;
+
+    for (entry = va_config_table[va_config_hash(key)]; entry; entry = entry->next) {
+        if (strcmp(entry->key, key) == 0)
+            return entry;
+    }
+
+    return NULL;
+}
+
+static void va_config_free(void)
+{
+    struct va_config_entry *entry, *next;
+    unsigned int i;
+
+    for (i = 0; i < VA_CONFIG_HASH_SIZE; i++) {
+        for (entry = va_config_table[i]; entry; entry = next) {
+            next = entry->next;
+            free(entry->key);
+            free(entry->value);
+            free(entry);
+        }
+        va_config_table[i] = NULL;
+    }
+
+    va_config_loaded = 0;
+}
+
+/* must be called with va_config_lock held */
+static void va_config_load(void)
+{
+    struct va_config_entry *entry;
     char *token, *value, *saveptr;
     char oneline[1024];
+    unsigned int hash;
     FILE *fp = NULL;
 
-    if (env == NULL)
-        return 1;
+    va_config_loaded = 1;
 
     fp = fopen(SYSCONFDIR "/libva.conf", "r");
     while (fp && (fgets(oneline, 1024, fp) != NULL)) {
@@ -85,19 +156,83 @@ int va_parseConfig(char *env, char *env_value)
         if (NULL == token || NULL == value)
             continue;
 
-        if (strcmp(token, env) == 0) {
-            if (env_value) {
-                strncpy(env_value, value, 1024);
-                env_value[1023] = '\0';
-            }
-
-            fclose(fp);
+        /* the first setting of a key wins */
+        if (va_config_find(token))
+            continue;
 
-            return 0;
+        entry = calloc(1, sizeof(*entry));
+        if (entry) {
+            entry->key = strdup(token);
+            entry->value = strdup(value);
         }
+        if (!entry || !entry->key || !entry->value) {
+            if (entry) {
+                free(entry->key);
+                free(entry->value);
+                free(entry);
+            }
+            break;
+        }
+
+        hash = va_config_hash(token);
+        entry->next = va_config_table[hash];
+        va_config_table[hash] = entry;
     }
     if (fp)
         fclose(fp);
+}
+
+/*
+ * a display was initialized, libva.conf stays parsed while it lives
+ */
+static void va_config_display_begin(void)
+{
+    VA_CONFIG_LOCK();
+    va_config_displays++;
+    VA_CONFIG_UNLOCK();
+}
+
+/*
+ * a display terminated, drop the parsed libva.conf with the last one so
+ * that long-running processes see the edits on the next vaInitialize()
+ */
+void va_reloadConfig(void)
+{
+    VA_CONFIG_LOCK();
+    if (va_config_displays && --va_config_displays == 0)
+        va_config_free();
+    VA_CONFIG_UNLOCK();
+}
+
+/*
+ * read a config "env" for libva.conf or from environment setting
+ * libva.conf has higher priority
+ * return 0: the "env" is set, and the value is copied into env_value
+ *        1: the env is not set
+ */
+int va_parseConfig(char *env, char *env_value)
+{
+    struct va_config_entry *entry;
+    char *value;
+
+    if (env == NULL)
+        return 1;
+
+    VA_CONFIG_LOCK();
+    if (!va_config_loaded)
+        va_config_load();
+
+    entry = va_config_find(env);
+    if (entry) {
+        if (env_value) {
+            strncpy(env_value, entry->value, 1024);
+            env_value[1023] = '\0';
+        }
+        VA_CONFIG_UNLOCK();
+
+        return 0;
+    }
+    VA_CONFIG_UNLOCK();
 
     /* no setting in config file, use env setting */
     value = secure_getenv(env);
@@ -357,21 +492,301 @@ static char *va_getDriverPath(const char *driver_dir, const char *driver_name)
     return driver_path;
 }
 
-static VAStatus va_openDriver(VADisplay dpy, char *driver_name)
+static void *va_dlopenDriver(const char *driver_path)
+{
+#if defined(RTLD_NODELETE) && !defined(ANDROID)
+    return dlopen(driver_path, RTLD_NOW | RTLD_GLOBAL | RTLD_NODELETE);
+#else
+    return dlopen(driver_path, RTLD_NOW | RTLD_GLOBAL);
+#endif
+}
+
+/*
+ * Call the init function of a loaded driver and check the result.
+ * The driver handle is kept in the driver context on success and
+ * closed on failure.
+ */
+static VAStatus va_initDriver(VADisplay dpy, const char *driver_path,
+                              void *handle, VADriverInit init_func)
 {
     VADriverContextP ctx = CTX(dpy);
+    struct VADriverVTable *vtable = ctx->vtable;
+    struct VADriverVTableVPP *vtable_vpp = ctx->vtable_vpp;
+    struct VADriverVTableProt *vtable_prot = ctx->vtable_prot;
+    VAStatus vaStatus = VA_STATUS_SUCCESS;
+
+    if (!vtable) {
+        vtable = calloc(1, sizeof(*vtable));
+        if (!vtable)
+            vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+    ctx->vtable = vtable;
+
+    if (!vtable_vpp) {
+        vtable_vpp = calloc(1, sizeof(*vtable_vpp));
+        if (vtable_vpp)
+            vtable_vpp->version = VA_DRIVER_VTABLE_VPP_VERSION;
+        else
+            vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+    ctx->vtable_vpp = vtable_vpp;
+
+    if (!vtable_prot) {
+        vtable_prot = calloc(1, sizeof(*vtable_prot));
+        if (vtable_prot)
+            vtable_prot->version = VA_DRIVER_VTABLE_PROT_VERSION;
+        else
+            vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+    ctx->vtable_prot = vtable_prot;
+
+    if (init_func && VA_STATUS_SUCCESS == vaStatus)
+        vaStatus = (*init_func)(ctx);
+
+    if (VA_STATUS_SUCCESS == vaStatus) {
+        CHECK_MAXIMUM(vaStatus, ctx, profiles);
+        CHECK_MAXIMUM(vaStatus, ctx, entrypoints);
+        CHECK_MAXIMUM(vaStatus, ctx, attributes);
+        CHECK_MAXIMUM(vaStatus, ctx, image_formats);
+        CHECK_MAXIMUM(vaStatus, ctx, subpic_formats);
+        CHECK_STRING(vaStatus, ctx, vendor);
+        CHECK_VTABLE(vaStatus, ctx, Terminate);
+        CHECK_VTABLE(vaStatus, ctx, QueryConfigProfiles);
+        CHECK_VTABLE(vaStatus, ctx, QueryConfigEntrypoints);
+        CHECK_VTABLE(vaStatus, ctx, QueryConfigAttributes);
+        CHECK_VTABLE(vaStatus, ctx, CreateConfig);
+        CHECK_VTABLE(vaStatus, ctx, DestroyConfig);
+        CHECK_VTABLE(vaStatus, ctx, GetConfigAttributes);
+        CHECK_VTABLE(vaStatus, ctx, CreateSurfaces);
+        CHECK_VTABLE(vaStatus, ctx, DestroySurfaces);
+        CHECK_VTABLE(vaStatus, ctx, CreateContext);
+        CHECK_VTABLE(vaStatus, ctx, DestroyContext);
+        CHECK_VTABLE(vaStatus, ctx, CreateBuffer);
+        CHECK_VTABLE(vaStatus, ctx, BufferSetNumElements);
+        CHECK_VTABLE(vaStatus, ctx, MapBuffer);
+        CHECK_VTABLE(vaStatus, ctx, UnmapBuffer);
+        CHECK_VTABLE(vaStatus, ctx, DestroyBuffer);
+        CHECK_VTABLE(vaStatus, ctx, BeginPicture);
+        CHECK_VTABLE(vaStatus, ctx, RenderPicture);
+        CHECK_VTABLE(vaStatus, ctx, EndPicture);
+        CHECK_VTABLE(vaStatus, ctx, SyncSurface);
+        CHECK_VTABLE(vaStatus, ctx, QuerySurfaceStatus);
+        CHECK_VTABLE(vaStatus, ctx, QueryImageFormats);
+        CHECK_VTABLE(vaStatus, ctx, CreateImage);
+        CHECK_VTABLE(vaStatus, ctx, DeriveImage);
+        CHECK_VTABLE(vaStatus, ctx, DestroyImage);
+        CHECK_VTABLE(vaStatus, ctx, SetImagePalette);
+        CHECK_VTABLE(vaStatus, ctx, GetImage);
+        CHECK_VTABLE(vaStatus, ctx, PutImage);
+        CHECK_VTABLE(vaStatus, ctx, QuerySubpictureFormats);
+        CHECK_VTABLE(vaStatus, ctx, CreateSubpicture);
+        CHECK_VTABLE(vaStatus, ctx, DestroySubpicture);
+        CHECK_VTABLE(vaStatus, ctx, SetSubpictureImage);
+        CHECK_VTABLE(vaStatus, ctx, SetSubpictureChromakey);
+        CHECK_VTABLE(vaStatus, ctx, SetSubpictureGlobalAlpha);
+        CHECK_VTABLE(vaStatus, ctx, AssociateSubpicture);
+        CHECK_VTABLE(vaStatus, ctx, DeassociateSubpicture);
+        CHECK_VTABLE(vaStatus, ctx, QueryDisplayAttributes);
+        CHECK_VTABLE(vaStatus, ctx, GetDisplayAttributes);
+        CHECK_VTABLE(vaStatus, ctx, SetDisplayAttributes);
+    }
+    if (VA_STATUS_SUCCESS != vaStatus) {
+        va_errorMessage(dpy, "%s init failed\n", driver_path);
+        dlclose(handle);
+    }
+    if (VA_STATUS_SUCCESS == vaStatus)
+        ctx->handle = handle;
+
+    return vaStatus;
+}
+
+#if !defined(_WIN32)
+/*
+ * Driver resolution cache, enabled by LIBVA_DRIVER_CACHE=<file>.
+ *
+ * Each line of the cache file maps a driver name, a drivers search path and
+ * the libva version to the driver that was found last time, its init
+ * function, and the mtime/size of the driver file. The version keeps a
+ * downgraded libva from calling the init function of a newer vtable. The
+ * device is implied by the driver name, which the display backend derives
+ * from the device ID. A matching entry lets va_openDriver() skip the search
+ * path walk and the init function probing; any mismatch falls back to the
+ * full search.
+ */
+#define VA_DRIVER_CACHE_FIELDS  7
+
+static bool va_getDriverCacheFile(char cache_file[1024])
+{
+    /* don't let setuid apps write to a user supplied file */
+    if (geteuid() != getuid() || getegid() != getgid())
+        return false;
+
+    return va_parseConfig("LIBVA_DRIVER_CACHE", cache_file) == 0 && cache_file[0];
+}
+
+/* split a cache line into its fields, return true when it is well formed */
+static bool va_parseDriverCacheLine(char *line, char *fields[VA_DRIVER_CACHE_FIELDS])
+{
+    char *saveptr;
+    int i;
+
+    for (i = 0; i < VA_DRIVER_CACHE_FIELDS; i++) {
+        fields[i] = strtok_r(i ? NULL : line, "\t\n", &saveptr);
+        if (!fields[i])
+            return false;
+    }
+    return true;
+}
+
+/* the entries of another libva version are never used */
+static bool va_matchDriverCacheLine(char *fields[VA_DRIVER_CACHE_FIELDS],
+                                    const char *driver_name, const char *search_path)
+{
+    char version[32];
+
+    snprintf(version, sizeof(version), "%d.%d", VA_MAJOR_VERSION, VA_MINOR_VERSION);
+
+    return strcmp(fields[0], driver_name) == 0 &&
+           strcmp(fields[1], search_path) == 0 &&
+           strcmp(fields[2], version) == 0;
+}
+
+static VAStatus va_openCachedDriver(VADisplay dpy, const char *driver_name,
+                                    const char *search_path)
+{
+    char cache_file[1024];
+    char *fields[VA_DRIVER_CACHE_FIELDS] = { NULL };
+    char oneline[4096];
+    VADriverInit init_func;
+    struct stat st;
+    void *handle;
+    bool found = false;
+    FILE *fp;
+
+    if (!va_getDriverCacheFile(cache_file))
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    fp = fopen(cache_file, "r");
+    if (!fp)
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    while (fgets(oneline, sizeof(oneline), fp)) {
+        if (va_parseDriverCacheLine(oneline, fields) &&
+            va_matchDriverCacheLine(fields, driver_name, search_path)) {
+            found = true;
+            break;
+        }
+    }
+    fclose(fp);
+
+    if (!found)
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    if (stat(fields[3], &st) != 0 ||
+        (unsigned long long)st.st_mtime != strtoull(fields[5], NULL, 10) ||
+        (unsigned long long)st.st_size != strtoull(fields[6], NULL, 10))
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    handle = va_dlopenDriver(fields[3]);
+    if (!handle)
+        return VA_STATUS_ERROR_UNKNOWN;
+
+    init_func = (VADriverInit)dlsym(handle, fields[4]);
+    if (!init_func) {
+        dlclose(handle);
+        return VA_STATUS_ERROR_UNKNOWN;
+    }
+
+    va_infoMessage(dpy, "Using cached driver %s\n", fields[3]);
+    va_infoMessage(dpy, "Found init function %s\n", fields[4]);
+
+    return va_initDriver(dpy, fields[3], handle, init_func);
+}
+
+static void va_cacheDriver(VADisplay dpy, const char *driver_name,
+                           const char *search_path, const char *driver_path,
+                           const char *init_func_s)
+{
+    char cache_file[1024];
+    char *fields[VA_DRIVER_CACHE_FIELDS];
+    char oneline[4096], line_copy[4096];
+    char *tmp_file;
+    struct stat st;
+    FILE *fp, *tmp_fp;
+    int fd;
+
+    if (!va_getDriverCacheFile(cache_file) || stat(driver_path, &st) != 0)
+        return;
+
+    if (asprintf(&tmp_file, "%s.XXXXXX", cache_file) < 0)
+        return;
+
+    fd = mkstemp(tmp_file);
+    tmp_fp = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!tmp_fp) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp_file);
+        }
+        free(tmp_file);
+        return;
+    }
+
+    /* keep the entries of the other drivers and search paths */
+    fp = fopen(cache_file, "r");
+    while (fp && fgets(oneline, sizeof(oneline), fp)) {
+        strcpy(line_copy, oneline);
+        if (!va_parseDriverCacheLine(line_copy, fields))
+            continue;
+        if (va_matchDriverCacheLine(fields, driver_name, search_path))
+            continue;
+        fputs(oneline, tmp_fp);
+    }
+    if (fp)
+        fclose(fp);
+
+    fprintf(tmp_fp, "%s\t%s\t%d.%d\t%s\t%s\t%llu\t%llu\n", driver_name, search_path,
+            VA_MAJOR_VERSION, VA_MINOR_VERSION, driver_path, init_func_s,
+            (unsigned long long)st.st_mtime, (unsigned long long)st.st_size);
+
+    if (fclose(tmp_fp) != 0 || rename(tmp_file, cache_file) != 0) {
+        va_infoMessage(dpy, "Failed to update driver cache %s\n", cache_file);
+        unlink(tmp_file);
+    }
+    free(tmp_file);
+}
+#else
+static VAStatus va_openCachedDriver(VADisplay dpy, const char *driver_name,
+                                    const char *search_path)
+{
+    return VA_STATUS_ERROR_UNKNOWN;
+}
+
+static void va_cacheDriver(VADisplay dpy, const char *driver_name,
+                           const char *search_path, const char *driver_path,
+                           const char *init_func_s)
+{
+}
+#endif
+
+static VAStatus va_openDriver(VADisplay dpy, char *driver_name)
+{
     VAStatus vaStatus = VA_STATUS_ERROR_UNKNOWN;
+    const char *drivers_path = NULL;
     char *search_path = NULL;
     char *saveptr;
     char *driver_dir;
 
     if (geteuid() == getuid())
         /* don't allow setuid apps to use LIBVA_DRIVERS_PATH */
-        search_path = secure_getenv("LIBVA_DRIVERS_PATH");
-    if (!search_path)
-        search_path = VA_DRIVERS_PATH;
+        drivers_path = secure_getenv("LIBVA_DRIVERS_PATH");
+    if (!drivers_path)
+        drivers_path = VA_DRIVERS_PATH;
+
+    if (va_openCachedDriver(dpy, driver_name, drivers_path) == VA_STATUS_SUCCESS)
+        return VA_STATUS_SUCCESS;
 
-    search_path = strdup((const char *)search_path);
+    search_path = strdup(drivers_path);
     if (!search_path) {
         va_errorMessage(dpy, "%s L%d Out of memory\n",
                         __FUNCTION__, __LINE__);
@@ -389,11 +804,7 @@ static VAStatus va_openDriver(VADisplay dpy, char *driver_name)
         }
 
         va_infoMessage(dpy, "Trying to open %s\n", driver_path);
-#if defined(RTLD_NODELETE) && !defined(ANDROID)
-        handle = dlopen(driver_path, RTLD_NOW | RTLD_GLOBAL | RTLD_NODELETE);
-#else
-        handle = dlopen(driver_path, RTLD_NOW | RTLD_GLOBAL);
-#endif
+        handle = va_dlopenDriver(driver_path);
         if (!handle) {
             /* Don't give errors for non-existing files */
             if (0 == access(driver_path, F_OK))
@@ -431,92 +842,9 @@ static VAStatus va_openDriver(VADisplay dpy, char *driver_name)
                                 driver_path, init_func_s);
                 dlclose(handle);
             } else {
-                struct VADriverVTable *vtable = ctx->vtable;
-                struct VADriverVTableVPP *vtable_vpp = ctx->vtable_vpp;
-                struct VADriverVTableProt *vtable_prot = ctx->vtable_prot;
-
-                vaStatus = VA_STATUS_SUCCESS;
-                if (!vtable) {
-                    vtable = calloc(1, sizeof(*vtable));
-                    if (!vtable)
-                        vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
-                }
-                ctx->vtable = vtable;
-
-                if (!vtable_vpp) {
-                    vtable_vpp = calloc(1, sizeof(*vtable_vpp));
-                    if (vtable_vpp)
-                        vtable_vpp->version = VA_DRIVER_VTABLE_VPP_VERSION;
-                    else
-                        vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
-                }
-                ctx->vtable_vpp = vtable_vpp;
-
-                if (!vtable_prot) {
-                    vtable_prot = calloc(1, sizeof(*vtable_prot));
-                    if (vtable_prot)
-                        vtable_prot->version = VA_DRIVER_VTABLE_PROT_VERSION;
-                    else
-                        vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
-                }
-                ctx->vtable_prot = vtable_prot;
-
-                if (init_func && VA_STATUS_SUCCESS == vaStatus)
-                    vaStatus = (*init_func)(ctx);
-
-                if (VA_STATUS_SUCCESS == vaStatus) {
-                    CHECK_MAXIMUM(vaStatus, ctx, profiles);
-                    CHECK_MAXIMUM(vaStatus, ctx, entrypoints);
-                    CHECK_MAXIMUM(vaStatus, ctx, attributes);
-                    CHECK_MAXIMUM(vaStatus, ctx, image_formats);
-                    CHECK_MAXIMUM(vaStatus, ctx, subpic_formats);
-                    CHECK_STRING(vaStatus, ctx, vendor);
-                    CHECK_VTABLE(vaStatus, ctx, Terminate);
-                    CHECK_VTABLE(vaStatus, ctx, QueryConfigProfiles);
-                    CHECK_VTABLE(vaStatus, ctx, QueryConfigEntrypoints);
-                    CHECK_VTABLE(vaStatus, ctx, QueryConfigAttributes);
-                    CHECK_VTABLE(vaStatus, ctx, CreateConfig);
-                    CHECK_VTABLE(vaStatus, ctx, DestroyConfig);
-                    CHECK_VTABLE(vaStatus, ctx, GetConfigAttributes);
-                    CHECK_VTABLE(vaStatus, ctx, CreateSurfaces);
-                    CHECK_VTABLE(vaStatus, ctx, DestroySurfaces);
-                    CHECK_VTABLE(vaStatus, ctx, CreateContext);
-                    CHECK_VTABLE(vaStatus, ctx, DestroyContext);
-                    CHECK_VTABLE(vaStatus, ctx, CreateBuffer);
-                    CHECK_VTABLE(vaStatus, ctx, BufferSetNumElements);
-                    CHECK_VTABLE(vaStatus, ctx, MapBuffer);
-                    CHECK_VTABLE(vaStatus, ctx, UnmapBuffer);
-                    CHECK_VTABLE(vaStatus, ctx, DestroyBuffer);
-                    CHECK_VTABLE(vaStatus, ctx, BeginPicture);
-                    CHECK_VTABLE(vaStatus, ctx, RenderPicture);
-                    CHECK_VTABLE(vaStatus, ctx, EndPicture);
-                    CHECK_VTABLE(vaStatus, ctx, SyncSurface);
-                    CHECK_VTABLE(vaStatus, ctx, QuerySurfaceStatus);
-                    CHECK_VTABLE(vaStatus, ctx, QueryImageFormats);
-                    CHECK_VTABLE(vaStatus, ctx, CreateImage);
-                    CHECK_VTABLE(vaStatus, ctx, DeriveImage);
-                    CHECK_VTABLE(vaStatus, ctx, DestroyImage);
-                    CHECK_VTABLE(vaStatus, ctx, SetImagePalette);
-                    CHECK_VTABLE(vaStatus, ctx, GetImage);
-                    CHECK_VTABLE(vaStatus, ctx, PutImage);
-                    CHECK_VTABLE(vaStatus, ctx, QuerySubpictureFormats);
-                    CHECK_VTABLE(vaStatus, ctx, CreateSubpicture);
-                    CHECK_VTABLE(vaStatus, ctx, DestroySubpicture);
-                    CHECK_VTABLE(vaStatus, ctx, SetSubpictureImage);
-                    CHECK_VTABLE(vaStatus, ctx, SetSubpictureChromakey);
-                    CHECK_VTABLE(vaStatus, ctx, SetSubpictureGlobalAlpha);
-                    CHECK_VTABLE(vaStatus, ctx, AssociateSubpicture);
-                    CHECK_VTABLE(vaStatus, ctx, DeassociateSubpicture);
-                    CHECK_VTABLE(vaStatus, ctx, QueryDisplayAttributes);
-                    CHECK_VTABLE(vaStatus, ctx, GetDisplayAttributes);
-                    CHECK_VTABLE(vaStatus, ctx, SetDisplayAttributes);
-                }
-                if (VA_STATUS_SUCCESS != vaStatus) {
-                    va_errorMessage(dpy, "%s init failed\n", driver_path);
-                    dlclose(handle);
-                }
+                vaStatus = va_initDriver(dpy, driver_path, handle, init_func);
                 if (VA_STATUS_SUCCESS == vaStatus)
-                    ctx->handle = handle;
+                    va_cacheDriver(dpy, driver_name, drivers_path, driver_path, init_func_s);
                 free(driver_path);
                 break;
             }
@@ -725,10 +1053,18 @@ VAStatus vaInitialize(
 
     va_MessagingInit();
 
+    va_StatsInit(dpy);
+
     va_infoMessage(dpy, "VA-API version %s\n", VA_VERSION_S);
 
     vaStatus = va_new_opendriver(dpy);
 
+    if (vaStatus == VA_STATUS_SUCCESS) {
+        va_CapsInit(dpy);
+        va_PoolInit(dpy);
+        va_config_display_begin();
+    }
+
     *major_version = VA_MAJOR_VERSION;
     *minor_version = VA_MINOR_VERSION;
 
@@ -752,10 +1088,16 @@ VAStatus vaTerminate(
     CHECK_DISPLAY(dpy);
     old_ctx = CTX(dpy);
 
+    /* pooled buffers go back to the driver before it is unloaded */
+    va_PoolEnd(dpy);
+
+    va_SyncEnd(dpy);
+
     if (old_ctx->handle) {
         vaStatus = old_ctx->vtable->vaTerminate(old_ctx);
         dlclose(old_ctx->handle);
         old_ctx->handle = NULL;
+        va_reloadConfig();
     }
     free(old_ctx->vtable);
     old_ctx->vtable = NULL;
@@ -774,6 +1116,10 @@ VAStatus vaTerminate(
 
     va_TraceEnd(dpy);
 
+    va_StatsEnd(dpy);
+
+    va_CapsEnd(dpy);
+
     if (VA_STATUS_SUCCESS == vaStatus)
         pDisplayContext->vaDestroy(pDisplayContext);
 
@@ -840,12 +1186,12 @@ VAStatus vaQueryConfigEntrypoints(
     int *num_entrypoints    /* out */
 )
 {
-    VADriverContextP ctx;
     VAStatus vaStatus = VA_STATUS_SUCCESS;
     CHECK_DISPLAY(dpy);
-    ctx = CTX(dpy);
 
-    vaStatus = ctx->vtable->vaQueryConfigEntrypoints(ctx, profile, entrypoints, num_entrypoints);
+    VA_STATS_BEGIN(dpy);
+    vaStatus = va_CapsQueryConfigEntrypoints(dpy, profile, entrypoints, num_entrypoints);
+    VA_STATS_END(dpy, VA_STATS_QUERY_CONFIG_ENTRYPOINTS, vaStatus);
     VA_TRACE_RET(dpy, vaStatus);
     return vaStatus;
 }
@@ -858,12 +1204,12 @@ VAStatus vaGetConfigAttributes(
     int num_attribs
 )
 {
-    VADriverContextP ctx;
     VAStatus vaStatus = VA_STATUS_SUCCESS;
     CHECK_DISPLAY(dpy);
-    ctx = CTX(dpy);
 
-    vaStatus = ctx->vtable->vaGetConfigAttributes(ctx, profile, entrypoint, attrib_list, num_attribs);
+    VA_STATS_BEGIN(dpy);
+    vaStatus = va_CapsGetConfigAttributes(dpy, profile, entrypoint, attrib_list, num_attribs);
+    VA_STATS_END(dpy, VA_STATS_GET_CONFIG_ATTRIBUTES, vaStatus);
     VA_TRACE_RET(dpy, vaStatus);
     return vaStatus;
 }
@@ -874,12 +1220,12 @@ VAStatus vaQueryConfigProfiles(
     int *num_profiles       /* out */
 )
 {
-    VADriverContextP ctx;
     VAStatus vaStatus = VA_STATUS_SUCCESS;
     CHECK_DISPLAY(dpy);
-    ctx = CTX(dpy);
 
-    vaStatus =  ctx->vtable->vaQueryConfigProfiles(ctx, profile_list, num_profiles);
+    VA_STATS_BEGIN(dpy);
+    vaStatus = va_CapsQueryConfigProfiles(dpy, profile_list, num_profiles);
+    VA_STATS_END(dpy, VA_STATS_QUERY_CONFIG_PROFILES, vaStatus);
     VA_TRACE_RET(dpy, vaStatus);
     return vaStatus;
 }
@@ -900,7 +1246,9 @@ VAStatus vaCreateConfig(
     ctx = CTX(dpy);
 
     VA_TRACE_VVVA(dpy, CREATE_CONFIG, TRACE_BEGIN, profile, entrypoint, num_attribs, attrib_list);
+    VA_STATS_BEGIN(dpy);
     vaStatus = ctx->vtable->vaCreateConfig(ctx, profile, entrypoint, attrib_list, num_attribs, config_id);
+    VA_STATS_END(dpy, VA_STATS_CREATE_CONFIG, vaStatus);
 
     /* record the current entrypoint for further trace/fool determination */
     VA_TRACE_ALL(va_TraceCreateConfig, dpy, profile, entrypoint, attrib_list, num_attribs, config_id);
@@ -921,7 +1269,10 @@ VAStatus vaDestroyConfig(
     ctx = CTX(dpy);
 
     VA_TRACE_V(dpy, DESTROY_CONFIG, TRACE_BEGIN, config_id);
+    VA_STATS_BEGIN(dpy);
+    va_CapsDestroyConfig(dpy, config_id);
     vaStatus = ctx->vtable->vaDestroyConfig(ctx, config_id);
+    VA_STATS_END(dpy, VA_STATS_DESTROY_CONFIG, vaStatus);
 
     VA_TRACE_ALL(va_TraceDestroyConfig, dpy, config_id);
     VA_TRACE_RET(dpy, vaStatus);
@@ -968,12 +1319,16 @@ VAStatus vaQueryProcessingRate(
     return vaStatus;
 }
 
-/* XXX: this is a slow implementation that will be removed */
+/*
+ * Surface attributes of drivers without vaQuerySurfaceAttributes, built
+ * from vaGetSurfaceAttributes and the image formats. The result is cached
+ * per config by va_CapsQuerySurfaceAttributes, so this runs once per config.
+ */
 static VAStatus
 va_impl_query_surface_attributes(
     VADriverContextP    ctx,
     VAConfigID          config,
-    VASurfaceAttrib    *out_attribs,
+    VASurfaceAttrib   **out_attribs_ptr,
     unsigned int       *out_num_attribs_ptr
 )
 {
@@ -983,6 +1338,8 @@ va_impl_query_surface_attributes(
     unsigned int out_num_attribs;
     VAImageFormat *image_formats = NULL;
     int num_image_formats, i;
+    uint32_t *fourcc_set = NULL;
+    unsigned int set_size;
     VAStatus va_status;
 
     /* List of surface attributes to query */
@@ -999,8 +1356,6 @@ va_impl_query_surface_attributes(
         { VASurfaceAttribNone,          VAGenericValueTypeInteger }
     };
 
-    if (!out_attribs || !out_num_attribs_ptr)
-        return VA_STATUS_ERROR_INVALID_PARAMETER;
     if (!ctx->vtable->vaGetSurfaceAttributes)
         return VA_STATUS_ERROR_UNIMPLEMENTED;
 
@@ -1050,55 +1405,51 @@ va_impl_query_surface_attributes(
     if (va_status != VA_STATUS_SUCCESS)
         goto end;
 
-    /* Remove invalid entries */
+    /* Open addressed set of the pixel formats seen so far, at most half full */
+    for (set_size = 16; set_size < 2 * (unsigned int)num_image_formats; set_size <<= 1)
+        ;
+    fourcc_set = calloc(set_size, sizeof(*fourcc_set));
+    if (!fourcc_set) {
+        va_status = VA_STATUS_ERROR_ALLOCATION_FAILED;
+        goto end;
+    }
+
+    /* Remove invalid entries, compacting the list in place */
     out_num_attribs = 0;
+    out_attrib = attribs;
     for (n = 0; n < num_attribs; n++) {
         VASurfaceAttrib * const attrib = &attribs[n];
 
         if (attrib->flags == VA_SURFACE_ATTRIB_NOT_SUPPORTED)
             continue;
 
-        // Accept all surface attributes that are not pixel-formats
-        if (attrib->type != VASurfaceAttribPixelFormat) {
-            out_num_attribs++;
-            continue;
-        }
-
-        // Drop invalid pixel-format attribute
-        if (!attrib->value.value.i) {
-            attrib->flags = VA_SURFACE_ATTRIB_NOT_SUPPORTED;
-            continue;
-        }
-
-        // Check for duplicates
-        int is_duplicate = 0;
-        for (i = n - 1; i >= 0 && !is_duplicate; i--) {
-            const VASurfaceAttrib * const prev_attrib = &attribs[i];
-            if (prev_attrib->type != VASurfaceAttribPixelFormat)
-                break;
-            is_duplicate = prev_attrib->value.value.i == attrib->value.value.i;
+        if (attrib->type == VASurfaceAttribPixelFormat) {
+            uint32_t fourcc = attrib->value.value.i;
+            unsigned int slot;
+
+            // Drop invalid pixel-format attribute
+            if (!fourcc)
+                continue;
+
+            // Drop duplicates, 0 marks a free slot
+            slot = (fourcc * 2654435761u) & (set_size - 1);
+            while (fourcc_set[slot] && fourcc_set[slot] != fourcc)
+                slot = (slot + 1) & (set_size - 1);
+            if (fourcc_set[slot])
+                continue;
+            fourcc_set[slot] = fourcc;
         }
-        if (is_duplicate)
-            attrib->flags = VA_SURFACE_ATTRIB_NOT_SUPPORTED;
-        else
-            out_num_attribs++;
-    }
 
-    if (*out_num_attribs_ptr < out_num_attribs) {
-        *out_num_attribs_ptr = out_num_attribs;
-        va_status = VA_STATUS_ERROR_MAX_NUM_EXCEEDED;
-        goto end;
-    }
-
-    out_attrib = out_attribs;
-    for (n = 0; n < num_attribs; n++) {
-        const VASurfaceAttrib * const attrib = &attribs[n];
-        if (attrib->flags == VA_SURFACE_ATTRIB_NOT_SUPPORTED)
-            continue;
         *out_attrib++ = *attrib;
+        out_num_attribs++;
     }
 
+    *out_attribs_ptr = attribs;
+    *out_num_attribs_ptr = out_num_attribs;
+    attribs = NULL;
+
 end:
+    free(fourcc_set);
     free(attribs);
     free(image_formats);
     return va_status;
@@ -1121,12 +1472,14 @@ vaQuerySurfaceAttributes(
         return VA_STATUS_ERROR_INVALID_DISPLAY;
 
     VA_TRACE_V(dpy, QUERY_SURFACE_ATTR, TRACE_BEGIN, config);
+    VA_STATS_BEGIN(dpy);
     if (!ctx->vtable->vaQuerySurfaceAttributes)
-        vaStatus = va_impl_query_surface_attributes(ctx, config,
-                   attrib_list, num_attribs);
+        vaStatus = va_CapsQuerySurfaceAttributes(dpy, config,
+                   attrib_list, num_attribs, va_impl_query_surface_attributes);
     else
-        vaStatus = ctx->vtable->vaQuerySurfaceAttributes(ctx, config,
-                   attrib_list, num_attribs);
+        vaStatus = va_CapsQuerySurfaceAttributes(dpy, config,
+                   attrib_list, num_attribs, NULL);
+    VA_STATS_END(dpy, VA_STATS_QUERY_SURFACE_ATTRIBUTES, vaStatus);
 
     VA_TRACE_LOG(va_TraceQuerySurfaceAttributes, dpy, config, attrib_list, num_attribs);
     VA_TRACE_RET(dpy, vaStatus);
@@ -1156,6 +1509,7 @@ vaCreateSurfaces(
         return VA_STATUS_ERROR_INVALID_DISPLAY;
 
     VA_TRACE_VVVVA(dpy, CREATE_SURFACE, TRACE_BEGIN, width, height, format, num_attribs, attrib_list);
+    VA_STATS_BEGIN(dpy);
     if (ctx->vtable->vaCreateSurfaces2)
         vaStatus = ctx->vtable->vaCreateSurfaces2(ctx, format, width, height,
                    surfaces, num_surfaces,
@@ -1165,6 +1519,7 @@ vaCreateSurfaces(
     else
         vaStatus = ctx->vtable->vaCreateSurfaces(ctx, width, height, format,
                    num_surfaces, surfaces);
+    VA_STATS_END(dpy, VA_STATS_CREATE_SURFACES, vaStatus);
     VA_TRACE_LOG(va_TraceCreateSurfaces,
                  dpy, width, height, format, num_surfaces, surfaces,
                  attrib_list, num_attribs);
@@ -1191,7 +1546,9 @@ VAStatus vaDestroySurfaces(
     VA_TRACE_LOG(va_TraceDestroySurfaces,
                  dpy, surface_list, num_surfaces);
 
+    VA_STATS_BEGIN(dpy);
     vaStatus = ctx->vtable->vaDestroySurfaces(ctx, surface_list, num_surfaces);
+    VA_STATS_END(dpy, VA_STATS_DESTROY_SURFACES, vaStatus);
     VA_TRACE_RET(dpy, vaStatus);
     VA_TRACE_V(dpy, DESTROY_SURFACE, TRACE_END, vaStatus);
 
@@ -1216,8 +1573,10 @@ VAStatus vaCreateContext(
     ctx = CTX(dpy);
 
     VA_TRACE_VVVVVA(dpy, CREATE_CONTEXT, TRACE_BEGIN, config_id, picture_width, picture_height, flag, num_render_targets, render_targets);
+    VA_STATS_BEGIN(dpy);
     vaStatus = ctx->vtable->vaCreateContext(ctx, config_id, picture_width, picture_height,
                                             flag, render_targets, num_render_targets, context);
+    VA_STATS_END(dpy, VA_STATS_CREATE_CONTEXT, vaStatus);
 
     /* keep current encode/decode resoluton */
     VA_TRACE_ALL(va_TraceCreateContext, dpy, config_id, picture_width, picture_height, flag, render_targets, num_render_targets, context);
@@ -1238,8 +1597,12 @@ VAStatus vaDestroyContext(
     CHECK_DISPLAY(dpy);
     ctx = CTX(dpy);
 
+    va_PoolDestroyContext(dpy, context);
+
     VA_TRACE_V(dpy, DESTROY_CONTEXT, TRACE_BEGIN, context);
+    VA_STATS_BEGIN(dpy);
     vaStatus = ctx->vtable->vaDestroyContext(ctx, context);
+    VA_STATS_END(dpy, VA_STATS_DESTROY_CONTEXT, vaStatus);
 
     VA_TRACE_ALL(va_TraceDestroyContext, dpy, context);
     VA_TRACE_RET(dpy, vaStatus);
@@ -1355,9 +1718,11 @@ VAStatus vaCreateBuffer(
     ctx = CTX(dpy);
 
     VA_TRACE_VVVV(dpy, CREATE_BUFFER, TRACE_BEGIN, context, type, size, num_elements);
+    VA_STATS_BEGIN(dpy);
     vaStatus = ctx->vtable->vaCreateBuffer(ctx, context, type, size, num_elements, data, buf_id);
+    VA_STATS_END(dpy, VA_STATS_CREATE_BUFFER, vaStatus);
 
-    VA_TRACE_LOG(va_TraceCreateBuffer,
+    VA_TRACE_ALL(va_TraceCreateBuffer,
                  dpy, context, type, size, num_elements, data, buf_id);
 
     VA_TRACE_RET(dpy, vaStatus);
@@ -1384,9 +1749,11 @@ VAStatus vaCreateBuffer2(
     if (!ctx->vtable->vaCreateBuffer2)
         return VA_STATUS_ERROR_UNIMPLEMENTED;
 
+    VA_STATS_BEGIN(dpy);
     vaStatus = ctx->vtable->vaCreateBuffer2(ctx, context, type, width, height, unit_size, pitch, buf_id);
+    VA_STATS_END(dpy, VA_STATS_CREATE_BUFFER2, vaStatus);
 
-    VA_TRACE_LOG(va_TraceCreateBuffer,
+    VA_TRACE_ALL(va_TraceCreateBuffer,
                  dpy, context, type, *pitch, height, NULL, buf_id);
     VA_TRACE_RET(dpy, vaStatus);
 
@@ -1404,7 +1771,9 @@ VAStatus vaBufferSetNumElements(
     CHECK_DISPLAY(dpy);
     ctx = CTX(dpy);
 
+    VA_STATS_BEGIN(dpy);
     vaStatus = ctx->vtable->vaBufferSetNumElements(ctx, buf_id, num_elements);
+    VA_STATS_END(dpy, VA_STATS_BUFFER_SET_NUM_ELEMENTS, vaStatus);
     VA_TRACE_RET(dpy, vaStatus);
     return vaStatus;
 }
@@ -1422,11 +1791,13 @@ VAStatus vaMapBuffer(
     CHECK_DISPLAY(dpy);
     ctx = CTX(dpy);
 
+    VA_STATS_BEGIN(dpy);
     if (ctx->vtable->vaMapBuffer2) {
         va_status = ctx->vtable->vaMapBuffer2(ctx, buf_id, pbuf, VA_MAPBUFFER_FLAG_DEFAULT);
     } else if (ctx->vtable->vaMapBuffer) {
         va_status = ctx->vtable->vaMapBuffer(ctx, buf_id, pbuf);
     }
+    VA_STATS_END(dpy, VA_STATS_MAP_BUFFER, va_status);
 
     VA_TRACE_ALL(va_TraceMapBuffer, dpy, buf_id, pbuf, VA_MAPBUFFER_FLAG_DEFAULT);
     VA_TRACE_RET(dpy, va_status);
@@ -1447,11 +1818,13 @@ VAStatus vaMapBuffer2(
     CHECK_DISPLAY(dpy);
     ctx = CTX(dpy);
 
+    VA_STATS_BEGIN(dpy);
     if (ctx->vtable->vaMapBuffer2) {
         va_status = ctx->vtable->vaMapBuffer2(ctx, buf_id, pbuf, flags);
     } else if (ctx->vtable->vaMapBuffer) {
         va_status = ctx->vtable->vaMapBuffer(ctx, buf_id, pbuf);
     }
+    VA_STATS_END(dpy, VA_STATS_MAP_BUFFER2, va_status);
 
     VA_TRACE_ALL(va_TraceMapBuffer, dpy, buf_id, pbuf, flags);
     VA_TRACE_RET(dpy, va_status);
@@ -1469,7 +1842,9 @@ VAStatus vaUnmapBuffer(
     CHECK_DISPLAY(dpy);
     ctx = CTX(dpy);
 
+    VA_STATS_BEGIN(dpy);
     vaStatus = ctx->vtable->vaUnmapBuffer(ctx, buf_id);
+    VA_STATS_END(dpy, VA_STATS_UNMAP_BUFFER, vaStatus);
     VA_TRACE_RET(dpy, vaStatus);
     return vaStatus;
 }
@@ -1485,10 +1860,12 @@ VAStatus vaDestroyBuffer(
     ctx = CTX(dpy);
 
     VA_TRACE_V(dpy, DESTROY_BUFFER, TRACE_BEGIN, buffer_id);
-    VA_TRACE_LOG(va_TraceDestroyBuffer,
+    VA_TRACE_ALL(va_TraceDestroyBuffer,
                  dpy, buffer_id);
 
+    VA_STATS_BEGIN(dpy);
     vaStatus = ctx->vtable->vaDestroyBuffer(ctx, buffer_id);
+    VA_STATS_END(dpy, VA_STATS_DESTROY_BUFFER, vaStatus);
     VA_TRACE_RET(dpy, vaStatus);
     VA_TRACE_V(dpy, DESTROY_BUFFER, TRACE_END, vaStatus);
     return vaStatus;
@@ -1524,10 +1901,12 @@ vaAcquireBufferHandle(VADisplay dpy, VABufferID buf_id, VABufferInfo *buf_info)
     CHECK_DISPLAY(dpy);
     ctx = CTX(dpy);
 
+    VA_STATS_BEGIN(dpy);
     if (!ctx->vtable->vaAcquireBufferHandle)
         vaStatus = VA_STATUS_ERROR_UNIMPLEMENTED;
     else
         vaStatus = ctx->vtable->vaAcquireBufferHandle(ctx, buf_id, buf_info);
+    VA_STATS_END(dpy, VA_STATS_ACQUIRE_BUFFER_HANDLE, vaStatus);
     VA_TRACE_RET(dpy, vaStatus);
     return vaStatus;
 }
@@ -1542,10 +1921,12 @@ vaReleaseBufferHandle(VADisplay dpy, VABufferID buf_id)
     CHECK_DISPLAY(dpy);
     ctx = CTX(dpy);
 
+    VA_STATS_BEGIN(dpy);
     if (!ctx->vtable->vaReleaseBufferHandle)
         vaStatus = VA_STATUS_ERROR_UNIMPLEMENTED;
     else
         vaStatus = ctx->vtable->vaReleaseBufferHandle(ctx, buf_id);
+    VA_STATS_END(dpy, VA_STATS_RELEASE_BUFFER_HANDLE, vaStatus);
     VA_TRACE_RET(dpy, vaStatus);
     return vaStatus;
 }
@@ -1561,12 +1942,14 @@ vaExportSurfaceHandle(VADisplay dpy, VASurfaceID surface_id,
     CHECK_DISPLAY(dpy);
     ctx = CTX(dpy);
 
+    VA_STATS_BEGIN(dpy);
     if (!ctx->vtable->vaExportSurfaceHandle)
         vaStatus = VA_STATUS_ERROR_UNIMPLEMENTED;
     else
         vaStatus = ctx->vtable->vaExportSurfaceHandle(ctx, surface_id,
                    mem_type, flags,
                    descriptor);
+    VA_STATS_END(dpy, VA_STATS_EXPORT_SURFACE_HANDLE, vaStatus);
     VA_TRACE_LOG(va_TraceExportSurfaceHandle, dpy, surface_id, mem_type, flags, descriptor);
 
     VA_TRACE_RET(dpy, vaStatus);
@@ -1588,7 +1971,9 @@ VAStatus vaBeginPicture(
     VA_TRACE_VV(dpy, BEGIN_PICTURE, TRACE_BEGIN, context, render_target);
     VA_TRACE_ALL(va_TraceBeginPicture, dpy, context, render_target);
 
+    VA_STATS_BEGIN(dpy);
     va_status = ctx->vtable->vaBeginPicture(ctx, context, render_target);
+    VA_STATS_END(dpy, VA_STATS_BEGIN_PICTURE, va_status);
     VA_TRACE_RET(dpy, va_status);
     VA_TRACE_V(dpy, BEGIN_PICTURE, TRACE_END, va_status);
 
@@ -1612,7 +1997,9 @@ VAStatus vaRenderPicture(
     VA_TRACE_BUFFERS(dpy, context, num_buffers, buffers);
     VA_TRACE_LOG(va_TraceRenderPicture, dpy, context, buffers, num_buffers);
 
+    VA_STATS_BEGIN(dpy);
     vaStatus = ctx->vtable->vaRenderPicture(ctx, context, buffers, num_buffers);
+    VA_STATS_END(dpy, VA_STATS_RENDER_PICTURE, vaStatus);
     VA_TRACE_RET(dpy, vaStatus);
     VA_TRACE_V(dpy, RENDER_PICTURE, TRACE_END, vaStatus);
     return vaStatus;
@@ -1631,7 +2018,57 @@ VAStatus vaEndPicture(
 
     VA_TRACE_V(dpy, END_PICTURE, TRACE_BEGIN, context);
     VA_TRACE_ALL(va_TraceEndPicture, dpy, context, 0);
+    VA_STATS_BEGIN(dpy);
     va_status = ctx->vtable->vaEndPicture(ctx, context);
+    VA_STATS_END(dpy, VA_STATS_END_PICTURE, va_status);
+    VA_TRACE_RET(dpy, va_status);
+    /* dump surface content */
+    VA_TRACE_ALL(va_TraceEndPictureExt, dpy, context, 1);
+    VA_TRACE_V(dpy, END_PICTURE, TRACE_END, va_status);
+
+    return va_status;
+}
+
+VAStatus vaSubmitPicture(
+    VADisplay dpy,
+    VAContextID context,
+    VASurfaceID render_target,
+    VABufferID *buffers,
+    int num_buffers
+)
+{
+    VADriverContextP ctx;
+    VAStatus va_status = VA_STATUS_SUCCESS, end_status;
+
+    CHECK_DISPLAY(dpy);
+    ctx = CTX(dpy);
+
+    /* emit the events of the three calls so existing trace tools keep working,
+     * the status of the whole submission goes with the END_PICTURE end event */
+    VA_TRACE_VV(dpy, BEGIN_PICTURE, TRACE_BEGIN, context, render_target);
+    VA_TRACE_ALL(va_TraceBeginPicture, dpy, context, render_target);
+    VA_TRACE_V(dpy, BEGIN_PICTURE, TRACE_END, va_status);
+    VA_TRACE_VVA(dpy, RENDER_PICTURE, TRACE_BEGIN, context, num_buffers, buffers);
+    VA_TRACE_BUFFERS(dpy, context, num_buffers, buffers);
+    VA_TRACE_LOG(va_TraceRenderPicture, dpy, context, buffers, num_buffers);
+    VA_TRACE_V(dpy, RENDER_PICTURE, TRACE_END, va_status);
+    VA_TRACE_V(dpy, END_PICTURE, TRACE_BEGIN, context);
+    VA_TRACE_ALL(va_TraceEndPicture, dpy, context, 0);
+
+    VA_STATS_BEGIN(dpy);
+    if (ctx->vtable->vaSubmitPicture) {
+        va_status = ctx->vtable->vaSubmitPicture(ctx, context, render_target,
+                    buffers, num_buffers);
+    } else {
+        va_status = ctx->vtable->vaBeginPicture(ctx, context, render_target);
+        if (va_status == VA_STATUS_SUCCESS) {
+            va_status = ctx->vtable->vaRenderPicture(ctx, context, buffers, num_buffers);
+            end_status = ctx->vtable->vaEndPicture(ctx, context);
+            if (va_status == VA_STATUS_SUCCESS)
+                va_status = end_status;
+        }
+    }
+    VA_STATS_END(dpy, VA_STATS_SUBMIT_PICTURE, va_status);
     VA_TRACE_RET(dpy, va_status);
     /* dump surface content */
     VA_TRACE_ALL(va_TraceEndPictureExt, dpy, context, 1);
@@ -1652,7 +2089,9 @@ VAStatus vaSyncSurface(
     ctx = CTX(dpy);
 
     VA_TRACE_V(dpy, SYNC_SURFACE, TRACE_BEGIN, render_target);
+    VA_STATS_BEGIN(dpy);
     va_status = ctx->vtable->vaSyncSurface(ctx, render_target);
+    VA_STATS_END(dpy, VA_STATS_SYNC_SURFACE, va_status);
     VA_TRACE_LOG(va_TraceSyncSurface, dpy, render_target);
     VA_TRACE_RET(dpy, va_status);
     VA_TRACE_V(dpy, SYNC_SURFACE, TRACE_END, va_status);
@@ -1673,10 +2112,12 @@ VAStatus vaSyncSurface2(
     ctx = CTX(dpy);
 
     VA_TRACE_VV(dpy, SYNC_SURFACE2, TRACE_BEGIN, surface, timeout_ns);
+    VA_STATS_BEGIN(dpy);
     if (ctx->vtable->vaSyncSurface2)
         va_status = ctx->vtable->vaSyncSurface2(ctx, surface, timeout_ns);
     else
         va_status = VA_STATUS_ERROR_UNIMPLEMENTED;
+    VA_STATS_END(dpy, VA_STATS_SYNC_SURFACE2, va_status);
     VA_TRACE_LOG(va_TraceSyncSurface2, dpy, surface, timeout_ns);
     VA_TRACE_RET(dpy, va_status);
     VA_TRACE_V(dpy, SYNC_SURFACE2, TRACE_END, va_status);
@@ -1695,7 +2136,9 @@ VAStatus vaQuerySurfaceStatus(
     CHECK_DISPLAY(dpy);
     ctx = CTX(dpy);
 
+    VA_STATS_BEGIN(dpy);
     va_status = ctx->vtable->vaQuerySurfaceStatus(ctx, render_target, status);
+    VA_STATS_END(dpy, VA_STATS_QUERY_SURFACE_STATUS, va_status);
 
     VA_TRACE_LOG(va_TraceQuerySurfaceStatus, dpy, render_target, status);
     VA_TRACE_RET(dpy, va_status);
@@ -1737,10 +2180,62 @@ VAStatus vaSyncBuffer(
 
     VA_TRACE_LOG(va_TraceSyncBuffer, dpy, buf_id, timeout_ns);
 
+    VA_STATS_BEGIN(dpy);
     if (ctx->vtable->vaSyncBuffer)
         va_status = ctx->vtable->vaSyncBuffer(ctx, buf_id, timeout_ns);
     else
         va_status = VA_STATUS_ERROR_UNIMPLEMENTED;
+    VA_STATS_END(dpy, VA_STATS_SYNC_BUFFER, va_status);
+    VA_TRACE_RET(dpy, va_status);
+
+    return va_status;
+}
+
+VAStatus vaGetSurfaceSyncFd(
+    VADisplay dpy,
+    VASurfaceID surface,
+    int *fd
+)
+{
+    VAStatus va_status;
+    VADriverContextP ctx;
+
+    CHECK_DISPLAY(dpy);
+    ctx = CTX(dpy);
+
+    if (!fd)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    if (ctx->vtable->vaGetSurfaceSyncFd)
+        va_status = ctx->vtable->vaGetSurfaceSyncFd(ctx, surface, fd);
+    else
+        va_status = va_SyncGetFd(dpy, VA_SYNC_SURFACE, surface, fd);
+    VA_TRACE_RET(dpy, va_status);
+
+    return va_status;
+}
+
+VAStatus vaGetBufferSyncFd(
+    VADisplay dpy,
+    VABufferID buf_id,
+    int *fd
+)
+{
+    VAStatus va_status;
+    VADriverContextP ctx;
+
+    CHECK_DISPLAY(dpy);
+    ctx = CTX(dpy);
+
+    if (!fd)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    if (ctx->vtable->vaGetBufferSyncFd)
+        va_status = ctx->vtable->vaGetBufferSyncFd(ctx, buf_id, fd);
+    else if (ctx->vtable->vaSyncBuffer)
+        va_status = va_SyncGetFd(dpy, VA_SYNC_BUFFER, buf_id, fd);
+    else
+        va_status = VA_STATUS_ERROR_UNIMPLEMENTED;
     VA_TRACE_RET(dpy, va_status);
 
     return va_status;
@@ -1791,7 +2286,9 @@ VAStatus vaCreateImage(
     CHECK_DISPLAY(dpy);
     ctx = CTX(dpy);
 
+    VA_STATS_BEGIN(dpy);
     va_status = ctx->vtable->vaCreateImage(ctx, format, width, height, image);
+    VA_STATS_END(dpy, VA_STATS_CREATE_IMAGE, va_status);
     VA_TRACE_RET(dpy, va_status);
     return va_status;
 }
@@ -1809,7 +2306,9 @@ VAStatus vaDestroyImage(
     CHECK_DISPLAY(dpy);
     ctx = CTX(dpy);
 
+    VA_STATS_BEGIN(dpy);
     va_status = ctx->vtable->vaDestroyImage(ctx, image);
+    VA_STATS_END(dpy, VA_STATS_DESTROY_IMAGE, va_status);
     VA_TRACE_RET(dpy, va_status);
     return va_status;
 }
@@ -1849,7 +2348,9 @@ VAStatus vaGetImage(
     CHECK_DISPLAY(dpy);
     ctx = CTX(dpy);
 
+    VA_STATS_BEGIN(dpy);
     va_status = ctx->vtable->vaGetImage(ctx, surface, x, y, width, height, image);
+    VA_STATS_END(dpy, VA_STATS_GET_IMAGE, va_status);
     VA_TRACE_RET(dpy, va_status);
     return va_status;
 }
@@ -1877,7 +2378,9 @@ VAStatus vaPutImage(
     CHECK_DISPLAY(dpy);
     ctx = CTX(dpy);
 
+    VA_STATS_BEGIN(dpy);
     va_status = ctx->vtable->vaPutImage(ctx, surface, image, src_x, src_y, src_width, src_height, dest_x, dest_y, dest_width, dest_height);
+    VA_STATS_END(dpy, VA_STATS_PUT_IMAGE, va_status);
     VA_TRACE_RET(dpy, va_status);
     return va_status;
 }
@@ -1924,7 +2427,9 @@ VAStatus vaDeriveImage(
     CHECK_DISPLAY(dpy);
     ctx = CTX(dpy);
 
+    VA_STATS_BEGIN(dpy);
     va_status = ctx->vtable->vaDeriveImage(ctx, surface, image);
+    VA_STATS_END(dpy, VA_STATS_DERIVE_IMAGE, va_status);
     VA_TRACE_LOG(va_TraceDeriveImage, dpy, surface, image);
     VA_TRACE_RET(dpy, va_status);
     return va_status;
@@ -2324,13 +2829,27 @@ vaCopy(
     CHECK_DISPLAY(dpy);
     ctx = CTX(dpy);
 
+    VA_STATS_BEGIN(dpy);
     if (ctx->vtable->vaCopy  == NULL)
         va_status = VA_STATUS_ERROR_UNIMPLEMENTED;
     else
         va_status = ctx->vtable->vaCopy(ctx, dst, src, option);
+    VA_STATS_END(dpy, VA_STATS_COPY, va_status);
     return va_status;
 }
 
+VAStatus
+vaGetCallStatistics(
+    VADisplay dpy,
+    VACallStatistics *stats_list,   /* out */
+    unsigned int *num_stats         /* in/out */
+)
+{
+    CHECK_DISPLAY(dpy);
+
+    return va_StatsGet(dpy, stats_list, num_stats);
+}
+
 /* Protected content */
 #define VA_PROT_INIT_CONTEXT(ctx, dpy) do {              \
         CHECK_DISPLAY(dpy);                             \
@@ -1917,6 +1917,75 @@ VAStatus vaDestroySurfaces(
     int num_surfaces
 );
 
+/** \brief Surface pool ID, see vaCreateSurfacePool() */
+typedef VAGenericID VASurfacePoolID;
+
+/**
+ * \brief Creates a pool of recycled surfaces.
+ *
+ * Surfaces acquired with vaAcquirePooledSurfaces() go back into the pool
+ * with vaReleasePooledSurfaces() instead of being destroyed, and are
+ * handed out again to later requests with the same format, size and
+ * surface attributes. Resolution switches back and forth then reuse the
+ * earlier surface sets instead of reallocating them.
+ *
+ * Idle surfaces are evicted least recently released first once their
+ * estimated memory exceeds \c max_idle_bytes. Surfaces created with a
+ * pointer attribute, e.g. an external buffer descriptor, are never kept.
+ *
+ * The pool owns all the surfaces it created: they are destroyed with the
+ * pool, at the latest in vaTerminate().
+ *
+ * @param[in] dpy               the VA display
+ * @param[in] max_idle_bytes    memory cap for idle surfaces, 0 for none
+ * @param[out] pool             the created pool
+ */
+VAStatus vaCreateSurfacePool(
+    VADisplay dpy,
+    uint64_t max_idle_bytes,
+    VASurfacePoolID *pool
+);
+
+/**
+ * \brief Destroys a surface pool and all the surfaces it created.
+ */
+VAStatus vaDestroySurfacePool(
+    VADisplay dpy,
+    VASurfacePoolID pool
+);
+
+/**
+ * \brief Gets surfaces from a pool.
+ *
+ * Takes the same arguments as vaCreateSurfaces(). Idle surfaces matching
+ * the request are reused, the missing ones are created. The content of
+ * reused surfaces is undefined.
+ */
+VAStatus vaAcquirePooledSurfaces(
+    VADisplay dpy,
+    VASurfacePoolID pool,
+    unsigned int format,
+    unsigned int width,
+    unsigned int height,
+    VASurfaceID *surfaces,
+    unsigned int num_surfaces,
+    VASurfaceAttrib *attrib_list,
+    unsigned int num_attribs
+);
+
+/**
+ * \brief Gives surfaces back to their pool.
+ *
+ * The surfaces must not be render targets of a live context any more nor
+ * have pending operations.
+ */
+VAStatus vaReleasePooledSurfaces(
+    VADisplay dpy,
+    VASurfacePoolID pool,
+    VASurfaceID *surfaces,
+    unsigned int num_surfaces
+);
+
 #define VA_PROGRESSIVE 0x1
 /**
  * vaCreateContext - Create a context
@@ -4025,6 +4094,83 @@ VAStatus vaDestroyBuffer(
     VABufferID buffer_id
 );
 
+/** \brief Buffer pool ID, see vaCreateBufferPool() */
+typedef VAGenericID VABufferPoolID;
+
+/**
+ * \brief Creates a pool of recycled buffers for a context.
+ *
+ * Buffers acquired from the pool with vaAcquirePooledBuffer() go back
+ * into it with vaReleasePooledBuffer() instead of being destroyed, and
+ * are handed out again to later requests of the same buffer type and
+ * size class. This saves a vaCreateBuffer()/vaDestroyBuffer() pair per
+ * buffer and frame.
+ *
+ * Single element slice data, bit plane, packed header data and protected
+ * slice data buffers are created with their size rounded up to a power of
+ * two so that payloads of varying size share buffers, their consumers take
+ * the amount of valid data from other parameters. All other buffers, e.g.
+ * parameter buffers, and buffers of several elements must match the size
+ * and element count exactly.
+ *
+ * The pool owns all the buffers it created: they are destroyed with the
+ * pool, at the latest when the context is destroyed.
+ *
+ * @param[in] dpy           the VA display
+ * @param[in] context       the context the buffers are created for
+ * @param[in] max_buffers   the maximum number of idle buffers kept,
+ *                          0 selects a default
+ * @param[out] pool         the created pool
+ */
+VAStatus vaCreateBufferPool(
+    VADisplay dpy,
+    VAContextID context,
+    unsigned int max_buffers,
+    VABufferPoolID *pool
+);
+
+/**
+ * \brief Destroys a buffer pool and all the buffers it created.
+ */
+VAStatus vaDestroyBufferPool(
+    VADisplay dpy,
+    VABufferPoolID pool
+);
+
+/**
+ * \brief Gets a buffer from a pool.
+ *
+ * Takes the same arguments as vaCreateBuffer(). An idle buffer of the same
+ * type and size, or size class for payload buffers, is reused when available, otherwise a new one is
+ * created. If "data" is not NULL, size * num_elements bytes are copied
+ * into the buffer. The buffer must be given back with
+ * vaReleasePooledBuffer(), not destroyed.
+ */
+VAStatus vaAcquirePooledBuffer(
+    VADisplay dpy,
+    VABufferPoolID pool,
+    VABufferType type,
+    unsigned int size,
+    unsigned int num_elements,
+    void *data,
+    VABufferID *buf_id
+);
+
+/**
+ * \brief Gives a buffer back to its pool.
+ *
+ * Unlike a destroyed buffer, a released buffer is written again by the
+ * next vaAcquirePooledBuffer(), so release it only once the pictures it
+ * was rendered with have completed, e.g. after vaSyncSurface() on their
+ * render targets. When the pool already holds max_buffers idle buffers,
+ * the buffer is destroyed.
+ */
+VAStatus vaReleasePooledBuffer(
+    VADisplay dpy,
+    VABufferPoolID pool,
+    VABufferID buf_id
+);
+
 /** \brief VA buffer information */
 typedef struct {
     /** \brief Buffer handle */
@@ -4236,6 +4382,29 @@ VAStatus vaEndPicture(
     VAContextID context
 );
 
+/**
+ * \brief Submits a complete picture in one call.
+ *
+ * Equivalent to vaBeginPicture() on \c render_target, vaRenderPicture()
+ * with \c buffers and vaEndPicture(), but crosses into the driver once
+ * when the driver supports it. Otherwise libva issues the three calls
+ * itself. If rendering fails the picture is still ended so the context
+ * can take the next one, and the rendering error is returned.
+ *
+ * @param[in] dpy           the VA display
+ * @param[in] context       the context to submit the picture to
+ * @param[in] render_target the surface to decode, encode or process into
+ * @param[in] buffers       the buffers to render
+ * @param[in] num_buffers   the number of buffers
+ */
+VAStatus vaSubmitPicture(
+    VADisplay dpy,
+    VAContextID context,
+    VASurfaceID render_target,
+    VABufferID *buffers,
+    int num_buffers
+);
+
 /**
  * Make the end of rendering for a pictures in contexts passed with submission.
  * The server should start processing all pending operations for contexts.
@@ -4392,6 +4561,53 @@ VAStatus vaSyncBuffer(
     uint64_t timeout_ns
 );
 
+/**
+ * \brief Returns a file descriptor signalled when a surface is ready.
+ *
+ * The returned descriptor becomes readable once all the operations
+ * pending on the surface at the time of the call have completed, or
+ * failed. It can be watched with poll(), select() or epoll instead of
+ * blocking a thread in vaSyncSurface(). The outcome is then read with
+ * vaSyncSurface2() and a zero timeout or vaQuerySurfaceStatus().
+ *
+ * The descriptor is a sync_file or an eventfd, its content should not be
+ * read. The caller owns it and must close() it. Drivers without native
+ * support are served by a libva thread, which polls the pending surfaces
+ * in turn with bounded waits, so one slow surface doesn't delay the
+ * others.
+ *
+ * Possible errors:
+ * - \ref VA_STATUS_ERROR_UNIMPLEMENTED: not supported on this platform
+ * - \ref VA_STATUS_ERROR_INVALID_DISPLAY: an invalid display was supplied
+ * - \ref VA_STATUS_ERROR_INVALID_SURFACE: an invalid surface was supplied
+ *
+ * @param[in] dpy         the VA display
+ * @param[in] surface     the surface to wait for
+ * @param[out] fd         the file descriptor
+ */
+VAStatus vaGetSurfaceSyncFd(
+    VADisplay dpy,
+    VASurfaceID surface,
+    int *fd
+);
+
+/**
+ * \brief Returns a file descriptor signalled when a buffer is ready.
+ *
+ * Same as vaGetSurfaceSyncFd() for the operations pending on a buffer,
+ * e.g. the encoding into a coded buffer. The outcome is then read with
+ * vaSyncBuffer() and a zero timeout.
+ *
+ * @param[in] dpy         the VA display
+ * @param[in] buf_id      the buffer to wait for
+ * @param[out] fd         the file descriptor
+ */
+VAStatus vaGetBufferSyncFd(
+    VADisplay dpy,
+    VABufferID buf_id,
+    int *fd
+);
+
 /**
  * Notes about synchronization interfaces:
  * vaSyncSurface:
@@ -5422,6 +5638,57 @@ typedef union _VACopyOption {
  */
 VAStatus vaCopy(VADisplay dpy, VACopyObject * dst, VACopyObject * src, VACopyOption option);
 
+/** \brief Latency statistics of one VA entry point.
+ *
+ * Latencies are measured in the dispatch layer around the driver call,
+ * so they do not include the cost of LIBVA_TRACE.
+ */
+typedef struct _VACallStatistics {
+    /** \brief Name of the entry point, e.g. "vaEndPicture". */
+    const char *name;
+    /** \brief Number of calls. */
+    uint64_t    count;
+    /** \brief Number of calls that did not return VA_STATUS_SUCCESS. */
+    uint64_t    errors;
+    /** \brief Sum of the latencies of all calls, in nanoseconds. */
+    uint64_t    total_ns;
+    /** \brief Shortest call, in nanoseconds. */
+    uint64_t    min_ns;
+    /** \brief Longest call, in nanoseconds. */
+    uint64_t    max_ns;
+    /** \brief Median latency, in nanoseconds (within 25% accuracy). */
+    uint64_t    p50_ns;
+    /** \brief 90th percentile latency, in nanoseconds (within 25% accuracy). */
+    uint64_t    p90_ns;
+    /** \brief 99th percentile latency, in nanoseconds (within 25% accuracy). */
+    uint64_t    p99_ns;
+
+    uint32_t    va_reserved[VA_PADDING_MEDIUM];
+} VACallStatistics;
+
+/** \brief Queries the per entry point latency statistics of a display.
+ *
+ * Statistics are only collected when LIBVA_CALL_STATS=1 is set in the
+ * environment or in libva.conf before vaInitialize() is called. They
+ * cover every call made on \c dpy since vaInitialize(), from all threads.
+ *
+ * If \c stats_list is NULL, \c num_stats returns the number of entry
+ * points that are measured. Otherwise \c num_stats is the number of
+ * elements in \c stats_list on input, and the number of elements filled
+ * in on output.
+ *
+ * @param[in] dpy               the VA display
+ * @param[out] stats_list       array of statistics, or NULL
+ * @param[in,out] num_stats     number of elements of \c stats_list
+ * @return VA_STATUS_SUCCESS if successful,
+ *         VA_STATUS_ERROR_UNIMPLEMENTED if statistics are not enabled
+ */
+VAStatus vaGetCallStatistics(
+    VADisplay dpy,
+    VACallStatistics *stats_list,   /* out */
+    unsigned int *num_stats         /* in/out */
+);
+
 #include <va/va_dec_hevc.h>
 #include <va/va_dec_jpeg.h>
 #include <va/va_dec_vp8.h>
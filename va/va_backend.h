@@ -511,8 +511,46 @@ struct VADriverVTable {
         void **pbuf,                        /* out */
         uint32_t flags                      /* in */
     );
+
+    /**
+     * \brief Begin, render and end a picture in one call.
+     *
+     * Optional, libva falls back to vaBeginPicture, vaRenderPicture and
+     * vaEndPicture when this is NULL. The driver must leave the context
+     * ready for the next picture whatever the outcome.
+     */
+    VAStatus(*vaSubmitPicture)(
+        VADriverContextP ctx,
+        VAContextID context,                /* in */
+        VASurfaceID render_target,          /* in */
+        VABufferID *buffers,                /* in */
+        int num_buffers                     /* in */
+    );
+
+    /**
+     * \brief Get a file descriptor signalled on surface completion.
+     *
+     * Optional, the returned sync_file or eventfd is owned by the caller.
+     * libva waits in a thread of its own when this is NULL.
+     */
+    VAStatus(*vaGetSurfaceSyncFd)(
+        VADriverContextP ctx,
+        VASurfaceID surface,                /* in */
+        int *fd                             /* out */
+    );
+
+    /**
+     * \brief Get a file descriptor signalled on buffer completion.
+     *
+     * Optional, see vaGetSurfaceSyncFd.
+     */
+    VAStatus(*vaGetBufferSyncFd)(
+        VADriverContextP ctx,
+        VABufferID buf_id,                  /* in */
+        int *fd                             /* out */
+    );
     /** \brief Reserved bytes for future use, must be zero */
-    unsigned long reserved[53];
+    unsigned long reserved[50];
 
 };
 
@@ -722,8 +760,13 @@ struct VADisplayContext {
         unsigned *num_drivers
     );
 
+    void *vastats; /* opaque for VA call statistics */
+    void *vacaps; /* opaque for the capability query cache */
+    void *vapool; /* opaque for buffer pools */
+    void *vasync; /* opaque for the sync fd fallback */
+
     /** \brief Reserved bytes for future use, must be zero */
-    unsigned long reserved[29];
+    unsigned long reserved[25];
 };
 
 typedef VAStatus(*VADriverInit)(
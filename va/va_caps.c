@@ -0,0 +1,473 @@
+/*
+ * Copyright (c) 2025 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#define _GNU_SOURCE 1
+#include "sysdeps.h"
+#include "va.h"
+#include "va_backend.h"
+#include "va_internal.h"
+#include "va_caps.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+#include "compat_win32.h"
+#else
+#include <pthread.h>
+#endif
+
+/*
+ * Capability queries answered by a loaded driver never change, yet
+ * frameworks repeat them many times while negotiating a pipeline. The
+ * answers of vaQueryConfigProfiles, vaQueryConfigEntrypoints,
+ * vaGetConfigAttributes and vaQuerySurfaceAttributes are kept per display
+ * and dropped in vaTerminate. Surface attributes depend on a config ID,
+ * which the driver may hand out again, so they are also dropped when the
+ * config is destroyed.
+ *
+ * Only successful answers are stored, with the exception of
+ * VA_STATUS_ERROR_UNSUPPORTED_PROFILE from vaQueryConfigEntrypoints which
+ * is what probing every known profile mostly returns.
+ */
+
+#define VA_CAPS_HASH_SIZE 64
+
+struct va_caps_entrypoints {
+    struct va_caps_entrypoints *next;
+    VAProfile profile;
+    VAStatus status;
+    int num_entrypoints;
+    VAEntrypoint *entrypoints;
+};
+
+struct va_caps_attrib {
+    struct va_caps_attrib *next;
+    VAProfile profile;
+    VAEntrypoint entrypoint;
+    VAConfigAttribType type;
+    uint32_t value;
+};
+
+struct va_caps_surface_attribs {
+    struct va_caps_surface_attribs *next;
+    VAConfigID config;
+    unsigned int num_attribs;
+    VASurfaceAttrib *attribs;
+};
+
+struct va_caps {
+    pthread_mutex_t lock;
+    /* -1 until the driver was asked */
+    int num_profiles;
+    VAProfile *profiles;
+    struct va_caps_entrypoints *entrypoints;
+    struct va_caps_attrib *attribs[VA_CAPS_HASH_SIZE];
+    struct va_caps_surface_attribs *surface_attribs[VA_CAPS_HASH_SIZE];
+};
+
+#define DPY2CAPS(dpy) ((struct va_caps *)((VADisplayContextP)(dpy))->vacaps)
+#define CAPS_CTX(dpy) (((VADisplayContextP)(dpy))->pDriverContext)
+
+static unsigned int va_caps_hash_attrib(
+    VAProfile profile,
+    VAEntrypoint entrypoint,
+    VAConfigAttribType type
+)
+{
+    uint32_t h = 2166136261u;
+
+    h = (h ^ (uint32_t)profile) * 16777619u;
+    h = (h ^ (uint32_t)entrypoint) * 16777619u;
+    h = (h ^ (uint32_t)type) * 16777619u;
+    return h % VA_CAPS_HASH_SIZE;
+}
+
+static struct va_caps_attrib *va_caps_find_attrib(
+    struct va_caps *caps,
+    VAProfile profile,
+    VAEntrypoint entrypoint,
+    VAConfigAttribType type
+)
+{
+    struct va_caps_attrib *attrib;
+
+    attrib = caps->attribs[va_caps_hash_attrib(profile, entrypoint, type)];
+    for (; attrib; attrib = attrib->next) {
+        if (attrib->profile == profile &&
+            attrib->entrypoint == entrypoint &&
+            attrib->type == type)
+            return attrib;
+    }
+    return NULL;
+}
+
+void va_CapsInit(VADisplay dpy)
+{
+    VADisplayContextP pDisplayContext = (VADisplayContextP)dpy;
+    struct va_caps *caps;
+
+    if (pDisplayContext->vacaps)
+        va_CapsEnd(dpy);
+
+    caps = calloc(1, sizeof(*caps));
+    if (!caps)
+        return;
+
+    pthread_mutex_init(&caps->lock, NULL);
+    caps->num_profiles = -1;
+    pDisplayContext->vacaps = caps;
+}
+
+void va_CapsEnd(VADisplay dpy)
+{
+    VADisplayContextP pDisplayContext = (VADisplayContextP)dpy;
+    struct va_caps *caps = DPY2CAPS(dpy);
+    int i;
+
+    if (!caps)
+        return;
+
+    while (caps->entrypoints) {
+        struct va_caps_entrypoints *next = caps->entrypoints->next;
+        free(caps->entrypoints->entrypoints);
+        free(caps->entrypoints);
+        caps->entrypoints = next;
+    }
+
+    for (i = 0; i < VA_CAPS_HASH_SIZE; i++) {
+        while (caps->attribs[i]) {
+            struct va_caps_attrib *next = caps->attribs[i]->next;
+            free(caps->attribs[i]);
+            caps->attribs[i] = next;
+        }
+        while (caps->surface_attribs[i]) {
+            struct va_caps_surface_attribs *next = caps->surface_attribs[i]->next;
+            free(caps->surface_attribs[i]->attribs);
+            free(caps->surface_attribs[i]);
+            caps->surface_attribs[i] = next;
+        }
+    }
+
+    free(caps->profiles);
+    pthread_mutex_destroy(&caps->lock);
+    free(caps);
+    pDisplayContext->vacaps = NULL;
+}
+
+VAStatus va_CapsQueryConfigProfiles(
+    VADisplay dpy,
+    VAProfile *profile_list,
+    int *num_profiles
+)
+{
+    VADriverContextP ctx = CAPS_CTX(dpy);
+    struct va_caps *caps = DPY2CAPS(dpy);
+    VAStatus vaStatus = VA_STATUS_SUCCESS;
+
+    if (!caps || !profile_list || !num_profiles)
+        return ctx->vtable->vaQueryConfigProfiles(ctx, profile_list, num_profiles);
+
+    pthread_mutex_lock(&caps->lock);
+    if (caps->num_profiles < 0) {
+        VAProfile *profiles = calloc(ctx->max_profiles, sizeof(*profiles));
+        int num = 0;
+
+        if (!profiles) {
+            vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
+            goto unlock;
+        }
+        vaStatus = ctx->vtable->vaQueryConfigProfiles(ctx, profiles, &num);
+        if (vaStatus != VA_STATUS_SUCCESS || num < 0 || num > ctx->max_profiles) {
+            free(profiles);
+            if (vaStatus == VA_STATUS_SUCCESS)
+                vaStatus = VA_STATUS_ERROR_OPERATION_FAILED;
+            goto unlock;
+        }
+        caps->profiles = profiles;
+        caps->num_profiles = num;
+    }
+
+    memcpy(profile_list, caps->profiles, caps->num_profiles * sizeof(*profile_list));
+    *num_profiles = caps->num_profiles;
+
+unlock:
+    pthread_mutex_unlock(&caps->lock);
+    return vaStatus;
+}
+
+VAStatus va_CapsQueryConfigEntrypoints(
+    VADisplay dpy,
+    VAProfile profile,
+    VAEntrypoint *entrypoint_list,
+    int *num_entrypoints
+)
+{
+    VADriverContextP ctx = CAPS_CTX(dpy);
+    struct va_caps *caps = DPY2CAPS(dpy);
+    struct va_caps_entrypoints *entry;
+    VAStatus vaStatus;
+
+    if (!caps || !entrypoint_list || !num_entrypoints)
+        return ctx->vtable->vaQueryConfigEntrypoints(ctx, profile, entrypoint_list, num_entrypoints);
+
+    pthread_mutex_lock(&caps->lock);
+    for (entry = caps->entrypoints; entry; entry = entry->next) {
+        if (entry->profile == profile)
+            break;
+    }
+
+    if (!entry) {
+        VAEntrypoint *entrypoints = calloc(ctx->max_entrypoints, sizeof(*entrypoints));
+        int num = 0;
+
+        entry = calloc(1, sizeof(*entry));
+        if (!entry || !entrypoints) {
+            free(entry);
+            free(entrypoints);
+            pthread_mutex_unlock(&caps->lock);
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        }
+
+        vaStatus = ctx->vtable->vaQueryConfigEntrypoints(ctx, profile, entrypoints, &num);
+        if (vaStatus == VA_STATUS_SUCCESS && (num < 0 || num > ctx->max_entrypoints))
+            vaStatus = VA_STATUS_ERROR_OPERATION_FAILED;
+        if (vaStatus != VA_STATUS_SUCCESS &&
+            vaStatus != VA_STATUS_ERROR_UNSUPPORTED_PROFILE) {
+            free(entry);
+            free(entrypoints);
+            pthread_mutex_unlock(&caps->lock);
+            return vaStatus;
+        }
+
+        entry->profile = profile;
+        entry->status = vaStatus;
+        entry->num_entrypoints = vaStatus == VA_STATUS_SUCCESS ? num : 0;
+        entry->entrypoints = entrypoints;
+        entry->next = caps->entrypoints;
+        caps->entrypoints = entry;
+    }
+
+    vaStatus = entry->status;
+    if (vaStatus == VA_STATUS_SUCCESS) {
+        memcpy(entrypoint_list, entry->entrypoints,
+               entry->num_entrypoints * sizeof(*entrypoint_list));
+        *num_entrypoints = entry->num_entrypoints;
+    }
+    pthread_mutex_unlock(&caps->lock);
+    return vaStatus;
+}
+
+VAStatus va_CapsGetConfigAttributes(
+    VADisplay dpy,
+    VAProfile profile,
+    VAEntrypoint entrypoint,
+    VAConfigAttrib *attrib_list,
+    int num_attribs
+)
+{
+    VADriverContextP ctx = CAPS_CTX(dpy);
+    struct va_caps *caps = DPY2CAPS(dpy);
+    struct va_caps_attrib *attrib;
+    VAStatus vaStatus;
+    int i;
+
+    /* an empty list still has the driver validate profile and entrypoint */
+    if (!caps || !attrib_list || num_attribs <= 0)
+        return ctx->vtable->vaGetConfigAttributes(ctx, profile, entrypoint, attrib_list, num_attribs);
+
+    pthread_mutex_lock(&caps->lock);
+    for (i = 0; i < num_attribs; i++) {
+        if (!va_caps_find_attrib(caps, profile, entrypoint, attrib_list[i].type))
+            break;
+    }
+
+    if (i == num_attribs) {
+        for (i = 0; i < num_attribs; i++) {
+            attrib = va_caps_find_attrib(caps, profile, entrypoint, attrib_list[i].type);
+            attrib_list[i].value = attrib->value;
+        }
+        pthread_mutex_unlock(&caps->lock);
+        return VA_STATUS_SUCCESS;
+    }
+
+    vaStatus = ctx->vtable->vaGetConfigAttributes(ctx, profile, entrypoint, attrib_list, num_attribs);
+    if (vaStatus == VA_STATUS_SUCCESS) {
+        for (i = 0; i < num_attribs; i++) {
+            VAConfigAttribType type = attrib_list[i].type;
+
+            attrib = va_caps_find_attrib(caps, profile, entrypoint, type);
+            if (!attrib) {
+                unsigned int h = va_caps_hash_attrib(profile, entrypoint, type);
+
+                attrib = calloc(1, sizeof(*attrib));
+                if (!attrib)
+                    break;
+                attrib->profile = profile;
+                attrib->entrypoint = entrypoint;
+                attrib->type = type;
+                attrib->next = caps->attribs[h];
+                caps->attribs[h] = attrib;
+            }
+            attrib->value = attrib_list[i].value;
+        }
+    }
+    pthread_mutex_unlock(&caps->lock);
+    return vaStatus;
+}
+
+/* default fill callback: the driver's own vaQuerySurfaceAttributes */
+static VAStatus va_caps_query_driver_surface_attributes(
+    VADriverContextP ctx,
+    VAConfigID config,
+    VASurfaceAttrib **attribs_ptr,
+    unsigned int *num_attribs_ptr
+)
+{
+    VASurfaceAttrib *attribs = NULL;
+    unsigned int num = 0;
+    VAStatus vaStatus;
+
+    /* ask for the count first, as documented for vaQuerySurfaceAttributes */
+    vaStatus = ctx->vtable->vaQuerySurfaceAttributes(ctx, config, NULL, &num);
+    if (vaStatus != VA_STATUS_SUCCESS)
+        return vaStatus;
+
+    if (num > 0) {
+        attribs = calloc(num, sizeof(*attribs));
+        if (!attribs)
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        vaStatus = ctx->vtable->vaQuerySurfaceAttributes(ctx, config, attribs, &num);
+        if (vaStatus != VA_STATUS_SUCCESS) {
+            free(attribs);
+            return vaStatus;
+        }
+    }
+
+    *attribs_ptr = attribs;
+    *num_attribs_ptr = num;
+    return VA_STATUS_SUCCESS;
+}
+
+static VAStatus va_caps_copy_surface_attributes(
+    const VASurfaceAttrib *attribs,
+    unsigned int num,
+    VASurfaceAttrib *attrib_list,
+    unsigned int *num_attribs
+)
+{
+    VAStatus vaStatus = VA_STATUS_SUCCESS;
+
+    if (attrib_list) {
+        if (*num_attribs < num)
+            vaStatus = VA_STATUS_ERROR_MAX_NUM_EXCEEDED;
+        else if (num > 0)
+            memcpy(attrib_list, attribs, num * sizeof(*attrib_list));
+    }
+    *num_attribs = num;
+    return vaStatus;
+}
+
+VAStatus va_CapsQuerySurfaceAttributes(
+    VADisplay dpy,
+    VAConfigID config,
+    VASurfaceAttrib *attrib_list,
+    unsigned int *num_attribs,
+    VACapsSurfaceAttribsFunc fill
+)
+{
+    VADriverContextP ctx = CAPS_CTX(dpy);
+    struct va_caps *caps = DPY2CAPS(dpy);
+    struct va_caps_surface_attribs *entry;
+    unsigned int h = config % VA_CAPS_HASH_SIZE;
+    VASurfaceAttrib *attribs = NULL;
+    unsigned int num = 0;
+    VAStatus vaStatus;
+
+    if (!num_attribs)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    if (!fill)
+        fill = va_caps_query_driver_surface_attributes;
+
+    if (!caps) {
+        vaStatus = fill(ctx, config, &attribs, &num);
+        if (vaStatus == VA_STATUS_SUCCESS)
+            vaStatus = va_caps_copy_surface_attributes(attribs, num, attrib_list, num_attribs);
+        free(attribs);
+        return vaStatus;
+    }
+
+    pthread_mutex_lock(&caps->lock);
+    for (entry = caps->surface_attribs[h]; entry; entry = entry->next) {
+        if (entry->config == config)
+            break;
+    }
+
+    if (!entry) {
+        vaStatus = fill(ctx, config, &attribs, &num);
+        if (vaStatus != VA_STATUS_SUCCESS)
+            goto unlock;
+
+        entry = calloc(1, sizeof(*entry));
+        if (!entry) {
+            free(attribs);
+            vaStatus = VA_STATUS_ERROR_ALLOCATION_FAILED;
+            goto unlock;
+        }
+        entry->config = config;
+        entry->num_attribs = num;
+        entry->attribs = attribs;
+        entry->next = caps->surface_attribs[h];
+        caps->surface_attribs[h] = entry;
+    }
+
+    vaStatus = va_caps_copy_surface_attributes(entry->attribs, entry->num_attribs,
+               attrib_list, num_attribs);
+
+unlock:
+    pthread_mutex_unlock(&caps->lock);
+    return vaStatus;
+}
+
+void va_CapsDestroyConfig(VADisplay dpy, VAConfigID config)
+{
+    struct va_caps *caps = DPY2CAPS(dpy);
+    struct va_caps_surface_attribs **pentry;
+
+    if (!caps)
+        return;
+
+    pthread_mutex_lock(&caps->lock);
+    pentry = &caps->surface_attribs[config % VA_CAPS_HASH_SIZE];
+    while (*pentry) {
+        struct va_caps_surface_attribs *entry = *pentry;
+
+        if (entry->config == config) {
+            *pentry = entry->next;
+            free(entry->attribs);
+            free(entry);
+            break;
+        }
+        pentry = &entry->next;
+    }
+    pthread_mutex_unlock(&caps->lock);
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2025 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef VA_CAPS_H
+#define VA_CAPS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \brief produce the complete surface attribute list of a config
+ * The list is allocated with malloc() and owned by the caller afterwards */
+typedef VAStatus(*VACapsSurfaceAttribsFunc)(
+    VADriverContextP ctx,
+    VAConfigID config,
+    VASurfaceAttrib **attribs,
+    unsigned int *num_attribs
+);
+
+DLL_HIDDEN
+void va_CapsInit(VADisplay dpy);
+
+DLL_HIDDEN
+void va_CapsEnd(VADisplay dpy);
+
+DLL_HIDDEN
+VAStatus va_CapsQueryConfigProfiles(
+    VADisplay dpy,
+    VAProfile *profile_list,
+    int *num_profiles
+);
+
+DLL_HIDDEN
+VAStatus va_CapsQueryConfigEntrypoints(
+    VADisplay dpy,
+    VAProfile profile,
+    VAEntrypoint *entrypoint_list,
+    int *num_entrypoints
+);
+
+DLL_HIDDEN
+VAStatus va_CapsGetConfigAttributes(
+    VADisplay dpy,
+    VAProfile profile,
+    VAEntrypoint entrypoint,
+    VAConfigAttrib *attrib_list,
+    int num_attribs
+);
+
+DLL_HIDDEN
+VAStatus va_CapsQuerySurfaceAttributes(
+    VADisplay dpy,
+    VAConfigID config,
+    VASurfaceAttrib *attrib_list,
+    unsigned int *num_attribs,
+    VACapsSurfaceAttribsFunc fill
+);
+
+DLL_HIDDEN
+void va_CapsDestroyConfig(VADisplay dpy, VAConfigID config);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VA_CAPS_H */
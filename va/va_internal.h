@@ -57,6 +57,9 @@ void va_infoMessage(VADisplay dpy, const char *msg, ...);
 DLL_HIDDEN
 int  va_parseConfig(char *env, char *env_value);
 
+DLL_HIDDEN
+void va_reloadConfig(void);
+
 VADisplayContextP va_newDisplayContext(void);
 
 VADriverContextP va_newDriverContext(VADisplayContextP dctx);
@@ -0,0 +1,935 @@
+/*
+ * Copyright (c) 2025 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#define _GNU_SOURCE 1
+#include "sysdeps.h"
+#include "va.h"
+#include "va_backend.h"
+#include "va_internal.h"
+#include "va_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+#include "compat_win32.h"
+#else
+#include <pthread.h>
+#endif
+
+/*
+ * Buffer pools recycle parameter and slice data buffers of a context
+ * instead of creating and destroying them for every frame. Surface pools
+ * do the same for surface sets, keeping idle surfaces in LRU order under
+ * a memory cap. Objects are created and destroyed through the public
+ * entry points so tracing sees them as usual, reusing an idle object does
+ * not reach the driver.
+ *
+ * All the pools of a display share one lock, it is never held across a
+ * driver call.
+ */
+
+#define VA_POOL_HASH_SIZE           64
+#define VA_POOL_MIN_SIZE            64
+#define VA_POOL_DEFAULT_MAX_BUFFERS 32
+
+struct va_pool_buffer {
+    struct va_pool_buffer *next;        /* hash chain by id */
+    struct va_pool_buffer *next_free;   /* idle list of the size class */
+    VABufferID id;
+    VABufferType type;
+    unsigned int size;
+    unsigned int num_elements;
+    int in_use;
+};
+
+struct va_buffer_pool {
+    VABufferPoolID id;
+    VAContextID context;
+    unsigned int max_buffers;
+    unsigned int num_idle;
+    struct va_pool_buffer *buffers[VA_POOL_HASH_SIZE];
+    struct va_pool_buffer *idle[VA_POOL_HASH_SIZE];
+};
+
+struct va_pool_surface {
+    struct va_pool_surface *next;       /* hash chain by id */
+    struct va_pool_surface *lru_prev;   /* idle list, most recent first */
+    struct va_pool_surface *lru_next;
+    VASurfaceID id;
+    unsigned int format;
+    unsigned int width;
+    unsigned int height;
+    uint32_t attribs_hash;
+    unsigned int num_attribs;
+    VASurfaceAttrib *attribs;
+    uint64_t bytes;
+    int pooled;                         /* 0 if it may not be reused */
+    int in_use;
+};
+
+struct va_surface_pool {
+    VASurfacePoolID id;
+    uint64_t max_idle_bytes;
+    uint64_t idle_bytes;
+    struct va_pool_surface *surfaces[VA_POOL_HASH_SIZE];
+    struct va_pool_surface *lru_head;
+    struct va_pool_surface *lru_tail;
+};
+
+struct va_pool {
+    pthread_mutex_t lock;
+    /* indexed by pool id - 1, NULL for free slots */
+    struct va_buffer_pool **buffer_pools;
+    unsigned int num_buffer_pools;
+    struct va_surface_pool **surface_pools;
+    unsigned int num_surface_pools;
+};
+
+#define DPY2POOL(dpy) ((struct va_pool *)((VADisplayContextP)(dpy))->vapool)
+
+/* payload buffers whose valid size comes from other parameters, e.g. the
+ * slice parameters, parameter buffers keep the exact size of their struct */
+static int va_pool_rounded_type(VABufferType type)
+{
+    switch (type) {
+    case VASliceDataBufferType:
+    case VABitPlaneBufferType:
+    case VAEncPackedHeaderDataBufferType:
+    case VAProtectedSliceDataBufferType:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static unsigned int va_pool_size_class(unsigned int size)
+{
+    unsigned int size_class = VA_POOL_MIN_SIZE;
+
+    while (size_class < size && size_class < 0x80000000u)
+        size_class <<= 1;
+    return size_class < size ? size : size_class;
+}
+
+static unsigned int va_pool_hash_key(
+    VABufferType type,
+    unsigned int size,
+    unsigned int num_elements
+)
+{
+    uint32_t h = 2166136261u;
+
+    h = (h ^ (uint32_t)type) * 16777619u;
+    h = (h ^ size) * 16777619u;
+    h = (h ^ num_elements) * 16777619u;
+    return h % VA_POOL_HASH_SIZE;
+}
+
+/* must be called with the lock held */
+static struct va_buffer_pool *va_pool_find(struct va_pool *pools, VABufferPoolID id)
+{
+    if (id == 0 || id > pools->num_buffer_pools)
+        return NULL;
+    return pools->buffer_pools[id - 1];
+}
+
+/* must be called with the lock held */
+static struct va_surface_pool *va_pool_find_surface_pool(struct va_pool *pools, VASurfacePoolID id)
+{
+    if (id == 0 || id > pools->num_surface_pools)
+        return NULL;
+    return pools->surface_pools[id - 1];
+}
+
+/* store a pool in the first free slot of a table, returns its id or 0;
+ * must be called with the lock held */
+static unsigned int va_pool_add_slot(void ***slots, unsigned int *num_slots, void *pool)
+{
+    unsigned int i;
+
+    for (i = 0; i < *num_slots; i++) {
+        if (!(*slots)[i])
+            break;
+    }
+    if (i == *num_slots) {
+        unsigned int num = *num_slots ? *num_slots * 2 : 8;
+        void **new_slots = realloc(*slots, num * sizeof(*new_slots));
+
+        if (!new_slots)
+            return 0;
+        memset(new_slots + i, 0, (num - i) * sizeof(*new_slots));
+        *slots = new_slots;
+        *num_slots = num;
+    }
+    (*slots)[i] = pool;
+    return i + 1;
+}
+
+static struct va_pool_buffer *va_pool_find_buffer(
+    struct va_buffer_pool *pool,
+    VABufferID id
+)
+{
+    struct va_pool_buffer *buffer;
+
+    for (buffer = pool->buffers[id % VA_POOL_HASH_SIZE]; buffer; buffer = buffer->next) {
+        if (buffer->id == id)
+            return buffer;
+    }
+    return NULL;
+}
+
+static void va_pool_remove_buffer(
+    struct va_buffer_pool *pool,
+    struct va_pool_buffer *buffer
+)
+{
+    struct va_pool_buffer **pbuffer = &pool->buffers[buffer->id % VA_POOL_HASH_SIZE];
+
+    while (*pbuffer != buffer)
+        pbuffer = &(*pbuffer)->next;
+    *pbuffer = buffer->next;
+}
+
+/* destroy the buffers of a pool already removed from the display */
+static void va_pool_free(VADisplay dpy, struct va_buffer_pool *pool)
+{
+    int i;
+
+    for (i = 0; i < VA_POOL_HASH_SIZE; i++) {
+        while (pool->buffers[i]) {
+            struct va_pool_buffer *next = pool->buffers[i]->next;
+            vaDestroyBuffer(dpy, pool->buffers[i]->id);
+            free(pool->buffers[i]);
+            pool->buffers[i] = next;
+        }
+    }
+    free(pool);
+}
+
+/* rough size of a surface, only used to enforce the idle memory cap */
+static uint64_t va_pool_surface_bytes(
+    unsigned int format,
+    unsigned int width,
+    unsigned int height
+)
+{
+    uint64_t pixels = (uint64_t)width * height;
+
+    switch (format & ~VA_RT_FORMAT_PROTECTED) {
+    case VA_RT_FORMAT_YUV400:
+        return pixels;
+    case VA_RT_FORMAT_YUV420:
+    case VA_RT_FORMAT_YUV411:
+        return pixels * 3 / 2;
+    case VA_RT_FORMAT_YUV422:
+    case VA_RT_FORMAT_RGB16:
+        return pixels * 2;
+    case VA_RT_FORMAT_YUV420_10:
+    case VA_RT_FORMAT_YUV420_12:
+    case VA_RT_FORMAT_YUV444:
+    case VA_RT_FORMAT_RGBP:
+        return pixels * 3;
+    case VA_RT_FORMAT_YUV422_10:
+    case VA_RT_FORMAT_YUV422_12:
+    case VA_RT_FORMAT_RGB32:
+    case VA_RT_FORMAT_RGB32_10:
+        return pixels * 4;
+    case VA_RT_FORMAT_YUV444_10:
+    case VA_RT_FORMAT_YUV444_12:
+        return pixels * 6;
+    default:
+        return pixels * 4;
+    }
+}
+
+/* hash of an attribute list, 0 if it holds something that can't be reused */
+static int va_pool_hash_surface_attribs(
+    const VASurfaceAttrib *attrib_list,
+    unsigned int num_attribs,
+    uint32_t *hash
+)
+{
+    uint32_t h = 2166136261u;
+    unsigned int i;
+
+    for (i = 0; i < num_attribs; i++) {
+        const VASurfaceAttrib *attrib = &attrib_list[i];
+
+        if (attrib->value.type != VAGenericValueTypeInteger &&
+            attrib->value.type != VAGenericValueTypeFloat)
+            return 0;
+
+        h = (h ^ (uint32_t)attrib->type) * 16777619u;
+        h = (h ^ attrib->flags) * 16777619u;
+        h = (h ^ (uint32_t)attrib->value.type) * 16777619u;
+        if (attrib->value.type == VAGenericValueTypeInteger)
+            h = (h ^ (uint32_t)attrib->value.value.i) * 16777619u;
+    }
+    *hash = h;
+    return 1;
+}
+
+static int va_pool_match_surface(
+    const struct va_pool_surface *surface,
+    unsigned int format,
+    unsigned int width,
+    unsigned int height,
+    uint32_t attribs_hash,
+    const VASurfaceAttrib *attrib_list,
+    unsigned int num_attribs
+)
+{
+    unsigned int i;
+
+    if (surface->format != format || surface->width != width ||
+        surface->height != height || surface->attribs_hash != attribs_hash ||
+        surface->num_attribs != num_attribs)
+        return 0;
+
+    for (i = 0; i < num_attribs; i++) {
+        const VASurfaceAttrib *a = &surface->attribs[i];
+        const VASurfaceAttrib *b = &attrib_list[i];
+
+        if (a->type != b->type || a->flags != b->flags ||
+            a->value.type != b->value.type)
+            return 0;
+        if (a->value.type == VAGenericValueTypeInteger &&
+            a->value.value.i != b->value.value.i)
+            return 0;
+        if (a->value.type == VAGenericValueTypeFloat &&
+            a->value.value.f != b->value.value.f)
+            return 0;
+    }
+    return 1;
+}
+
+static void va_pool_lru_remove(
+    struct va_surface_pool *pool,
+    struct va_pool_surface *surface
+)
+{
+    if (surface->lru_prev)
+        surface->lru_prev->lru_next = surface->lru_next;
+    else
+        pool->lru_head = surface->lru_next;
+    if (surface->lru_next)
+        surface->lru_next->lru_prev = surface->lru_prev;
+    else
+        pool->lru_tail = surface->lru_prev;
+    surface->lru_prev = surface->lru_next = NULL;
+    pool->idle_bytes -= surface->bytes;
+}
+
+static void va_pool_remove_surface(
+    struct va_surface_pool *pool,
+    struct va_pool_surface *surface
+)
+{
+    struct va_pool_surface **psurface = &pool->surfaces[surface->id % VA_POOL_HASH_SIZE];
+
+    while (*psurface != surface)
+        psurface = &(*psurface)->next;
+    *psurface = surface->next;
+}
+
+static struct va_pool_surface *va_pool_find_surface(
+    struct va_surface_pool *pool,
+    VASurfaceID id
+)
+{
+    struct va_pool_surface *surface;
+
+    for (surface = pool->surfaces[id % VA_POOL_HASH_SIZE]; surface; surface = surface->next) {
+        if (surface->id == id)
+            return surface;
+    }
+    return NULL;
+}
+
+static void va_pool_free_surface_pool(VADisplay dpy, struct va_surface_pool *pool)
+{
+    int i;
+
+    for (i = 0; i < VA_POOL_HASH_SIZE; i++) {
+        while (pool->surfaces[i]) {
+            struct va_pool_surface *next = pool->surfaces[i]->next;
+            vaDestroySurfaces(dpy, &pool->surfaces[i]->id, 1);
+            free(pool->surfaces[i]->attribs);
+            free(pool->surfaces[i]);
+            pool->surfaces[i] = next;
+        }
+    }
+    free(pool);
+}
+
+static VAStatus va_pool_upload(
+    VADisplay dpy,
+    VABufferID buf_id,
+    const void *data,
+    size_t data_size
+)
+{
+    void *pbuf = NULL;
+    VAStatus va_status;
+
+    va_status = vaMapBuffer(dpy, buf_id, &pbuf);
+    if (va_status != VA_STATUS_SUCCESS)
+        return va_status;
+
+    memcpy(pbuf, data, data_size);
+    return vaUnmapBuffer(dpy, buf_id);
+}
+
+void va_PoolInit(VADisplay dpy)
+{
+    VADisplayContextP pDisplayContext = (VADisplayContextP)dpy;
+    struct va_pool *pools;
+
+    if (pDisplayContext->vapool)
+        va_PoolEnd(dpy);
+
+    pools = calloc(1, sizeof(*pools));
+    if (!pools)
+        return;
+
+    pthread_mutex_init(&pools->lock, NULL);
+    pDisplayContext->vapool = pools;
+}
+
+void va_PoolEnd(VADisplay dpy)
+{
+    VADisplayContextP pDisplayContext = (VADisplayContextP)dpy;
+    struct va_pool *pools = DPY2POOL(dpy);
+    unsigned int i;
+
+    if (!pools)
+        return;
+
+    for (i = 0; i < pools->num_buffer_pools; i++) {
+        if (pools->buffer_pools[i])
+            va_pool_free(dpy, pools->buffer_pools[i]);
+    }
+    free(pools->buffer_pools);
+    for (i = 0; i < pools->num_surface_pools; i++) {
+        if (pools->surface_pools[i])
+            va_pool_free_surface_pool(dpy, pools->surface_pools[i]);
+    }
+    free(pools->surface_pools);
+    pthread_mutex_destroy(&pools->lock);
+    free(pools);
+    pDisplayContext->vapool = NULL;
+}
+
+void va_PoolDestroyContext(VADisplay dpy, VAContextID context)
+{
+    struct va_pool *pools = DPY2POOL(dpy);
+    unsigned int i;
+
+    if (!pools)
+        return;
+
+    pthread_mutex_lock(&pools->lock);
+    for (i = 0; i < pools->num_buffer_pools; i++) {
+        struct va_buffer_pool *pool = pools->buffer_pools[i];
+
+        if (!pool || pool->context != context)
+            continue;
+
+        pools->buffer_pools[i] = NULL;
+        pthread_mutex_unlock(&pools->lock);
+        va_pool_free(dpy, pool);
+        pthread_mutex_lock(&pools->lock);
+    }
+    pthread_mutex_unlock(&pools->lock);
+}
+
+VAStatus vaCreateBufferPool(
+    VADisplay dpy,
+    VAContextID context,
+    unsigned int max_buffers,
+    VABufferPoolID *pool_id
+)
+{
+    struct va_pool *pools;
+    struct va_buffer_pool *pool;
+
+    CHECK_DISPLAY(dpy);
+    pools = DPY2POOL(dpy);
+    if (!pools)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+    if (!pool_id)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    pool->context = context;
+    pool->max_buffers = max_buffers ? max_buffers : VA_POOL_DEFAULT_MAX_BUFFERS;
+
+    pthread_mutex_lock(&pools->lock);
+    pool->id = va_pool_add_slot((void ***)&pools->buffer_pools,
+                                &pools->num_buffer_pools, pool);
+    pthread_mutex_unlock(&pools->lock);
+
+    if (!pool->id) {
+        free(pool);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+
+    *pool_id = pool->id;
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus vaDestroyBufferPool(
+    VADisplay dpy,
+    VABufferPoolID pool_id
+)
+{
+    struct va_pool *pools;
+    struct va_buffer_pool *pool;
+
+    CHECK_DISPLAY(dpy);
+    pools = DPY2POOL(dpy);
+    if (!pools)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    pthread_mutex_lock(&pools->lock);
+    pool = va_pool_find(pools, pool_id);
+    if (pool)
+        pools->buffer_pools[pool_id - 1] = NULL;
+    pthread_mutex_unlock(&pools->lock);
+
+    if (!pool)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    va_pool_free(dpy, pool);
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus vaAcquirePooledBuffer(
+    VADisplay dpy,
+    VABufferPoolID pool_id,
+    VABufferType type,
+    unsigned int size,
+    unsigned int num_elements,
+    void *data,
+    VABufferID *buf_id
+)
+{
+    struct va_pool *pools;
+    struct va_buffer_pool *pool;
+    struct va_pool_buffer *buffer, **pbuffer;
+    VAContextID context;
+    size_t data_size;
+    unsigned int h;
+    VAStatus va_status;
+
+    CHECK_DISPLAY(dpy);
+    pools = DPY2POOL(dpy);
+    if (!pools)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+    if (!buf_id || !size || !num_elements)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    /* the element stride of arrays must stay exact */
+    data_size = (size_t)size * num_elements;
+    if (num_elements == 1 && va_pool_rounded_type(type))
+        size = va_pool_size_class(size);
+    h = va_pool_hash_key(type, size, num_elements);
+
+    pthread_mutex_lock(&pools->lock);
+    pool = va_pool_find(pools, pool_id);
+    if (!pool) {
+        pthread_mutex_unlock(&pools->lock);
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
+    for (pbuffer = &pool->idle[h]; *pbuffer; pbuffer = &(*pbuffer)->next_free) {
+        buffer = *pbuffer;
+        if (buffer->type == type && buffer->size == size &&
+            buffer->num_elements == num_elements) {
+            *pbuffer = buffer->next_free;
+            buffer->next_free = NULL;
+            buffer->in_use = 1;
+            pool->num_idle--;
+            *buf_id = buffer->id;
+            pthread_mutex_unlock(&pools->lock);
+
+            if (data) {
+                va_status = va_pool_upload(dpy, *buf_id, data, data_size);
+                if (va_status != VA_STATUS_SUCCESS) {
+                    vaReleasePooledBuffer(dpy, pool_id, *buf_id);
+                    return va_status;
+                }
+            }
+            return VA_STATUS_SUCCESS;
+        }
+    }
+    context = pool->context;
+    pthread_mutex_unlock(&pools->lock);
+
+    buffer = calloc(1, sizeof(*buffer));
+    if (!buffer)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+    va_status = vaCreateBuffer(dpy, context, type, size, num_elements, NULL, &buffer->id);
+    if (va_status != VA_STATUS_SUCCESS) {
+        free(buffer);
+        return va_status;
+    }
+    if (data) {
+        va_status = va_pool_upload(dpy, buffer->id, data, data_size);
+        if (va_status != VA_STATUS_SUCCESS) {
+            vaDestroyBuffer(dpy, buffer->id);
+            free(buffer);
+            return va_status;
+        }
+    }
+    buffer->type = type;
+    buffer->size = size;
+    buffer->num_elements = num_elements;
+    buffer->in_use = 1;
+
+    pthread_mutex_lock(&pools->lock);
+    pool = va_pool_find(pools, pool_id);
+    if (pool) {
+        buffer->next = pool->buffers[buffer->id % VA_POOL_HASH_SIZE];
+        pool->buffers[buffer->id % VA_POOL_HASH_SIZE] = buffer;
+    }
+    pthread_mutex_unlock(&pools->lock);
+
+    /* the pool was destroyed meanwhile */
+    if (!pool) {
+        vaDestroyBuffer(dpy, buffer->id);
+        free(buffer);
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
+    *buf_id = buffer->id;
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus vaReleasePooledBuffer(
+    VADisplay dpy,
+    VABufferPoolID pool_id,
+    VABufferID buf_id
+)
+{
+    struct va_pool *pools;
+    struct va_buffer_pool *pool;
+    struct va_pool_buffer *buffer;
+    unsigned int h;
+
+    CHECK_DISPLAY(dpy);
+    pools = DPY2POOL(dpy);
+    if (!pools)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    pthread_mutex_lock(&pools->lock);
+    pool = va_pool_find(pools, pool_id);
+    if (!pool) {
+        pthread_mutex_unlock(&pools->lock);
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
+    buffer = va_pool_find_buffer(pool, buf_id);
+    if (!buffer || !buffer->in_use) {
+        pthread_mutex_unlock(&pools->lock);
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+    }
+
+    if (pool->num_idle >= pool->max_buffers) {
+        va_pool_remove_buffer(pool, buffer);
+        pthread_mutex_unlock(&pools->lock);
+        free(buffer);
+        return vaDestroyBuffer(dpy, buf_id);
+    }
+
+    h = va_pool_hash_key(buffer->type, buffer->size, buffer->num_elements);
+    buffer->in_use = 0;
+    buffer->next_free = pool->idle[h];
+    pool->idle[h] = buffer;
+    pool->num_idle++;
+    pthread_mutex_unlock(&pools->lock);
+
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus vaCreateSurfacePool(
+    VADisplay dpy,
+    uint64_t max_idle_bytes,
+    VASurfacePoolID *pool_id
+)
+{
+    struct va_pool *pools;
+    struct va_surface_pool *pool;
+
+    CHECK_DISPLAY(dpy);
+    pools = DPY2POOL(dpy);
+    if (!pools)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+    if (!pool_id)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    pool = calloc(1, sizeof(*pool));
+    if (!pool)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    pool->max_idle_bytes = max_idle_bytes;
+
+    pthread_mutex_lock(&pools->lock);
+    pool->id = va_pool_add_slot((void ***)&pools->surface_pools,
+                                &pools->num_surface_pools, pool);
+    pthread_mutex_unlock(&pools->lock);
+
+    if (!pool->id) {
+        free(pool);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+
+    *pool_id = pool->id;
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus vaDestroySurfacePool(
+    VADisplay dpy,
+    VASurfacePoolID pool_id
+)
+{
+    struct va_pool *pools;
+    struct va_surface_pool *pool;
+
+    CHECK_DISPLAY(dpy);
+    pools = DPY2POOL(dpy);
+    if (!pools)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    pthread_mutex_lock(&pools->lock);
+    pool = va_pool_find_surface_pool(pools, pool_id);
+    if (pool)
+        pools->surface_pools[pool_id - 1] = NULL;
+    pthread_mutex_unlock(&pools->lock);
+
+    if (!pool)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    va_pool_free_surface_pool(dpy, pool);
+    return VA_STATUS_SUCCESS;
+}
+
+VAStatus vaAcquirePooledSurfaces(
+    VADisplay dpy,
+    VASurfacePoolID pool_id,
+    unsigned int format,
+    unsigned int width,
+    unsigned int height,
+    VASurfaceID *surfaces,
+    unsigned int num_surfaces,
+    VASurfaceAttrib *attrib_list,
+    unsigned int num_attribs
+)
+{
+    struct va_pool *pools;
+    struct va_surface_pool *pool;
+    struct va_pool_surface *surface, **created = NULL;
+    uint32_t attribs_hash = 0;
+    unsigned int num_reused = 0, i;
+    int pooled;
+    VAStatus va_status;
+
+    CHECK_DISPLAY(dpy);
+    pools = DPY2POOL(dpy);
+    if (!pools)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+    if (!surfaces || !num_surfaces || (num_attribs && !attrib_list))
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    pooled = va_pool_hash_surface_attribs(attrib_list, num_attribs, &attribs_hash);
+
+    pthread_mutex_lock(&pools->lock);
+    pool = va_pool_find_surface_pool(pools, pool_id);
+    if (!pool) {
+        pthread_mutex_unlock(&pools->lock);
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
+    /* most recently released first, they are the most likely to be cached */
+    surface = pooled ? pool->lru_head : NULL;
+    while (surface && num_reused < num_surfaces) {
+        struct va_pool_surface *next = surface->lru_next;
+
+        if (va_pool_match_surface(surface, format, width, height, attribs_hash,
+                                  attrib_list, num_attribs)) {
+            va_pool_lru_remove(pool, surface);
+            surface->in_use = 1;
+            surfaces[num_reused++] = surface->id;
+        }
+        surface = next;
+    }
+    pthread_mutex_unlock(&pools->lock);
+
+    if (num_reused == num_surfaces)
+        return VA_STATUS_SUCCESS;
+
+    created = calloc(num_surfaces - num_reused, sizeof(*created));
+    if (!created) {
+        va_status = VA_STATUS_ERROR_ALLOCATION_FAILED;
+        goto error;
+    }
+    for (i = 0; i < num_surfaces - num_reused; i++) {
+        surface = calloc(1, sizeof(*surface));
+        if (surface && num_attribs)
+            surface->attribs = malloc(num_attribs * sizeof(*attrib_list));
+        if (!surface || (num_attribs && !surface->attribs)) {
+            free(surface);
+            va_status = VA_STATUS_ERROR_ALLOCATION_FAILED;
+            goto error;
+        }
+        created[i] = surface;
+    }
+
+    va_status = vaCreateSurfaces(dpy, format, width, height, surfaces + num_reused,
+                                 num_surfaces - num_reused, attrib_list, num_attribs);
+    if (va_status != VA_STATUS_SUCCESS)
+        goto error;
+
+    pthread_mutex_lock(&pools->lock);
+    pool = va_pool_find_surface_pool(pools, pool_id);
+    for (i = 0; pool && i < num_surfaces - num_reused; i++) {
+        unsigned int h;
+
+        surface = created[i];
+        surface->id = surfaces[num_reused + i];
+        surface->format = format;
+        surface->width = width;
+        surface->height = height;
+        surface->attribs_hash = attribs_hash;
+        surface->num_attribs = num_attribs;
+        if (num_attribs)
+            memcpy(surface->attribs, attrib_list, num_attribs * sizeof(*attrib_list));
+        surface->bytes = va_pool_surface_bytes(format, width, height);
+        surface->pooled = pooled;
+        surface->in_use = 1;
+
+        h = surface->id % VA_POOL_HASH_SIZE;
+        surface->next = pool->surfaces[h];
+        pool->surfaces[h] = surface;
+    }
+    pthread_mutex_unlock(&pools->lock);
+
+    /* the pool was destroyed meanwhile, along with the reused surfaces */
+    if (!pool) {
+        vaDestroySurfaces(dpy, surfaces + num_reused, num_surfaces - num_reused);
+        va_status = VA_STATUS_ERROR_INVALID_PARAMETER;
+        goto error;
+    }
+
+    free(created);
+    return VA_STATUS_SUCCESS;
+
+error:
+    if (created) {
+        for (i = 0; i < num_surfaces - num_reused; i++) {
+            if (created[i]) {
+                free(created[i]->attribs);
+                free(created[i]);
+            }
+        }
+        free(created);
+    }
+    if (num_reused)
+        vaReleasePooledSurfaces(dpy, pool_id, surfaces, num_reused);
+    return va_status;
+}
+
+VAStatus vaReleasePooledSurfaces(
+    VADisplay dpy,
+    VASurfacePoolID pool_id,
+    VASurfaceID *surfaces,
+    unsigned int num_surfaces
+)
+{
+    struct va_pool *pools;
+    struct va_surface_pool *pool;
+    struct va_pool_surface *surface, *evicted = NULL;
+    VAStatus va_status = VA_STATUS_SUCCESS;
+    unsigned int i;
+
+    CHECK_DISPLAY(dpy);
+    pools = DPY2POOL(dpy);
+    if (!pools)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+    if (!surfaces && num_surfaces)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    pthread_mutex_lock(&pools->lock);
+    pool = va_pool_find_surface_pool(pools, pool_id);
+    if (!pool) {
+        pthread_mutex_unlock(&pools->lock);
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
+    for (i = 0; i < num_surfaces; i++) {
+        surface = va_pool_find_surface(pool, surfaces[i]);
+        if (!surface || !surface->in_use) {
+            va_status = VA_STATUS_ERROR_INVALID_SURFACE;
+            continue;
+        }
+
+        surface->in_use = 0;
+        if (!surface->pooled) {
+            va_pool_remove_surface(pool, surface);
+            surface->next = evicted;
+            evicted = surface;
+            continue;
+        }
+
+        surface->lru_prev = NULL;
+        surface->lru_next = pool->lru_head;
+        if (pool->lru_head)
+            pool->lru_head->lru_prev = surface;
+        else
+            pool->lru_tail = surface;
+        pool->lru_head = surface;
+        pool->idle_bytes += surface->bytes;
+    }
+
+    /* evict the least recently released surfaces above the cap */
+    while (pool->max_idle_bytes && pool->idle_bytes > pool->max_idle_bytes) {
+        surface = pool->lru_tail;
+        va_pool_lru_remove(pool, surface);
+        va_pool_remove_surface(pool, surface);
+        surface->next = evicted;
+        evicted = surface;
+    }
+    pthread_mutex_unlock(&pools->lock);
+
+    while (evicted) {
+        surface = evicted->next;
+        vaDestroySurfaces(dpy, &evicted->id, 1);
+        free(evicted->attribs);
+        free(evicted);
+        evicted = surface;
+    }
+
+    return va_status;
+}
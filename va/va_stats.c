@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2025 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE 1
+#include "sysdeps.h"
+#include "va.h"
+#include "va_backend.h"
+#include "va_internal.h"
+#include "va_stats.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+#include "compat_win32.h"
+#else
+#include <time.h>
+#endif
+
+/*
+ * Env. to collect per entry point latency statistics:
+ * .LIBVA_CALL_STATS=1: measure the driver calls of every display initialized
+ *                      afterwards, results are read with vaGetCallStatistics()
+ *
+ * Every thread accumulates into its own block of counters, so recording a
+ * call takes no lock and no atomic read-modify-write. vaGetCallStatistics()
+ * sums the blocks of all threads that ever used the display.
+ */
+
+/* LIBVA_CALL_STATS */
+int va_stats_flag = 0;
+
+/* 4 buckets per power of two, covers latencies up to 2^40 ns (~18 minutes) */
+#define VA_STATS_SUB_BUCKET_BITS    2
+#define VA_STATS_SUB_BUCKETS        (1 << VA_STATS_SUB_BUCKET_BITS)
+#define VA_STATS_NUM_BUCKETS        (VA_STATS_SUB_BUCKETS * 40)
+
+#if defined(_MSC_VER)
+#define VA_STATS_TLS                    __declspec(thread)
+#define VA_STATS_LOAD(p)                (*(volatile uint64_t *)(p))
+#define VA_STATS_STORE(p, v)            (*(volatile uint64_t *)(p) = (v))
+#define VA_STATS_LOAD_PTR(p)            (*(void * volatile *)(p))
+#define VA_STATS_CAS_PTR(p, old, new)   \
+    (InterlockedCompareExchangePointer((PVOID volatile *)(p), new, old) == (old))
+#else
+#define VA_STATS_TLS                    __thread
+#define VA_STATS_LOAD(p)                __atomic_load_n(p, __ATOMIC_RELAXED)
+#define VA_STATS_STORE(p, v)            __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#define VA_STATS_LOAD_PTR(p)            __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define VA_STATS_CAS_PTR(p, old, new)   \
+    __atomic_compare_exchange_n(p, &(old), new, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)
+#endif
+
+struct va_stats_counters {
+    uint64_t count;
+    uint64_t errors;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t histogram[VA_STATS_NUM_BUCKETS];
+};
+
+/* counters of one thread, only ever written by that thread */
+struct va_stats_thread {
+    struct va_stats_thread *next;
+    const void *owner;
+    struct va_stats_counters calls[VA_STATS_NUM_CALLS];
+};
+
+struct va_stats {
+    uint64_t serial;
+    /* push-only list, freed in va_StatsEnd */
+    struct va_stats_thread *threads;
+};
+
+/* last block used by the current thread */
+static VA_STATS_TLS struct {
+    uint64_t serial;
+    struct va_stats_thread *thread;
+} va_stats_cache;
+
+static uint64_t va_stats_serial = 0;
+
+static const char *va_stats_call_names[VA_STATS_NUM_CALLS] = {
+    [VA_STATS_QUERY_CONFIG_PROFILES]    = "vaQueryConfigProfiles",
+    [VA_STATS_QUERY_CONFIG_ENTRYPOINTS] = "vaQueryConfigEntrypoints",
+    [VA_STATS_GET_CONFIG_ATTRIBUTES]    = "vaGetConfigAttributes",
+    [VA_STATS_CREATE_CONFIG]            = "vaCreateConfig",
+    [VA_STATS_DESTROY_CONFIG]           = "vaDestroyConfig",
+    [VA_STATS_QUERY_SURFACE_ATTRIBUTES] = "vaQuerySurfaceAttributes",
+    [VA_STATS_CREATE_SURFACES]          = "vaCreateSurfaces",
+    [VA_STATS_DESTROY_SURFACES]         = "vaDestroySurfaces",
+    [VA_STATS_CREATE_CONTEXT]           = "vaCreateContext",
+    [VA_STATS_DESTROY_CONTEXT]          = "vaDestroyContext",
+    [VA_STATS_CREATE_BUFFER]            = "vaCreateBuffer",
+    [VA_STATS_CREATE_BUFFER2]           = "vaCreateBuffer2",
+    [VA_STATS_BUFFER_SET_NUM_ELEMENTS]  = "vaBufferSetNumElements",
+    [VA_STATS_MAP_BUFFER]               = "vaMapBuffer",
+    [VA_STATS_MAP_BUFFER2]              = "vaMapBuffer2",
+    [VA_STATS_UNMAP_BUFFER]             = "vaUnmapBuffer",
+    [VA_STATS_DESTROY_BUFFER]           = "vaDestroyBuffer",
+    [VA_STATS_ACQUIRE_BUFFER_HANDLE]    = "vaAcquireBufferHandle",
+    [VA_STATS_RELEASE_BUFFER_HANDLE]    = "vaReleaseBufferHandle",
+    [VA_STATS_EXPORT_SURFACE_HANDLE]    = "vaExportSurfaceHandle",
+    [VA_STATS_BEGIN_PICTURE]            = "vaBeginPicture",
+    [VA_STATS_RENDER_PICTURE]           = "vaRenderPicture",
+    [VA_STATS_END_PICTURE]              = "vaEndPicture",
+    [VA_STATS_SUBMIT_PICTURE]           = "vaSubmitPicture",
+    [VA_STATS_SYNC_SURFACE]             = "vaSyncSurface",
+    [VA_STATS_SYNC_SURFACE2]            = "vaSyncSurface2",
+    [VA_STATS_QUERY_SURFACE_STATUS]     = "vaQuerySurfaceStatus",
+    [VA_STATS_SYNC_BUFFER]              = "vaSyncBuffer",
+    [VA_STATS_CREATE_IMAGE]             = "vaCreateImage",
+    [VA_STATS_DESTROY_IMAGE]            = "vaDestroyImage",
+    [VA_STATS_GET_IMAGE]                = "vaGetImage",
+    [VA_STATS_PUT_IMAGE]                = "vaPutImage",
+    [VA_STATS_DERIVE_IMAGE]             = "vaDeriveImage",
+    [VA_STATS_COPY]                     = "vaCopy",
+};
+
+#define DPY2STATS(dpy) ((struct va_stats *)((VADisplayContextP)(dpy))->vastats)
+
+uint64_t va_StatsTimestamp(void)
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (!frequency.QuadPart)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ull +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ull / frequency.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static int va_stats_bucket(uint64_t ns)
+{
+    int msb = 0, bucket;
+
+    if (ns < VA_STATS_SUB_BUCKETS)
+        return (int)ns;
+
+    while (ns >> (msb + 1))
+        msb++;
+
+    bucket = (msb - VA_STATS_SUB_BUCKET_BITS + 1) * VA_STATS_SUB_BUCKETS +
+             (int)((ns >> (msb - VA_STATS_SUB_BUCKET_BITS)) & (VA_STATS_SUB_BUCKETS - 1));
+
+    return bucket < VA_STATS_NUM_BUCKETS ? bucket : VA_STATS_NUM_BUCKETS - 1;
+}
+
+/* smallest latency that falls into the given bucket */
+static uint64_t va_stats_bucket_base(int bucket)
+{
+    int shift = bucket / VA_STATS_SUB_BUCKETS - 1;
+
+    if (bucket < VA_STATS_SUB_BUCKETS)
+        return bucket;
+
+    return (uint64_t)(VA_STATS_SUB_BUCKETS + bucket % VA_STATS_SUB_BUCKETS) << shift;
+}
+
+void va_StatsInit(VADisplay dpy)
+{
+    VADisplayContextP pDisplayContext = (VADisplayContextP)dpy;
+    char env_value[1024];
+    struct va_stats *stats;
+
+    if (va_parseConfig("LIBVA_CALL_STATS", env_value) != 0 ||
+        atoi(env_value) == 0)
+        return;
+
+    stats = calloc(1, sizeof(*stats));
+    if (!stats) {
+        va_errorMessage(dpy, "%s L%d Out of memory\n", __func__, __LINE__);
+        return;
+    }
+
+#if defined(_MSC_VER)
+    stats->serial = InterlockedIncrement64((LONG64 volatile *)&va_stats_serial);
+#else
+    stats->serial = __atomic_add_fetch(&va_stats_serial, 1, __ATOMIC_RELAXED);
+#endif
+
+    pDisplayContext->vastats = stats;
+    va_stats_flag = 1;
+}
+
+void va_StatsEnd(VADisplay dpy)
+{
+    VADisplayContextP pDisplayContext = (VADisplayContextP)dpy;
+    struct va_stats *stats = DPY2STATS(dpy);
+    struct va_stats_thread *thread, *next;
+
+    if (!stats)
+        return;
+
+    for (thread = stats->threads; thread; thread = next) {
+        next = thread->next;
+        free(thread);
+    }
+
+    free(stats);
+    pDisplayContext->vastats = NULL;
+}
+
+static struct va_stats_thread *va_stats_get_thread(struct va_stats *stats)
+{
+    /* the address of a TLS variable identifies the calling thread */
+    const void *owner = &va_stats_cache;
+    struct va_stats_thread *thread, *head;
+
+    if (va_stats_cache.serial == stats->serial)
+        return va_stats_cache.thread;
+
+    for (thread = VA_STATS_LOAD_PTR(&stats->threads); thread; thread = thread->next) {
+        if (thread->owner == owner)
+            break;
+    }
+
+    if (!thread) {
+        thread = calloc(1, sizeof(*thread));
+        if (!thread)
+            return NULL;
+        thread->owner = owner;
+
+        do {
+            head = VA_STATS_LOAD_PTR(&stats->threads);
+            thread->next = head;
+        } while (!VA_STATS_CAS_PTR(&stats->threads, head, thread));
+    }
+
+    va_stats_cache.serial = stats->serial;
+    va_stats_cache.thread = thread;
+    return thread;
+}
+
+void va_StatsRecord(
+    VADisplay dpy,
+    VAStatsCall call,
+    uint64_t start,
+    VAStatus status
+)
+{
+    struct va_stats *stats = DPY2STATS(dpy);
+    struct va_stats_thread *thread;
+    struct va_stats_counters *counters;
+    uint64_t ns = va_StatsTimestamp() - start;
+    int bucket;
+
+    if (!stats)
+        return;
+
+    thread = va_stats_get_thread(stats);
+    if (!thread)
+        return;
+
+    counters = &thread->calls[call];
+    bucket = va_stats_bucket(ns);
+
+    /* single writer: plain updates, stored atomically for the readers */
+    if (counters->count == 0 || ns < counters->min_ns)
+        VA_STATS_STORE(&counters->min_ns, ns);
+    if (ns > counters->max_ns)
+        VA_STATS_STORE(&counters->max_ns, ns);
+    VA_STATS_STORE(&counters->total_ns, counters->total_ns + ns);
+    VA_STATS_STORE(&counters->histogram[bucket], counters->histogram[bucket] + 1);
+    if (status != VA_STATUS_SUCCESS)
+        VA_STATS_STORE(&counters->errors, counters->errors + 1);
+    VA_STATS_STORE(&counters->count, counters->count + 1);
+}
+
+static uint64_t va_stats_percentile(
+    const uint64_t *histogram,
+    uint64_t count,
+    unsigned int percent,
+    uint64_t min_ns,
+    uint64_t max_ns
+)
+{
+    uint64_t rank, seen = 0, value;
+    int i;
+
+    if (!count)
+        return 0;
+
+    rank = (count * percent + 99) / 100;
+    for (i = 0; i < VA_STATS_NUM_BUCKETS - 1; i++) {
+        seen += histogram[i];
+        if (seen >= rank)
+            break;
+    }
+
+    /* middle of the bucket, clamped to the observed range */
+    value = (va_stats_bucket_base(i) + va_stats_bucket_base(i + 1)) / 2;
+    if (value < min_ns)
+        value = min_ns;
+    if (value > max_ns)
+        value = max_ns;
+    return value;
+}
+
+VAStatus va_StatsGet(
+    VADisplay dpy,
+    VACallStatistics *stats_list,
+    unsigned int *num_stats
+)
+{
+    struct va_stats *stats = DPY2STATS(dpy);
+    struct va_stats_thread *thread;
+    uint64_t histogram[VA_STATS_NUM_BUCKETS];
+    unsigned int call, i;
+
+    if (!stats)
+        return VA_STATUS_ERROR_UNIMPLEMENTED;
+
+    if (!num_stats)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    if (!stats_list) {
+        *num_stats = VA_STATS_NUM_CALLS;
+        return VA_STATUS_SUCCESS;
+    }
+
+    if (*num_stats > VA_STATS_NUM_CALLS)
+        *num_stats = VA_STATS_NUM_CALLS;
+
+    for (call = 0; call < *num_stats; call++) {
+        VACallStatistics *s = &stats_list[call];
+
+        memset(s, 0, sizeof(*s));
+        memset(histogram, 0, sizeof(histogram));
+        s->name = va_stats_call_names[call];
+
+        for (thread = VA_STATS_LOAD_PTR(&stats->threads); thread; thread = thread->next) {
+            struct va_stats_counters *counters = &thread->calls[call];
+            uint64_t count = VA_STATS_LOAD(&counters->count);
+            uint64_t min_ns, max_ns;
+
+            if (!count)
+                continue;
+
+            min_ns = VA_STATS_LOAD(&counters->min_ns);
+            max_ns = VA_STATS_LOAD(&counters->max_ns);
+            if (s->count == 0 || min_ns < s->min_ns)
+                s->min_ns = min_ns;
+            if (max_ns > s->max_ns)
+                s->max_ns = max_ns;
+
+            s->count += count;
+            s->errors += VA_STATS_LOAD(&counters->errors);
+            s->total_ns += VA_STATS_LOAD(&counters->total_ns);
+            for (i = 0; i < VA_STATS_NUM_BUCKETS; i++)
+                histogram[i] += VA_STATS_LOAD(&counters->histogram[i]);
+        }
+
+        /* the histogram may be a few calls ahead of count while a thread records */
+        s->p50_ns = va_stats_percentile(histogram, s->count, 50, s->min_ns, s->max_ns);
+        s->p90_ns = va_stats_percentile(histogram, s->count, 90, s->min_ns, s->max_ns);
+        s->p99_ns = va_stats_percentile(histogram, s->count, 99, s->min_ns, s->max_ns);
+    }
+
+    return VA_STATUS_SUCCESS;
+}
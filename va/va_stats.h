@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2025 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef VA_STATS_H
+#define VA_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int va_stats_flag;
+
+/** \brief entry points measured by the statistics layer
+ * Note: keep in sync with va_stats_call_names in va_stats.c */
+typedef enum {
+    VA_STATS_QUERY_CONFIG_PROFILES = 0,
+    VA_STATS_QUERY_CONFIG_ENTRYPOINTS,
+    VA_STATS_GET_CONFIG_ATTRIBUTES,
+    VA_STATS_CREATE_CONFIG,
+    VA_STATS_DESTROY_CONFIG,
+    VA_STATS_QUERY_SURFACE_ATTRIBUTES,
+    VA_STATS_CREATE_SURFACES,
+    VA_STATS_DESTROY_SURFACES,
+    VA_STATS_CREATE_CONTEXT,
+    VA_STATS_DESTROY_CONTEXT,
+    VA_STATS_CREATE_BUFFER,
+    VA_STATS_CREATE_BUFFER2,
+    VA_STATS_BUFFER_SET_NUM_ELEMENTS,
+    VA_STATS_MAP_BUFFER,
+    VA_STATS_MAP_BUFFER2,
+    VA_STATS_UNMAP_BUFFER,
+    VA_STATS_DESTROY_BUFFER,
+    VA_STATS_ACQUIRE_BUFFER_HANDLE,
+    VA_STATS_RELEASE_BUFFER_HANDLE,
+    VA_STATS_EXPORT_SURFACE_HANDLE,
+    VA_STATS_BEGIN_PICTURE,
+    VA_STATS_RENDER_PICTURE,
+    VA_STATS_END_PICTURE,
+    VA_STATS_SUBMIT_PICTURE,
+    VA_STATS_SYNC_SURFACE,
+    VA_STATS_SYNC_SURFACE2,
+    VA_STATS_QUERY_SURFACE_STATUS,
+    VA_STATS_SYNC_BUFFER,
+    VA_STATS_CREATE_IMAGE,
+    VA_STATS_DESTROY_IMAGE,
+    VA_STATS_GET_IMAGE,
+    VA_STATS_PUT_IMAGE,
+    VA_STATS_DERIVE_IMAGE,
+    VA_STATS_COPY,
+    VA_STATS_NUM_CALLS
+} VAStatsCall;
+
+/** \brief VA_STATS_BEGIN
+ * start measuring a call, must be placed right before the driver call */
+#define VA_STATS_BEGIN(dpy)                                             \
+    uint64_t va_stats_start = va_stats_flag ? va_StatsTimestamp() : 0
+
+/** \brief VA_STATS_END
+ * account the call started by VA_STATS_BEGIN in the current scope */
+#define VA_STATS_END(dpy,call,ret)                                      \
+    if (va_stats_start) {                                               \
+        va_StatsRecord(dpy, call, va_stats_start, ret);                 \
+    }
+
+DLL_HIDDEN
+void va_StatsInit(VADisplay dpy);
+
+DLL_HIDDEN
+void va_StatsEnd(VADisplay dpy);
+
+DLL_HIDDEN
+uint64_t va_StatsTimestamp(void);
+
+DLL_HIDDEN
+void va_StatsRecord(
+    VADisplay dpy,
+    VAStatsCall call,
+    uint64_t start,
+    VAStatus status
+);
+
+DLL_HIDDEN
+VAStatus va_StatsGet(
+    VADisplay dpy,
+    VACallStatistics *stats_list,
+    unsigned int *num_stats
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VA_STATS_H */
@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2025 Intel Corporation. All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL PRECISION INSIGHT AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#define _GNU_SOURCE 1
+#include "sysdeps.h"
+#include "va.h"
+#include "va_backend.h"
+#include "va_internal.h"
+#include "va_sync.h"
+#include <stdlib.h>
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#endif
+
+/*
+ * Fallback of vaGetSurfaceSyncFd/vaGetBufferSyncFd for drivers that
+ * can't hand out a sync_file themselves: a thread per display polls the
+ * requested objects round-robin with the timed sync calls and signals an
+ * eventfd (a pipe outside Linux) for each one that completed. A slow or
+ * never submitted object only costs one bounded wait per round, so it
+ * doesn't hold back the others. The thread is started on first use and
+ * joined in vaTerminate, after at most one wait, requests still queued
+ * then are signalled without waiting.
+ */
+
+#if defined(_WIN32)
+
+void va_SyncEnd(VADisplay dpy)
+{
+}
+
+VAStatus va_SyncGetFd(
+    VADisplay dpy,
+    VASyncObjectType type,
+    VAGenericID id,
+    int *fd
+)
+{
+    return VA_STATUS_ERROR_UNIMPLEMENTED;
+}
+
+#else
+
+/* bounded wait per object, short while others are queued behind it */
+#define VA_SYNC_POLL_TIMEOUT        1000000ull     /* ns */
+#define VA_SYNC_POLL_TIMEOUT_ALONE  10000000ull    /* ns */
+
+struct va_sync_job {
+    struct va_sync_job *next;
+    VASyncObjectType type;
+    VAGenericID id;
+    int fd;         /* signalled end, owned by the job */
+};
+
+struct va_sync {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    VADisplay dpy;
+    int exit;
+    struct va_sync_job *head;
+    struct va_sync_job *tail;
+    unsigned int num_jobs;
+};
+
+#define DPY2SYNC(dpy) ((struct va_sync *)((VADisplayContextP)(dpy))->vasync)
+
+static pthread_mutex_t va_sync_create_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void va_sync_signal(struct va_sync_job *job)
+{
+#if defined(__linux__)
+    uint64_t value = 1;
+#else
+    char value = 1;
+#endif
+
+    while (write(job->fd, &value, sizeof(value)) < 0 && errno == EINTR)
+        ;
+    close(job->fd);
+    free(job);
+}
+
+/* wait up to timeout for the object, returns 0 while it is still busy */
+static int va_sync_poll(VADriverContextP ctx, struct va_sync_job *job, uint64_t timeout)
+{
+    VASurfaceStatus status;
+    VAStatus va_status;
+
+    if (job->type == VA_SYNC_BUFFER)
+        va_status = ctx->vtable->vaSyncBuffer(ctx, job->id, timeout);
+    else if (ctx->vtable->vaSyncSurface2)
+        va_status = ctx->vtable->vaSyncSurface2(ctx, job->id, timeout);
+    else {
+        /* no timed wait in the driver, look at the status and sleep instead */
+        va_status = ctx->vtable->vaQuerySurfaceStatus(ctx, job->id, &status);
+        if (va_status == VA_STATUS_SUCCESS && (status & VASurfaceRendering)) {
+            usleep(timeout / 1000);
+            va_status = VA_STATUS_ERROR_TIMEDOUT;
+        }
+    }
+
+    /* errors end the wait as well, the caller sees them on the next sync */
+    return va_status != VA_STATUS_ERROR_TIMEDOUT;
+}
+
+static void *va_sync_thread(void *arg)
+{
+    struct va_sync *sync = arg;
+    VADriverContextP ctx = CTX(sync->dpy);
+    struct va_sync_job *job;
+    uint64_t timeout;
+
+    pthread_mutex_lock(&sync->lock);
+    for (;;) {
+        while (!sync->head && !sync->exit)
+            pthread_cond_wait(&sync->cond, &sync->lock);
+        if (sync->exit)
+            break;
+
+        job = sync->head;
+        sync->head = job->next;
+        if (!sync->head)
+            sync->tail = NULL;
+        job->next = NULL;
+        timeout = sync->num_jobs > 1 ? VA_SYNC_POLL_TIMEOUT : VA_SYNC_POLL_TIMEOUT_ALONE;
+        pthread_mutex_unlock(&sync->lock);
+
+        if (va_sync_poll(ctx, job, timeout)) {
+            va_sync_signal(job);
+            pthread_mutex_lock(&sync->lock);
+            sync->num_jobs--;
+            continue;
+        }
+
+        /* still busy, try again after the others */
+        pthread_mutex_lock(&sync->lock);
+        if (sync->tail)
+            sync->tail->next = job;
+        else
+            sync->head = job;
+        sync->tail = job;
+    }
+
+    /* wake up whoever still waits, the display is going away */
+    job = sync->head;
+    sync->head = sync->tail = NULL;
+    sync->num_jobs = 0;
+    pthread_mutex_unlock(&sync->lock);
+
+    while (job) {
+        struct va_sync_job *next = job->next;
+        va_sync_signal(job);
+        job = next;
+    }
+    return NULL;
+}
+
+static struct va_sync *va_sync_get(VADisplay dpy)
+{
+    VADisplayContextP pDisplayContext = (VADisplayContextP)dpy;
+    struct va_sync *sync;
+
+    pthread_mutex_lock(&va_sync_create_lock);
+    sync = pDisplayContext->vasync;
+    if (!sync) {
+        sync = calloc(1, sizeof(*sync));
+        if (sync) {
+            pthread_mutex_init(&sync->lock, NULL);
+            pthread_cond_init(&sync->cond, NULL);
+            sync->dpy = dpy;
+            if (pthread_create(&sync->thread, NULL, va_sync_thread, sync) != 0) {
+                pthread_cond_destroy(&sync->cond);
+                pthread_mutex_destroy(&sync->lock);
+                free(sync);
+                sync = NULL;
+            }
+        }
+        pDisplayContext->vasync = sync;
+    }
+    pthread_mutex_unlock(&va_sync_create_lock);
+
+    return sync;
+}
+
+/* create the descriptor pair: one end for the caller, one for the thread */
+static int va_sync_create_fds(int *user_fd, int *signal_fd)
+{
+#if defined(__linux__)
+    *user_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (*user_fd < 0)
+        return -1;
+    *signal_fd = fcntl(*user_fd, F_DUPFD_CLOEXEC, 0);
+    if (*signal_fd < 0) {
+        close(*user_fd);
+        return -1;
+    }
+#else
+    int fds[2];
+
+    if (pipe(fds) < 0)
+        return -1;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    *user_fd = fds[0];
+    *signal_fd = fds[1];
+#endif
+    return 0;
+}
+
+void va_SyncEnd(VADisplay dpy)
+{
+    VADisplayContextP pDisplayContext = (VADisplayContextP)dpy;
+    struct va_sync *sync = DPY2SYNC(dpy);
+
+    if (!sync)
+        return;
+
+    pthread_mutex_lock(&sync->lock);
+    sync->exit = 1;
+    pthread_cond_signal(&sync->cond);
+    pthread_mutex_unlock(&sync->lock);
+    pthread_join(sync->thread, NULL);
+
+    pthread_cond_destroy(&sync->cond);
+    pthread_mutex_destroy(&sync->lock);
+    free(sync);
+    pDisplayContext->vasync = NULL;
+}
+
+VAStatus va_SyncGetFd(
+    VADisplay dpy,
+    VASyncObjectType type,
+    VAGenericID id,
+    int *fd
+)
+{
+    VADriverContextP ctx = CTX(dpy);
+    struct va_sync *sync;
+    struct va_sync_job *job;
+    int user_fd;
+
+    /* catch invalid surfaces now, not once the thread gets to them */
+    if (type == VA_SYNC_SURFACE) {
+        VASurfaceStatus status;
+        VAStatus va_status = ctx->vtable->vaQuerySurfaceStatus(ctx, id, &status);
+
+        if (va_status != VA_STATUS_SUCCESS)
+            return va_status;
+    }
+
+    sync = va_sync_get(dpy);
+    if (!sync)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    job = calloc(1, sizeof(*job));
+    if (!job)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    job->type = type;
+    job->id = id;
+    if (va_sync_create_fds(&user_fd, &job->fd) < 0) {
+        free(job);
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+    }
+
+    pthread_mutex_lock(&sync->lock);
+    if (sync->tail)
+        sync->tail->next = job;
+    else
+        sync->head = job;
+    sync->tail = job;
+    sync->num_jobs++;
+    pthread_cond_signal(&sync->cond);
+    pthread_mutex_unlock(&sync->lock);
+
+    *fd = user_fd;
+    return VA_STATUS_SUCCESS;
+}
+
+#endif /* _WIN32 */
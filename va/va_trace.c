@@ -45,6 +45,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
+#include <time.h>
 #include <fcntl.h>
 #include "va_drmcommon.h"
 #if defined(_WIN32)
@@ -57,11 +59,14 @@
 #include <sys/stat.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <errno.h>
 #endif
 
 #if defined(__linux__)
 #include <sys/syscall.h>
+#include <sys/inotify.h>
+#include <poll.h>
 #elif defined(__DragonFly__) || defined(__FreeBSD__)
 #include <pthread_np.h>
 #elif defined(__NetBSD__)
@@ -91,17 +96,102 @@ static pid_t va_gettid()
 #endif
 }
 
+#if defined(_MSC_VER)
+#define VA_TRACE_TLS __declspec(thread)
+#define VA_TRACE_LOAD(ptr)          (*(volatile unsigned int *)(ptr))
+#define VA_TRACE_STORE(ptr, val)    (*(volatile unsigned int *)(ptr) = (val))
+#define VA_TRACE_FENCE()            MemoryBarrier()
+#define VA_TRACE_LOAD_PTR(ptr)      (*(void * volatile *)(ptr))
+#define VA_TRACE_STORE_PTR(ptr, val) (*(void * volatile *)(ptr) = (val))
+#define VA_TRACE_FETCH_ADD(ptr, val) InterlockedExchangeAdd((volatile LONG *)(ptr), val)
+#else
+#define VA_TRACE_TLS __thread
+#define VA_TRACE_LOAD(ptr)          __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#define VA_TRACE_STORE(ptr, val)    __atomic_store_n(ptr, val, __ATOMIC_RELAXED)
+#define VA_TRACE_FENCE()            __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define VA_TRACE_LOAD_PTR(ptr)      __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define VA_TRACE_STORE_PTR(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#define VA_TRACE_FETCH_ADD(ptr, val) __atomic_fetch_add(ptr, val, __ATOMIC_RELAXED)
+#endif
+
+/* per-thread cache of the thread id and of the thread's log file slot,
+ * so the trace hooks neither make a syscall nor scan the slots under a lock */
+static VA_TRACE_TLS pid_t va_trace_tid;
+static VA_TRACE_TLS struct {
+    struct va_trace *pva_trace;
+    int idx;
+} va_trace_log_binding;
+
+static pid_t va_trace_thread_id(void)
+{
+    if (!va_trace_tid)
+        va_trace_tid = va_gettid();
+
+    return va_trace_tid;
+}
+
+#if !defined(_WIN32)
+static pthread_once_t va_trace_atfork_once = PTHREAD_ONCE_INIT;
+
+/* the forking thread lives on in the child with another id */
+static void va_trace_atfork_child(void)
+{
+    va_trace_tid = 0;
+    va_trace_log_binding.pva_trace = NULL;
+}
+
+static void va_trace_register_atfork(void)
+{
+    pthread_atfork(NULL, NULL, va_trace_atfork_child);
+}
+#endif
+
 /*
  * Env. to debug some issue, e.g. the decode/encode issue in a video conference scenerio:
  * .LIBVA_TRACE=log_file: general VA parameters saved into log_file
  * .LIBVA_TRACE=FTRACE: trace general VA parameters into linux ftrace framework, use trace-cmd to capture and parse by tracetool in libva-utils
+ * .LIBVA_TRACE_FORMAT=binary: save raw records into log_file instead of text, the per-frame calls
+ *                              and their buffers are only formatted by va_trace_decode, which
+ *                              renders the records as the text log
+ * .LIBVA_TRACE_ASYNC=block|drop: hand log, codedbuf and surface writes to a background thread,
+ *                                when its queue is full either wait or drop the log record
  * .LIBVA_TRACE_BUFDATA: dump all VA data buffer into log_file
  *                       when LIBVA_TRACE in FTRACE mode, all data are redirected to linux ftrace, finally parsed by tracetool
- * .LIBVA_TRACE_CODEDBUF=coded_clip_file: save the coded clip into file coded_clip_file
+ * .LIBVA_TRACE_CODEDBUF=coded_clip_file: save the coded clip into file coded_clip_file, in IVF for
+ *                                VP8, VP9 and AV1 and as an Annex-B stream for H.264, HEVC and VVC
+ * .LIBVA_TRACE_CODEDBUF_FORMAT=raw|ivf|annexb|length: override the coded clip container, length
+ *                                replaces the H.264/HEVC/VVC start codes by 4-byte big-endian
+ *                                NAL unit lengths, raw saves the segments as they are
  * .LIBVA_TRACE_SURFACE=yuv_file: save surface YUV into file yuv_file. Use file name to determine
  *                                decode/encode or jpeg surfaces
  * .LIBVA_TRACE_SURFACE_GEOMETRY=WIDTHxHEIGHT+XOFF+YOFF: only save part of surface context into file
  *                                due to storage bandwidth limitation
+ * .LIBVA_TRACE_SURFACE_CRC: write one line per frame with the CRC32C of each plane into the
+ *                           LIBVA_TRACE_SURFACE file instead of the YUV data
+ * .LIBVA_TRACE_SURFACE_QUEUE=N: surface frames waiting for the writer thread, 4 by default, the
+ *                                rendering thread waits while the queue is full unless this or
+ *                                LIBVA_TRACE_ASYNC=drop is set, then frames are skipped
+ * .LIBVA_TRACE_SAMPLE=N, FIRST-LAST or FIRST-LAST:N: only trace every Nth frame and/or the frames
+ *                                FIRST to LAST of each context, counted from 0 as frame_count
+ * .LIBVA_TRACE_CONTEXTS=ID,ID,...: only trace the listed contexts
+ * .LIBVA_TRACE_FILTER=CATEGORY,CATEGORY,...: only log the calls of the listed categories, out of
+ *                                context, surfaces, buffers, render, sync, display, protected
+ *                                and status (the return value of every call)
+ * .LIBVA_TRACE_MAX_SIZE=SIZE[k|m|g]: rotate a log file once SIZE bytes were written into it, the
+ *                                rotated segments are named log_file.1, log_file.2, ...
+ * .LIBVA_TRACE_ROTATE=SECONDS: rotate a log file every SECONDS
+ * .LIBVA_TRACE_ROTATE_KEEP=N: only keep the last N rotated segments of each log file, binary
+ *                             segments are cut between records and each starts with a header
+ * .LIBVA_TRACE_COMPRESS: gzip the log files while writing them, needs libz.so.1 at runtime,
+ *                        binary logs are decoded from the concatenated, decompressed segments
+ * .LIBVA_TRACE_JSON=json_file: save the call events as Chrome trace events, for chrome://tracing
+ *                                or ui.perfetto.dev, with a track per thread, a track per context
+ *                                holding its pictures, grouped under a synthetic process, and
+ *                                flow arrows from vaEndPicture to the vaSyncSurface of the
+ *                                render target, alone or with LIBVA_TRACE
+ * .LIBVA_TRACE_CONTROL=control_file: start paused and trace while control_file holds "on", the
+ *                                file is watched and can also change the filter and sampling
+ *                                at runtime, see trace_control_apply
  */
 
 /* global settings */
@@ -109,24 +199,50 @@ static pid_t va_gettid()
 /* LIBVA_TRACE */
 int va_trace_flag = 0;
 
-#define MAX_TRACE_CTX_NUM   64
-#define TRACE_CTX_ID_MASK      (MAX_TRACE_CTX_NUM - 1)
-
-#define MAX_TRACE_THREAD_NUM   64
+/* LIBVA_TRACE_FILTER */
+#define TRACE_CAT_CONTEXT       0x01
+#define TRACE_CAT_SURFACES      0x02
+#define TRACE_CAT_BUFFERS       0x04
+#define TRACE_CAT_RENDER        0x08
+#define TRACE_CAT_SYNC          0x10
+#define TRACE_CAT_DISPLAY       0x20
+#define TRACE_CAT_PROTECTED     0x40
+#define TRACE_CAT_STATUS        0x80
+#define TRACE_CAT_ALL           0xff
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+static const struct {
+    const char *name;
+    unsigned int category;
+} va_trace_categories[] = {
+    { "context", TRACE_CAT_CONTEXT },
+    { "surfaces", TRACE_CAT_SURFACES },
+    { "buffers", TRACE_CAT_BUFFERS },
+    { "render", TRACE_CAT_RENDER },
+    { "sync", TRACE_CAT_SYNC },
+    { "display", TRACE_CAT_DISPLAY },
+    { "protected", TRACE_CAT_PROTECTED },
+    { "status", TRACE_CAT_STATUS },
+    { "all", TRACE_CAT_ALL },
+};
 
-#define MAX_TRACE_BUF_INFO_HASH_SIZE     1024 // 1<<10
-#define MAX_TRACE_BUF_INFO_HASH_LEVEL    3
-#define TRACE_BUF_INFO_HASH_ID_MASK         (MAX_TRACE_BUF_INFO_HASH_SIZE - 1)
+static unsigned int va_trace_filter = TRACE_CAT_ALL;
 
-struct trace_buf_info {
-    int valid;
+/* LIBVA_TRACE_SAMPLE */
+static unsigned int va_trace_sample_first = 0;
+static unsigned int va_trace_sample_last = UINT_MAX;
+static unsigned int va_trace_sample_every = 1;
 
-    VABufferID buf_id;
-    VAContextID ctx_id;
-};
+/* pointer array indexed without locks. It is grown under resource_mutex
+ * into a bigger copy, and an outgrown copy is kept until the array itself
+ * is freed since a reader may still be indexing it */
+#define TRACE_PTR_TABLE_MIN_SIZE    16
 
-struct trace_buf_manager {
-    struct trace_buf_info *pbuf_info[MAX_TRACE_BUF_INFO_HASH_LEVEL];
+struct trace_ptr_table {
+    struct trace_ptr_table *retired;
+    int size;
+    void *ptr[];
 };
 
 struct trace_log_file {
@@ -138,13 +254,13 @@ struct trace_log_file {
 };
 
 struct trace_log_files_manager {
-    struct trace_log_file log_file[MAX_TRACE_THREAD_NUM];
+    struct trace_ptr_table *log_file; /* struct trace_log_file */
 };
 
 /* per context settings */
 struct trace_context {
     struct trace_log_file *plog_file;
-    struct trace_log_file *plog_file_list[MAX_TRACE_THREAD_NUM];
+    struct trace_ptr_table *plog_file_list; /* log files of the threads */
 
     /* LIBVA_TRACE_CODEDBUF */
     FILE *trace_fp_codedbuf; /* save the encode result into a file */
@@ -174,6 +290,12 @@ struct trace_context {
 
     unsigned int pts; /* IVF header information */
 
+    uint64_t trace_replay_ts; /* record timestamp while decoding a binary log */
+
+    int trace_frame_skip; /* LIBVA_TRACE_SAMPLE leaves the current frame out */
+
+    struct trace_writer *writer; /* LIBVA_TRACE_ASYNC writer thread */
+
     pid_t created_thd_id;
 };
 
@@ -187,20 +309,60 @@ struct trace_config_info {
     pid_t created_thd_id;
 };
 
+/* VA id to value map, open addressing with linear probing. Updated under
+ * resource_mutex, looked up without any lock: a reader retries when the
+ * sequence count shows that an update raced with it. The table doubles
+ * when it gets half full, and an outgrown table is kept until va_TraceEnd
+ * since a reader may still be probing it */
+#define TRACE_ID_NONE           0xffffffff
+#define TRACE_ID_MAP_MIN_BITS   6
+
+struct trace_id_table {
+    struct trace_id_table *retired;
+    unsigned int bits;
+    unsigned int count;
+    struct {
+        unsigned int id;
+        unsigned int value; /* value + 1, 0 when the entry is unused */
+    } entries[];
+};
+
+struct trace_id_map {
+    unsigned int seq;
+    struct trace_id_table *table;
+};
+
 struct va_trace {
-    struct trace_context *ptra_ctx[MAX_TRACE_CTX_NUM + 1];
+    struct trace_ptr_table *ptra_ctx; /* struct trace_context */
+    struct trace_context *ptra_vir_ctx; /* calls without a context */
     int context_num;
-    struct trace_buf_manager buf_manager;
+    struct trace_id_map context_map;
+    struct trace_id_map buf_map;
     struct trace_log_files_manager log_files_manager;
-    struct trace_config_info config_info[MAX_TRACE_CTX_NUM];
+    struct trace_ptr_table *config_info; /* struct trace_config_info */
+    struct trace_id_map config_map;
 
     char *fn_log_env;
     char *fn_codedbuf_env;
     char *fn_surface_env;
+    VAContextID *trace_contexts; /* LIBVA_TRACE_CONTEXTS */
+    int trace_contexts_num;
     pthread_mutex_t resource_mutex;
     pthread_mutex_t context_mutex;
     VADisplay dpy;
     int ftrace_fd;
+    struct trace_writer *writer;
+    struct trace_control *control; /* LIBVA_TRACE_CONTROL */
+
+    unsigned long long trace_max_size; /* LIBVA_TRACE_MAX_SIZE */
+    unsigned int trace_rotate_period; /* LIBVA_TRACE_ROTATE */
+    unsigned int trace_rotate_keep; /* LIBVA_TRACE_ROTATE_KEEP */
+    int trace_binary; /* LIBVA_TRACE_FORMAT=binary */
+    int trace_async; /* LIBVA_TRACE_ASYNC, log and codedbuf writes go through writer */
+    int trace_compress; /* LIBVA_TRACE_COMPRESS */
+    int surface_crc; /* LIBVA_TRACE_SURFACE_CRC */
+    int codedbuf_format; /* LIBVA_TRACE_CODEDBUF_FORMAT */
+    struct trace_json *json; /* LIBVA_TRACE_JSON */
 };
 
 #define LOCK_RESOURCE(pva_trace)                                    \
@@ -235,14 +397,12 @@ struct va_trace {
             return;                                                         \
     }                                                                       \
                                                                             \
-    if (ctx_id != VA_INVALID_ID) {                                          \
-        int temp_idx = get_valid_ctx_idx(pva_trace, ctx_id);                \
-        if(temp_idx < MAX_TRACE_CTX_NUM)                                    \
-            trace_ctx = pva_trace->ptra_ctx[temp_idx];                      \
-    }                                                                       \
+    if (ctx_id != VA_INVALID_ID)                                            \
+        trace_ctx = trace_ptr_table_get(&pva_trace->ptra_ctx,               \
+                                        get_valid_ctx_idx(pva_trace, ctx_id)); \
                                                                             \
     if(!trace_ctx                                                           \
-        || trace_ctx->trace_context != context) {                           \
+        || trace_ctx->trace_context != ctx_id) {                            \
         return;                                                             \
     }                                                                       \
     refresh_log_file(pva_trace, trace_ctx)
@@ -256,7 +416,7 @@ struct va_trace {
         return;                                                             \
                                                                             \
     LOCK_CONTEXT(pva_trace);                                                \
-    trace_ctx = pva_trace->ptra_ctx[MAX_TRACE_CTX_NUM];                     \
+    trace_ctx = pva_trace->ptra_vir_ctx;                                    \
     if(!trace_ctx) {                                                        \
         UNLOCK_CONTEXT(pva_trace);                                          \
         return;                                                             \
@@ -266,6 +426,14 @@ struct va_trace {
 #define DPY2TRACE_VIRCTX_EXIT(pva_trace)                                \
     UNLOCK_CONTEXT(pva_trace)
 
+/* LIBVA_TRACE_FILTER, leave the hook before any lookup or formatting */
+#define TRACE_CATEGORY_ON(category)                                         \
+    (VA_TRACE_LOAD(&va_trace_filter) & (category))
+
+#define TRACE_FILTER(category)                                              \
+    if (!TRACE_CATEGORY_ON(category))                                       \
+        return
+
 #define TRACE_FUNCNAME(idx)    va_TraceMsg(trace_ctx, "==========%s\n", __func__);
 
 #define TRACE_NEWLINE() do { \
@@ -288,490 +456,2294 @@ VAStatus vaBufferInfo(
     unsigned int *num_elements  /* out */
 );
 
-VAStatus vaLockSurface(VADisplay dpy,
-                       VASurfaceID surface,
-                       unsigned int *fourcc, /* following are output argument */
-                       unsigned int *luma_stride,
-                       unsigned int *chroma_u_stride,
-                       unsigned int *chroma_v_stride,
-                       unsigned int *luma_offset,
-                       unsigned int *chroma_u_offset,
-                       unsigned int *chroma_v_offset,
-                       unsigned int *buffer_name,
-                       void **buffer
-                      );
-
-VAStatus vaUnlockSurface(VADisplay dpy,
-                         VASurfaceID surface
-                        );
+/* LIBVA_TRACE_ASYNC: bounded ring of pending writes, drained by one thread */
+#define TRACE_WRITER_RING_SIZE      4096
+#define TRACE_WRITER_RING_MASK      (TRACE_WRITER_RING_SIZE - 1)
+/* trace files written since the last flush, the writer flushes only those */
+#define TRACE_WRITER_DIRTY_FILES    8
+
+/* LIBVA_TRACE_CODEDBUF_FORMAT */
+#define TRACE_CODEDBUF_AUTO         0
+#define TRACE_CODEDBUF_RAW          1
+#define TRACE_CODEDBUF_IVF          2
+#define TRACE_CODEDBUF_ANNEXB       3
+#define TRACE_CODEDBUF_LENGTH       4
+
+/* segments of a coded frame written without allocating the iovec array */
+#define TRACE_CODEDBUF_IOV          16
+
+/* LIBVA_TRACE_SURFACE: surface frames queued before the rendering thread
+ * waits, or skips new ones on request */
+#define TRACE_WRITER_MAX_FRAMES     4
+
+struct trace_chunk {
+    FILE *fp;
+    size_t size;
+    int frame; /* surface frame, holds a slot from trace_writer_reserve_frame */
+    unsigned char data[];
+};
 
-static int get_valid_config_idx(
-    struct va_trace *pva_trace,
-    VAConfigID config_id)
+static struct trace_chunk *trace_chunk_new(FILE *fp, size_t size)
 {
-    int idx = MAX_TRACE_CTX_NUM;
-
-    LOCK_RESOURCE(pva_trace);
+    struct trace_chunk *chunk = malloc(sizeof(struct trace_chunk) + size);
 
-    for (idx = 0; idx < MAX_TRACE_CTX_NUM; idx++) {
-        if (pva_trace->config_info[idx].valid &&
-            pva_trace->config_info[idx].config_id == config_id)
-            break;
+    if (chunk) {
+        chunk->fp = fp;
+        chunk->size = size;
+        chunk->frame = 0;
     }
 
-    UNLOCK_RESOURCE(pva_trace);
-
-    return idx;
+    return chunk;
 }
 
-static void add_trace_config_info(
-    struct va_trace *pva_trace,
-    VAConfigID config_id,
-    VAProfile profile,
-    VAEntrypoint entrypoint)
+#if defined(_WIN32)
+static struct trace_writer *trace_writer_create(int block, unsigned int max_frames, int skip_frames)
 {
-    struct trace_config_info *pconfig_info;
-    int idx = 0;
-    pid_t thd_id = va_gettid();
+    return NULL;
+}
 
-    LOCK_RESOURCE(pva_trace);
+static int trace_writer_reserve_frame(struct trace_writer *writer)
+{
+    return 0;
+}
 
-    for (idx = 0; idx < MAX_TRACE_CTX_NUM; idx++) {
-        if (!pva_trace->config_info[idx].valid ||
-            pva_trace->config_info[idx].config_id == config_id)
-            break;
-    }
+static void trace_writer_release_frame(struct trace_writer *writer)
+{
+}
 
-    if (idx < MAX_TRACE_CTX_NUM) {
-        pconfig_info = &pva_trace->config_info[idx];
+static void trace_writer_push(struct trace_writer *writer, struct trace_chunk *chunk, int may_drop)
+{
+    fwrite(chunk->data, chunk->size, 1, chunk->fp);
+    free(chunk);
+}
 
-        pconfig_info->valid = 1;
-        pconfig_info->config_id = config_id;
-        pconfig_info->trace_profile = profile;
-        pconfig_info->trace_entrypoint = entrypoint;
-        pconfig_info->created_thd_id = thd_id;
-    }
+static void trace_writer_sync(struct trace_writer *writer)
+{
+}
 
-    UNLOCK_RESOURCE(pva_trace);
+static unsigned long trace_writer_destroy(struct trace_writer *writer, unsigned long *skipped)
+{
+    *skipped = 0;
+    return 0;
 }
+#else
+struct trace_ring_slot {
+    size_t seq;
+    struct trace_chunk *chunk;
+};
 
-static void delete_trace_config_info(
-    struct va_trace *pva_trace,
-    VAConfigID config_id)
+struct trace_writer {
+    struct trace_ring_slot slots[TRACE_WRITER_RING_SIZE];
+    size_t enqueue_pos; /* claimed by producers with CAS */
+    size_t dequeue_pos; /* writer thread only */
+    size_t written_pos; /* chunks written so far, for producers waiting for room */
+    size_t flushed_pos; /* chunks flushed to their files, for trace_writer_sync */
+    int syncs; /* trace_writer_sync callers */
+    FILE *dirty[TRACE_WRITER_DIRTY_FILES]; /* writer thread only */
+    unsigned int num_dirty;
+
+    int block; /* wait for room instead of dropping log records */
+    int stop;
+    int idle; /* writer thread sleeps on cond */
+    int waiters; /* producers sleeping on cond */
+    unsigned long dropped;
+
+    unsigned int frames; /* surface frames queued */
+    unsigned int max_frames;
+    int skip_frames; /* skip surface frames instead of waiting for room */
+    unsigned long skipped; /* surface frames not dumped */
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+/* multi-producer push, fails when the ring is full */
+static int trace_ring_push(struct trace_writer *writer, struct trace_chunk *chunk)
 {
-    struct trace_config_info *pconfig_info;
-    int idx = 0;
+    struct trace_ring_slot *slot;
+    size_t pos = __atomic_load_n(&writer->enqueue_pos, __ATOMIC_RELAXED);
+    size_t seq;
 
-    LOCK_RESOURCE(pva_trace);
+    for (;;) {
+        slot = &writer->slots[pos & TRACE_WRITER_RING_MASK];
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
 
-    for (idx = 0; idx < MAX_TRACE_CTX_NUM; idx++) {
-        if (pva_trace->config_info[idx].valid &&
-            pva_trace->config_info[idx].config_id == config_id)
-            break;
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(&writer->enqueue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if ((intptr_t)(seq - pos) < 0)
+            return -1;
+        else
+            pos = __atomic_load_n(&writer->enqueue_pos, __ATOMIC_RELAXED);
     }
 
-    if (idx < MAX_TRACE_CTX_NUM) {
-        pconfig_info = &pva_trace->config_info[idx];
+    slot->chunk = chunk;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
 
-        pconfig_info->valid = 0;
-        pconfig_info->config_id = -1;
-    }
+    return 0;
+}
 
-    UNLOCK_RESOURCE(pva_trace);
+static int trace_ring_empty(struct trace_writer *writer)
+{
+    size_t pos = writer->dequeue_pos;
+
+    return __atomic_load_n(&writer->slots[pos & TRACE_WRITER_RING_MASK].seq,
+                           __ATOMIC_ACQUIRE) != pos + 1;
 }
 
-static VAContextID get_ctx_by_buf(
-    struct va_trace *pva_trace,
-    VABufferID buf_id)
+/* single-consumer pop, NULL when the ring is empty */
+static struct trace_chunk *trace_ring_pop(struct trace_writer *writer)
 {
-    struct trace_buf_manager *pbuf_mgr = &pva_trace->buf_manager;
-    struct trace_buf_info *pbuf_info = pbuf_mgr->pbuf_info[0];
-    VAContextID context = VA_INVALID_ID;
-    int i = 0, idx = 0;
+    struct trace_ring_slot *slot;
+    struct trace_chunk *chunk;
+    size_t pos = writer->dequeue_pos;
 
-    LOCK_RESOURCE(pva_trace);
+    if (trace_ring_empty(writer))
+        return NULL;
 
-    idx = buf_id & TRACE_BUF_INFO_HASH_ID_MASK;
-    for (i = 0; i < MAX_TRACE_BUF_INFO_HASH_LEVEL; i++) {
-        pbuf_info = pbuf_mgr->pbuf_info[i];
-        if (!pbuf_info)
-            break;
+    slot = &writer->slots[pos & TRACE_WRITER_RING_MASK];
 
-        if (pbuf_info[idx].valid
-            && pbuf_info[idx].buf_id == buf_id) {
-            context = pbuf_info[idx].ctx_id;
-            break;
-        }
-    }
+    chunk = slot->chunk;
+    __atomic_store_n(&slot->seq, pos + TRACE_WRITER_RING_SIZE, __ATOMIC_RELEASE);
+    writer->dequeue_pos = pos + 1;
 
-    UNLOCK_RESOURCE(pva_trace);
+    return chunk;
+}
 
-    return context;
+static void trace_writer_wake(struct trace_writer *writer, int *sleepers)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(sleepers, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&writer->mutex);
+        pthread_cond_broadcast(&writer->cond);
+        pthread_mutex_unlock(&writer->mutex);
+    }
 }
 
-static void add_trace_buf_info(
-    struct va_trace *pva_trace,
-    VAContextID context,
-    VABufferID buf_id)
+/* claim room for one surface frame, waits while the writer is behind, or
+ * fails with skip_frames so the frame is skipped before the surface is even
+ * read back */
+static int trace_writer_reserve_frame(struct trace_writer *writer)
 {
-    struct trace_buf_manager *pbuf_mgr = &pva_trace->buf_manager;
-    struct trace_buf_info *pbuf_info = NULL;
-    int i = 0, idx = 0;
+    while (__atomic_add_fetch(&writer->frames, 1, __ATOMIC_RELAXED) > writer->max_frames) {
+        __atomic_sub_fetch(&writer->frames, 1, __ATOMIC_RELAXED);
+        if (writer->skip_frames) {
+            __atomic_add_fetch(&writer->skipped, 1, __ATOMIC_RELAXED);
+            return -1;
+        }
 
-    LOCK_RESOURCE(pva_trace);
+        /* the writer thread wakes the waiters after each chunk */
+        pthread_mutex_lock(&writer->mutex);
+        __atomic_add_fetch(&writer->waiters, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&writer->frames, __ATOMIC_RELAXED) >= writer->max_frames)
+            pthread_cond_wait(&writer->cond, &writer->mutex);
+        __atomic_sub_fetch(&writer->waiters, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&writer->mutex);
+    }
 
-    idx = buf_id & TRACE_BUF_INFO_HASH_ID_MASK;
-    for (i = 0; i < MAX_TRACE_BUF_INFO_HASH_LEVEL; i++) {
-        pbuf_info = pbuf_mgr->pbuf_info[i];
-        if (!pbuf_info) {
-            pbuf_info = (struct trace_buf_info *)calloc(
-                            sizeof(struct trace_buf_info) * MAX_TRACE_BUF_INFO_HASH_SIZE,
-                            1);
-            if (!pbuf_info)
-                break;
+    return 0;
+}
 
-            pbuf_mgr->pbuf_info[i] = pbuf_info;
-        }
+static void trace_writer_release_frame(struct trace_writer *writer)
+{
+    __atomic_sub_fetch(&writer->frames, 1, __ATOMIC_RELAXED);
+}
 
-        if (pbuf_info[idx].valid
-            && pbuf_info[idx].buf_id != buf_id)
-            continue;
+/* flush the trace files written so far, never the streams of the application */
+static void trace_writer_flush(struct trace_writer *writer)
+{
+    unsigned int i;
 
-        pbuf_info[idx].buf_id = buf_id;
-        pbuf_info[idx].ctx_id = context;
-        pbuf_info[idx].valid = 1;
-        break;
-    }
+    for (i = 0; i < writer->num_dirty; i++)
+        fflush(writer->dirty[i]);
+    writer->num_dirty = 0;
+}
 
-    if (i >= MAX_TRACE_BUF_INFO_HASH_LEVEL)
-        va_errorMessage(pva_trace->dpy, "Add buf info failed\n");
+static void trace_writer_mark_dirty(struct trace_writer *writer, FILE *fp)
+{
+    unsigned int i;
 
-    UNLOCK_RESOURCE(pva_trace);
+    for (i = 0; i < writer->num_dirty; i++) {
+        if (writer->dirty[i] == fp)
+            return;
+    }
+
+    if (writer->num_dirty == TRACE_WRITER_DIRTY_FILES)
+        trace_writer_flush(writer);
+    writer->dirty[writer->num_dirty++] = fp;
 }
 
-static void delete_trace_buf_info(
-    struct va_trace *pva_trace,
-    VABufferID buf_id)
+static void *trace_writer_thread(void *arg)
 {
-    struct trace_buf_manager *pbuf_mgr = &pva_trace->buf_manager;
-    struct trace_buf_info *pbuf_info = NULL;
-    int i = 0, idx = 0;
+    struct trace_writer *writer = arg;
+    struct trace_chunk *chunk;
+    int stop;
 
-    LOCK_RESOURCE(pva_trace);
+    for (;;) {
+        chunk = trace_ring_pop(writer);
+        if (chunk) {
+            /* a surface frame is one whole-plane write, no flush per row */
+            fwrite(chunk->data, chunk->size, 1, chunk->fp);
+            trace_writer_mark_dirty(writer, chunk->fp);
+            if (chunk->frame)
+                trace_writer_release_frame(writer);
+            free(chunk);
 
-    idx = buf_id & TRACE_BUF_INFO_HASH_ID_MASK;
-    for (i = 0; i < MAX_TRACE_BUF_INFO_HASH_LEVEL; i++) {
-        pbuf_info = pbuf_mgr->pbuf_info[i];
-        if (!pbuf_info)
-            break;
+            __atomic_store_n(&writer->written_pos, writer->dequeue_pos, __ATOMIC_RELEASE);
+            /* a file is about to be closed, don't keep it in the dirty set */
+            if (__atomic_load_n(&writer->syncs, __ATOMIC_ACQUIRE)) {
+                trace_writer_flush(writer);
+                __atomic_store_n(&writer->flushed_pos, writer->dequeue_pos, __ATOMIC_RELEASE);
+            }
+            trace_writer_wake(writer, &writer->waiters);
+            continue;
+        }
 
-        if (pbuf_info[idx].valid
-            && pbuf_info[idx].buf_id == buf_id) {
-            pbuf_info[idx].valid = 0;
+        /* ring drained, push the data out of the stdio buffers */
+        trace_writer_flush(writer);
+        __atomic_store_n(&writer->flushed_pos, writer->dequeue_pos, __ATOMIC_RELEASE);
+        trace_writer_wake(writer, &writer->waiters);
+
+        pthread_mutex_lock(&writer->mutex);
+        __atomic_store_n(&writer->idle, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        while (trace_ring_empty(writer) && !writer->stop)
+            pthread_cond_wait(&writer->cond, &writer->mutex);
+        __atomic_store_n(&writer->idle, 0, __ATOMIC_RELAXED);
+        stop = writer->stop;
+        pthread_mutex_unlock(&writer->mutex);
+
+        if (stop && trace_ring_empty(writer))
             break;
-        }
     }
 
-    UNLOCK_RESOURCE(pva_trace);
+    return NULL;
 }
 
-/*
-static void delete_trace_all_context_buf(
-    struct va_trace *pva_trace,
-    VAContextID context)
+static struct trace_writer *trace_writer_create(int block, unsigned int max_frames, int skip_frames)
 {
-    struct trace_buf_manager *pbuf_mgr = &pva_trace->buf_manager;
-    struct trace_buf_info *pbuf_info = NULL;
-    int i = 0, j = 0;
+    struct trace_writer *writer = calloc(sizeof(struct trace_writer), 1);
+    size_t i;
 
-    LOCK_RESOURCE(pva_trace);
+    if (!writer)
+        return NULL;
 
-    for(i = 0;i < MAX_TRACE_BUF_INFO_HASH_LEVEL;i++) {
-        pbuf_info = pbuf_mgr->pbuf_info[i];
-        if(!pbuf_info)
-            break;
+    for (i = 0; i < TRACE_WRITER_RING_SIZE; i++)
+        writer->slots[i].seq = i;
+    writer->block = block;
+    writer->max_frames = max_frames;
+    writer->skip_frames = skip_frames;
 
-        for(j = 0;j < MAX_TRACE_BUF_INFO_HASH_SIZE;j++)
-            if(pbuf_info[j].valid
-                && pbuf_info[j].ctx_id == context)
-                pbuf_info[j].valid = 0;
+    pthread_mutex_init(&writer->mutex, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+
+    if (pthread_create(&writer->thread, NULL, trace_writer_thread, writer) != 0) {
+        pthread_cond_destroy(&writer->cond);
+        pthread_mutex_destroy(&writer->mutex);
+        free(writer);
+
+        return NULL;
     }
 
-    UNLOCK_RESOURCE(pva_trace);
+    return writer;
 }
-*/
 
-static int get_free_ctx_idx(
-    struct va_trace *pva_trace,
-    VAContextID context)
+/* hand chunk over to the writer thread, log records may be dropped when the
+ * ring is full, surface and codedbuf data always wait as a gap corrupts them */
+static void trace_writer_push(struct trace_writer *writer, struct trace_chunk *chunk, int may_drop)
 {
-    int idx;
+    while (trace_ring_push(writer, chunk) < 0) {
+        if (may_drop && !writer->block) {
+            __atomic_add_fetch(&writer->dropped, 1, __ATOMIC_RELAXED);
+            free(chunk);
+            return;
+        }
 
-    LOCK_RESOURCE(pva_trace);
+        pthread_mutex_lock(&writer->mutex);
+        __atomic_add_fetch(&writer->waiters, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&writer->written_pos, __ATOMIC_RELAXED) + TRACE_WRITER_RING_SIZE <=
+            __atomic_load_n(&writer->enqueue_pos, __ATOMIC_RELAXED))
+            pthread_cond_wait(&writer->cond, &writer->mutex);
+        __atomic_sub_fetch(&writer->waiters, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&writer->mutex);
+    }
 
-    for (idx = 0; idx < MAX_TRACE_CTX_NUM; idx++)
-        if (!pva_trace->ptra_ctx[idx] ||
-            pva_trace->ptra_ctx[idx]->trace_context == context)
-            break;
+    trace_writer_wake(writer, &writer->idle);
+}
 
-    UNLOCK_RESOURCE(pva_trace);
+/* wait until everything pushed so far was flushed to its file and left the
+ * dirty set, before fclose() */
+static void trace_writer_sync(struct trace_writer *writer)
+{
+    size_t target = __atomic_load_n(&writer->enqueue_pos, __ATOMIC_ACQUIRE);
 
-    return idx;
+    __atomic_add_fetch(&writer->syncs, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&writer->mutex);
+    __atomic_add_fetch(&writer->waiters, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while ((intptr_t)(__atomic_load_n(&writer->flushed_pos, __ATOMIC_ACQUIRE) - target) < 0)
+        pthread_cond_wait(&writer->cond, &writer->mutex);
+    __atomic_sub_fetch(&writer->waiters, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&writer->mutex);
+    __atomic_sub_fetch(&writer->syncs, 1, __ATOMIC_RELAXED);
 }
 
-static int get_valid_ctx_idx(
-    struct va_trace *pva_trace,
-    VAContextID context)
+/* drain and stop the writer thread, returns the number of dropped records */
+static unsigned long trace_writer_destroy(struct trace_writer *writer, unsigned long *skipped)
 {
-    int idx;
+    unsigned long dropped;
 
-    LOCK_RESOURCE(pva_trace);
+    pthread_mutex_lock(&writer->mutex);
+    writer->stop = 1;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
 
-    for (idx = 0; idx < MAX_TRACE_CTX_NUM; idx++)
-        if (pva_trace->ptra_ctx[idx] &&
-            pva_trace->ptra_ctx[idx]->trace_context == context)
-            break;
+    pthread_join(writer->thread, NULL);
 
-    UNLOCK_RESOURCE(pva_trace);
+    dropped = writer->dropped;
+    *skipped = writer->skipped;
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->mutex);
+    free(writer);
 
-    return idx;
+    return dropped;
 }
+#endif
 
-static void FILE_NAME_SUFFIX(
-    char *env_value,
-    int max_size,
-    char *suffix_str,
-    unsigned int suffix_handle)
+/* write to a trace file, through the writer thread when LIBVA_TRACE_ASYNC is on */
+static void va_TraceFileWrite(
+    struct trace_context *trace_ctx,
+    FILE *fp,
+    const void *data,
+    size_t size,
+    int may_drop)
 {
-    int tmp = strnlen(env_value, max_size);
-    int left = max_size - tmp;
-    struct timeval tv;
-    int size = 0;
+    struct trace_chunk *chunk;
 
-    if (suffix_str)
-        size = strlen(suffix_str);
+    if (!trace_ctx->writer) {
+        fwrite(data, size, 1, fp);
+        return;
+    }
 
-    if (left < (size + 8 + 10))
+    chunk = trace_chunk_new(fp, size);
+    if (!chunk)
         return;
 
-    if (gettimeofday(&tv, NULL) == 0) {
-        sprintf(env_value + tmp,
-                ".%02d%02d%02d.",
-                (unsigned int)(tv.tv_sec / 3600) % 24,
-                (unsigned int)(tv.tv_sec / 60) % 60,
-                (unsigned int)tv.tv_sec % 60);
+    memcpy(chunk->data, data, size);
+    trace_writer_push(trace_ctx->writer, chunk, may_drop);
+}
 
-        tmp += 8;
-        left -= 8;
+#if defined(_WIN32)
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
+#else
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/* writev() until everything is out, short writes resume where they stopped */
+static void trace_writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+    ssize_t n;
+
+    while (iovcnt > 0) {
+        n = writev(fd, iov, iovcnt > IOV_MAX ? IOV_MAX : iovcnt);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
     }
+}
+#endif
 
-    if (suffix_str) {
-        strcat(env_value + tmp,
-               suffix_str);
+/* write a record made of several pieces, with one writev() or as one chunk
+ * through the writer thread, never dropped */
+static void va_TraceFileWritev(
+    struct trace_context *trace_ctx,
+    FILE *fp,
+    struct iovec *iov,
+    int iovcnt)
+{
+    struct trace_chunk *chunk;
+    size_t size = 0;
+    int i;
 
-        tmp += size;
-        left -= size;
+    if (!trace_ctx->writer) {
+#if defined(_WIN32)
+        for (i = 0; i < iovcnt; i++)
+            fwrite(iov[i].iov_base, iov[i].iov_len, 1, fp);
+        fflush(fp);
+#else
+        /* anything still buffered by stdio goes first */
+        fflush(fp);
+        trace_writev_all(fileno(fp), iov, iovcnt);
+#endif
+        return;
     }
 
-    if (suffix_handle) {
-        sprintf(env_value + tmp,
-                "0x%08x",
-                suffix_handle);
+    for (i = 0; i < iovcnt; i++)
+        size += iov[i].iov_len;
+
+    chunk = trace_chunk_new(fp, size);
+    if (!chunk)
+        return;
+
+    size = 0;
+    for (i = 0; i < iovcnt; i++) {
+        memcpy(chunk->data + size, iov[i].iov_base, iov[i].iov_len);
+        size += iov[i].iov_len;
     }
+    trace_writer_push(trace_ctx->writer, chunk, 0);
 }
 
-static int open_tracing_specil_file(
-    struct va_trace *pva_trace,
-    struct trace_context *ptra_ctx,
-    int type) // 0: codedbuf, 1: surface
+/* lock-free, returns NULL for an index out of the array */
+static void *trace_ptr_table_get(
+    struct trace_ptr_table **ptable,
+    int idx)
 {
-    char *fn_env = type == 0 ?
-                   pva_trace->fn_codedbuf_env : pva_trace->fn_surface_env;
-    char env_value[1024];
-    FILE *fp = NULL;
+    struct trace_ptr_table *table = VA_TRACE_LOAD_PTR(ptable);
 
-    strncpy(env_value, fn_env, 1024);
-    env_value[1023] = '\0';
-    FILE_NAME_SUFFIX(env_value, 1024,
-                     "ctx-", (unsigned int)ptra_ctx->trace_context);
+    if (!table || idx < 0 || idx >= table->size)
+        return NULL;
 
-    fn_env = strdup(env_value);
-    if (!fn_env)
-        return -1;
+    return VA_TRACE_LOAD_PTR(&table->ptr[idx]);
+}
 
-    fp = fopen(fn_env, "w");
-    if (!fp) {
-        free(fn_env);
+/* must be called with resource_mutex held unless the array isn't shared
+ * yet, the array doubles until idx fits */
+static int trace_ptr_table_set(
+    struct trace_ptr_table **ptable,
+    int idx,
+    void *ptr)
+{
+    struct trace_ptr_table *table = *ptable, *grown;
+    int size;
 
+    if (idx < 0)
         return -1;
+
+    if (!table || idx >= table->size) {
+        size = table ? table->size * 2 : TRACE_PTR_TABLE_MIN_SIZE;
+        while (size <= idx)
+            size *= 2;
+
+        grown = calloc(1, sizeof(*grown) + sizeof(grown->ptr[0]) * size);
+        if (!grown)
+            return -1;
+
+        grown->size = size;
+        grown->retired = table;
+        if (table)
+            memcpy(grown->ptr, table->ptr, sizeof(table->ptr[0]) * table->size);
+
+        VA_TRACE_STORE_PTR(ptable, grown);
+        table = grown;
     }
 
-    if (type == 0) {
-        ptra_ctx->trace_codedbuf_fn = fn_env;
-        ptra_ctx->trace_fp_codedbuf = fp;
-        va_infoMessage(pva_trace->dpy, "LIBVA_TRACE_CODEDBUF is on, save codedbuf into %s\n",
+    VA_TRACE_STORE_PTR(&table->ptr[idx], ptr);
+
+    return 0;
+}
+
+/* index of the first unused slot, which may be right past the array */
+static int trace_ptr_table_find_free(
+    struct trace_ptr_table *table)
+{
+    int idx;
+
+    for (idx = 0; table && idx < table->size; idx++)
+        if (!table->ptr[idx])
+            break;
+
+    return idx;
+}
+
+static void trace_ptr_table_free(
+    struct trace_ptr_table **ptable)
+{
+    struct trace_ptr_table *table = *ptable, *retired;
+
+    while (table) {
+        retired = table->retired;
+        free(table);
+        table = retired;
+    }
+
+    *ptable = NULL;
+}
+
+static unsigned int trace_id_hash(unsigned int id, unsigned int bits)
+{
+    return (id * 2654435761u) >> (32 - bits);
+}
+
+/* lock-free lookup, returns TRACE_ID_NONE when the id isn't mapped */
+static unsigned int trace_id_map_find(
+    struct trace_id_map *map,
+    unsigned int id)
+{
+    struct trace_id_table *table;
+    unsigned int seq, value, entry_value, mask, i, n;
+
+    do {
+        seq = VA_TRACE_LOAD(&map->seq);
+        VA_TRACE_FENCE();
+
+        value = 0;
+        table = VA_TRACE_LOAD_PTR(&map->table);
+        if (table) {
+            mask = (1u << table->bits) - 1;
+            i = trace_id_hash(id, table->bits);
+            for (n = 0; n <= mask; n++) {
+                entry_value = VA_TRACE_LOAD(&table->entries[i].value);
+                if (!entry_value)
+                    break;
+
+                if (VA_TRACE_LOAD(&table->entries[i].id) == id) {
+                    value = entry_value;
+                    break;
+                }
+
+                i = (i + 1) & mask;
+            }
+        }
+
+        VA_TRACE_FENCE();
+    } while ((seq & 1) || seq != VA_TRACE_LOAD(&map->seq));
+
+    return value ? value - 1 : TRACE_ID_NONE;
+}
+
+/* the update functions must be called with resource_mutex held */
+static struct trace_id_table *trace_id_map_grow(
+    struct trace_id_map *map)
+{
+    struct trace_id_table *table = map->table, *grown;
+    unsigned int bits = table ? table->bits + 1 : TRACE_ID_MAP_MIN_BITS;
+    unsigned int mask = (1u << bits) - 1, i, j;
+
+    grown = calloc(1, sizeof(*grown) + (sizeof(grown->entries[0]) << bits));
+    if (!grown)
+        return NULL;
+
+    grown->bits = bits;
+    grown->retired = table;
+
+    for (j = 0; table && j < (1u << table->bits); j++) {
+        if (!table->entries[j].value)
+            continue;
+
+        i = trace_id_hash(table->entries[j].id, bits);
+        while (grown->entries[i].value)
+            i = (i + 1) & mask;
+
+        grown->entries[i] = table->entries[j];
+        grown->count++;
+    }
+
+    VA_TRACE_STORE_PTR(&map->table, grown);
+
+    return grown;
+}
+
+static int trace_id_map_insert(
+    struct trace_id_map *map,
+    unsigned int id,
+    unsigned int value)
+{
+    struct trace_id_table *table = map->table;
+    unsigned int mask, i;
+
+    if (!table || (table->count + 1) * 2 > (1u << table->bits)) {
+        table = trace_id_map_grow(map);
+        if (!table)
+            return -1;
+    }
+
+    mask = (1u << table->bits) - 1;
+    i = trace_id_hash(id, table->bits);
+    while (table->entries[i].value && table->entries[i].id != id)
+        i = (i + 1) & mask;
+
+    if (!table->entries[i].value)
+        table->count++;
+
+    VA_TRACE_STORE(&map->seq, map->seq + 1);
+    VA_TRACE_FENCE();
+    VA_TRACE_STORE(&table->entries[i].id, id);
+    VA_TRACE_STORE(&table->entries[i].value, value + 1);
+    VA_TRACE_FENCE();
+    VA_TRACE_STORE(&map->seq, map->seq + 1);
+
+    return 0;
+}
+
+static void trace_id_map_remove(
+    struct trace_id_map *map,
+    unsigned int id)
+{
+    struct trace_id_table *table = map->table;
+    unsigned int mask, i, j, home;
+
+    if (!table)
+        return;
+
+    mask = (1u << table->bits) - 1;
+    i = trace_id_hash(id, table->bits);
+    while (table->entries[i].value && table->entries[i].id != id)
+        i = (i + 1) & mask;
+
+    if (!table->entries[i].value)
+        return;
+
+    VA_TRACE_STORE(&map->seq, map->seq + 1);
+    VA_TRACE_FENCE();
+
+    /* pull back the rest of the cluster so that no probe sequence is cut */
+    for (j = (i + 1) & mask; table->entries[j].value; j = (j + 1) & mask) {
+        home = trace_id_hash(table->entries[j].id, table->bits);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            VA_TRACE_STORE(&table->entries[i].id, table->entries[j].id);
+            VA_TRACE_STORE(&table->entries[i].value, table->entries[j].value);
+            i = j;
+        }
+    }
+    VA_TRACE_STORE(&table->entries[i].value, 0);
+    table->count--;
+
+    VA_TRACE_FENCE();
+    VA_TRACE_STORE(&map->seq, map->seq + 1);
+}
+
+static void trace_id_map_free(
+    struct trace_id_map *map)
+{
+    struct trace_id_table *table = map->table, *retired;
+
+    while (table) {
+        retired = table->retired;
+        free(table);
+        table = retired;
+    }
+
+    map->table = NULL;
+}
+
+static int get_valid_config_idx(
+    struct va_trace *pva_trace,
+    VAConfigID config_id)
+{
+    unsigned int idx = trace_id_map_find(&pva_trace->config_map, config_id);
+
+    return idx == TRACE_ID_NONE ? -1 : (int)idx;
+}
+
+static void add_trace_config_info(
+    struct va_trace *pva_trace,
+    VAConfigID config_id,
+    VAProfile profile,
+    VAEntrypoint entrypoint)
+{
+    struct trace_ptr_table *table;
+    struct trace_config_info *pconfig_info = NULL;
+    int idx = 0;
+    pid_t thd_id = va_trace_thread_id();
+
+    LOCK_RESOURCE(pva_trace);
+
+    idx = get_valid_config_idx(pva_trace, config_id);
+    if (idx < 0) {
+        table = pva_trace->config_info;
+        for (idx = 0; table && idx < table->size; idx++) {
+            pconfig_info = table->ptr[idx];
+            if (!pconfig_info || !pconfig_info->valid)
+                break;
+        }
+    }
+
+    pconfig_info = trace_ptr_table_get(&pva_trace->config_info, idx);
+    if (!pconfig_info) {
+        pconfig_info = calloc(sizeof(struct trace_config_info), 1);
+        if (pconfig_info &&
+            trace_ptr_table_set(&pva_trace->config_info, idx, pconfig_info)) {
+            free(pconfig_info);
+            pconfig_info = NULL;
+        }
+    }
+
+    if (pconfig_info) {
+        pconfig_info->config_id = config_id;
+        pconfig_info->trace_profile = profile;
+        pconfig_info->trace_entrypoint = entrypoint;
+        pconfig_info->created_thd_id = thd_id;
+        pconfig_info->valid =
+            trace_id_map_insert(&pva_trace->config_map, config_id, idx) == 0;
+    }
+
+    UNLOCK_RESOURCE(pva_trace);
+}
+
+static void delete_trace_config_info(
+    struct va_trace *pva_trace,
+    VAConfigID config_id)
+{
+    struct trace_config_info *pconfig_info;
+
+    LOCK_RESOURCE(pva_trace);
+
+    pconfig_info = trace_ptr_table_get(&pva_trace->config_info,
+                                       get_valid_config_idx(pva_trace, config_id));
+    if (pconfig_info) {
+        pconfig_info->valid = 0;
+        pconfig_info->config_id = -1;
+
+        trace_id_map_remove(&pva_trace->config_map, config_id);
+    }
+
+    UNLOCK_RESOURCE(pva_trace);
+}
+
+static VAContextID get_ctx_by_buf(
+    struct va_trace *pva_trace,
+    VABufferID buf_id)
+{
+    return trace_id_map_find(&pva_trace->buf_map, buf_id);
+}
+
+static void add_trace_buf_info(
+    struct va_trace *pva_trace,
+    VAContextID context,
+    VABufferID buf_id)
+{
+    LOCK_RESOURCE(pva_trace);
+
+    if (trace_id_map_insert(&pva_trace->buf_map, buf_id, context))
+        va_errorMessage(pva_trace->dpy, "Add buf info failed\n");
+
+    UNLOCK_RESOURCE(pva_trace);
+}
+
+static void delete_trace_buf_info(
+    struct va_trace *pva_trace,
+    VABufferID buf_id)
+{
+    LOCK_RESOURCE(pva_trace);
+
+    trace_id_map_remove(&pva_trace->buf_map, buf_id);
+
+    UNLOCK_RESOURCE(pva_trace);
+}
+
+static int get_valid_ctx_idx(
+    struct va_trace *pva_trace,
+    VAContextID context)
+{
+    unsigned int idx = trace_id_map_find(&pva_trace->context_map, context);
+
+    return idx == TRACE_ID_NONE ? -1 : (int)idx;
+}
+
+static int get_free_ctx_idx(
+    struct va_trace *pva_trace,
+    VAContextID context)
+{
+    int idx = get_valid_ctx_idx(pva_trace, context);
+
+    if (idx >= 0)
+        return idx;
+
+    LOCK_RESOURCE(pva_trace);
+
+    /* grow the array now, installing the context later can't fail */
+    idx = trace_ptr_table_find_free(pva_trace->ptra_ctx);
+    if (trace_ptr_table_set(&pva_trace->ptra_ctx, idx, NULL))
+        idx = -1;
+
+    UNLOCK_RESOURCE(pva_trace);
+
+    return idx;
+}
+
+static void FILE_NAME_SUFFIX(
+    char *env_value,
+    int max_size,
+    char *suffix_str,
+    unsigned int suffix_handle)
+{
+    int tmp = strnlen(env_value, max_size);
+    int left = max_size - tmp;
+    struct timeval tv;
+    int size = 0;
+
+    if (suffix_str)
+        size = strlen(suffix_str);
+
+    if (left < (size + 8 + 10))
+        return;
+
+    if (gettimeofday(&tv, NULL) == 0) {
+        sprintf(env_value + tmp,
+                ".%02d%02d%02d.",
+                (unsigned int)(tv.tv_sec / 3600) % 24,
+                (unsigned int)(tv.tv_sec / 60) % 60,
+                (unsigned int)tv.tv_sec % 60);
+
+        tmp += 8;
+        left -= 8;
+    }
+
+    if (suffix_str) {
+        strcat(env_value + tmp,
+               suffix_str);
+
+        tmp += size;
+        left -= size;
+    }
+
+    if (suffix_handle) {
+        sprintf(env_value + tmp,
+                "0x%08x",
+                suffix_handle);
+    }
+}
+
+static int open_tracing_specil_file(
+    struct va_trace *pva_trace,
+    struct trace_context *ptra_ctx,
+    int type) // 0: codedbuf, 1: surface
+{
+    char *fn_env = type == 0 ?
+                   pva_trace->fn_codedbuf_env : pva_trace->fn_surface_env;
+    char env_value[1024];
+    FILE *fp = NULL;
+
+    strncpy(env_value, fn_env, 1024);
+    env_value[1023] = '\0';
+    FILE_NAME_SUFFIX(env_value, 1024,
+                     "ctx-", (unsigned int)ptra_ctx->trace_context);
+
+    fn_env = strdup(env_value);
+    if (!fn_env)
+        return -1;
+
+    fp = fopen(fn_env, "w");
+    if (!fp) {
+        free(fn_env);
+
+        return -1;
+    }
+
+    if (type == 0) {
+        ptra_ctx->trace_codedbuf_fn = fn_env;
+        ptra_ctx->trace_fp_codedbuf = fp;
+        va_infoMessage(pva_trace->dpy, "LIBVA_TRACE_CODEDBUF is on, save codedbuf into %s\n",
+                       fn_env);
+    } else {
+        ptra_ctx->trace_surface_fn = fn_env;
+        ptra_ctx->trace_fp_surface = fp;
+        va_infoMessage(pva_trace->dpy, "LIBVA_TRACE_SURFACE is on, save surface into %s\n",
                        fn_env);
+    }
+
+    return 0;
+}
+
+/* open the surface and codedbuf files the context needs and doesn't have yet */
+static void open_tracing_dump_files(
+    struct va_trace *pva_trace,
+    struct trace_context *trace_ctx)
+{
+    int encode, decode, jpeg, vpp;
+
+    /* avoid to create so many empty files */
+    encode = (trace_ctx->trace_entrypoint == VAEntrypointEncSlice);
+    decode = (trace_ctx->trace_entrypoint == VAEntrypointVLD);
+    jpeg = (trace_ctx->trace_entrypoint == VAEntrypointEncPicture);
+    vpp = (trace_ctx->trace_entrypoint == VAEntrypointVideoProc);
+
+    if (((encode && (va_trace_flag & VA_TRACE_FLAG_SURFACE_ENCODE)) ||
+         (decode && (va_trace_flag & VA_TRACE_FLAG_SURFACE_DECODE)) ||
+         (jpeg && (va_trace_flag & VA_TRACE_FLAG_SURFACE_JPEG)) ||
+         (vpp && (va_trace_flag & VA_TRACE_FLAG_SURFACE_VPPOUT))) &&
+        !trace_ctx->trace_fp_surface) {
+        if (open_tracing_specil_file(pva_trace, trace_ctx, 1) < 0) {
+            va_errorMessage(pva_trace->dpy, "Open surface fail failed for ctx 0x%08x\n",
+                            trace_ctx->trace_context);
+
+            va_trace_flag &= ~(VA_TRACE_FLAG_SURFACE);
+        }
+    }
+
+    if (encode && (va_trace_flag & VA_TRACE_FLAG_CODEDBUF) &&
+        !trace_ctx->trace_fp_codedbuf) {
+        if (open_tracing_specil_file(pva_trace, trace_ctx, 0) < 0) {
+            va_errorMessage(pva_trace->dpy, "Open codedbuf fail failed for ctx 0x%08x\n",
+                            trace_ctx->trace_context);
+
+            va_trace_flag &= ~(VA_TRACE_FLAG_CODEDBUF);
+        }
+    }
+}
+
+static void fill_binary_log_header(VATraceBinaryHeader *header)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, VA_TRACE_BINARY_MAGIC, sizeof(VA_TRACE_BINARY_MAGIC));
+    header->version = VA_TRACE_BINARY_VERSION;
+    header->flags = va_trace_flag;
+}
+
+static void write_binary_log_header(FILE *fp)
+{
+    VATraceBinaryHeader header;
+
+    fill_binary_log_header(&header);
+    fwrite(&header, sizeof(header), 1, fp);
+}
+
+#if defined(__linux__)
+/* zlib is only loaded for LIBVA_TRACE_COMPRESS, libva doesn't link it */
+static struct {
+    void *(*gzdopen)(int fd, const char *mode);
+    int (*gzwrite)(void *file, const void *buf, unsigned int len);
+    int (*gzclose)(void *file);
+} va_trace_zlib;
+
+static pthread_once_t va_trace_zlib_once = PTHREAD_ONCE_INIT;
+
+static void va_trace_zlib_load(void)
+{
+    void *handle = dlopen("libz.so.1", RTLD_NOW | RTLD_LOCAL);
+
+    if (!handle)
+        return;
+
+    *(void **)&va_trace_zlib.gzdopen = dlsym(handle, "gzdopen");
+    *(void **)&va_trace_zlib.gzwrite = dlsym(handle, "gzwrite");
+    *(void **)&va_trace_zlib.gzclose = dlsym(handle, "gzclose");
+    if (!va_trace_zlib.gzdopen || !va_trace_zlib.gzwrite || !va_trace_zlib.gzclose) {
+        memset(&va_trace_zlib, 0, sizeof(va_trace_zlib));
+        dlclose(handle);
+    }
+}
+
+/* a log file behind a FILE cookie, every stdio flush lands here so the
+ * writers of fp_log don't know about rotation */
+struct trace_log_segment {
+    char *base; /* log file name without the .gz suffix */
+    const char *suffix;
+    int fd;
+    void *gz; /* gzFile when compressed */
+    unsigned long long size; /* bytes written into the segment */
+    time_t start;
+    unsigned int index; /* segments rotated so far */
+
+    unsigned long long max_size;
+    unsigned int period;
+    unsigned int keep;
+
+    /* binary logs are followed record by record, so that each segment
+     * starts with its own header and is cut between records only */
+    int binary;
+    unsigned long long head_size; /* header bytes at the segment start */
+    VATraceRecord record; /* the record header being written */
+    size_t record_fill;
+    unsigned long long skip; /* bytes left of the current header or payload */
+};
+
+static int trace_log_segment_open(struct trace_log_segment *seg, int append)
+{
+    char fn[1024];
+
+    snprintf(fn, sizeof(fn), "%s%s", seg->base, seg->suffix);
+    seg->fd = open(fn, O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644);
+    if (seg->fd < 0)
+        return -1;
+
+    seg->gz = NULL;
+    if (*seg->suffix) {
+        /* a gzip file may hold several members, appending starts another one */
+        seg->gz = va_trace_zlib.gzdopen(seg->fd, append ? "ab1" : "wb1");
+        if (!seg->gz) {
+            close(seg->fd);
+            return -1;
+        }
+    }
+
+    seg->size = append ? lseek(seg->fd, 0, SEEK_END) : 0;
+    seg->start = time(NULL);
+    seg->head_size = 0;
+
+    return 0;
+}
+
+static void trace_log_segment_close(struct trace_log_segment *seg)
+{
+    if (seg->gz)
+        va_trace_zlib.gzclose(seg->gz);
+    else if (seg->fd >= 0)
+        close(seg->fd);
+
+    seg->gz = NULL;
+    seg->fd = -1;
+}
+
+static int trace_log_segment_write_all(
+    struct trace_log_segment *seg,
+    const char *buf,
+    size_t size)
+{
+    ssize_t ret;
+
+    if (seg->gz)
+        return size && va_trace_zlib.gzwrite(seg->gz, buf, size) == 0 ? -1 : 0;
+
+    while (size) {
+        ret = write(seg->fd, buf, size);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += ret;
+        size -= ret;
+    }
+
+    return 0;
+}
+
+/* log_file becomes log_file.N and a new log_file is started */
+static int trace_log_segment_rotate(struct trace_log_segment *seg)
+{
+    char fn[1024], rotated_fn[1024];
+
+    trace_log_segment_close(seg);
+
+    seg->index++;
+    snprintf(fn, sizeof(fn), "%s%s", seg->base, seg->suffix);
+    snprintf(rotated_fn, sizeof(rotated_fn), "%s.%u%s", seg->base, seg->index, seg->suffix);
+    rename(fn, rotated_fn);
+
+    if (seg->keep && seg->index > seg->keep) {
+        snprintf(rotated_fn, sizeof(rotated_fn), "%s.%u%s",
+                 seg->base, seg->index - seg->keep, seg->suffix);
+        unlink(rotated_fn);
+    }
+
+    return trace_log_segment_open(seg, 0);
+}
+
+/* a new binary segment repeats the file header, va_trace_decode skips the
+ * headers found between records of concatenated segments */
+static int trace_log_segment_rotate_binary(struct trace_log_segment *seg)
+{
+    VATraceBinaryHeader header;
+
+    if (trace_log_segment_rotate(seg) < 0)
+        return -1;
+
+    fill_binary_log_header(&header);
+    if (trace_log_segment_write_all(seg, (const char *)&header, sizeof(header)) < 0)
+        return -1;
+
+    seg->size = seg->head_size = sizeof(header);
+    return 0;
+}
+
+/* follow the records through buf, returns the offset of the last record
+ * start within room, else of the first one after it, or -1 if buf holds
+ * no record start */
+static ssize_t trace_log_segment_scan(
+    struct trace_log_segment *seg,
+    const char *buf,
+    size_t size,
+    size_t room)
+{
+    ssize_t cut = -1;
+    size_t pos = 0, n;
+
+    while (pos < size) {
+        if (seg->skip) {
+            n = seg->skip < size - pos ? seg->skip : size - pos;
+            seg->skip -= n;
+            pos += n;
+            continue;
+        }
+
+        if (!seg->record_fill && (cut < 0 || pos <= room))
+            cut = pos;
+
+        n = sizeof(seg->record) - seg->record_fill;
+        if (n > size - pos)
+            n = size - pos;
+        memcpy((char *)&seg->record + seg->record_fill, buf + pos, n);
+        seg->record_fill += n;
+        pos += n;
+
+        if (seg->record_fill == sizeof(seg->record)) {
+            seg->skip = seg->record.size;
+            seg->record_fill = 0;
+        }
+    }
+
+    if (!seg->skip && !seg->record_fill && (cut < 0 || size <= room))
+        cut = size;
+
+    return cut;
+}
+
+static ssize_t trace_log_segment_write_binary(
+    struct trace_log_segment *seg,
+    const char *buf,
+    size_t size)
+{
+    size_t room = size;
+    ssize_t cut;
+    int rotate = 0;
+
+    if (seg->size > seg->head_size) {
+        if (seg->period && time(NULL) - seg->start >= seg->period)
+            rotate = 1;
+        else if (seg->max_size && seg->size + size > seg->max_size) {
+            room = seg->max_size > seg->size ? seg->max_size - seg->size : 0;
+            rotate = 1;
+        }
+    }
+
+    cut = trace_log_segment_scan(seg, buf, size, room);
+
+    /* without a record start in buf the rotation waits for the next write */
+    if (rotate && cut >= 0) {
+        if (trace_log_segment_write_all(seg, buf, cut) < 0 ||
+            trace_log_segment_rotate_binary(seg) < 0)
+            return -1;
+    } else
+        cut = 0;
+
+    if (trace_log_segment_write_all(seg, buf + cut, size - cut) < 0)
+        return -1;
+
+    seg->size += size - cut;
+    return size;
+}
+
+static ssize_t trace_log_segment_write(void *cookie, const char *buf, size_t size)
+{
+    struct trace_log_segment *seg = cookie;
+    size_t cut = 0;
+
+    if (seg->fd < 0)
+        return -1;
+
+    if (seg->binary)
+        return trace_log_segment_write_binary(seg, buf, size);
+
+    if (seg->size && seg->period && time(NULL) - seg->start >= seg->period) {
+        if (trace_log_segment_rotate(seg) < 0)
+            return -1;
+    }
+
+    /* end the full segment on the last line boundary that fits, stdio
+     * flushes don't follow lines */
+    if (seg->size && seg->max_size && seg->size + size > seg->max_size) {
+        size_t room = seg->max_size > seg->size ? seg->max_size - seg->size : 0;
+        const char *eol = memrchr(buf, '\n', room);
+
+        if (eol)
+            cut = eol - buf + 1;
+
+        if (trace_log_segment_write_all(seg, buf, cut) < 0 ||
+            trace_log_segment_rotate(seg) < 0)
+            return -1;
+    }
+
+    if (trace_log_segment_write_all(seg, buf + cut, size - cut) < 0)
+        return -1;
+
+    seg->size += size - cut;
+    return size;
+}
+
+static int trace_log_segment_release(void *cookie)
+{
+    struct trace_log_segment *seg = cookie;
+
+    trace_log_segment_close(seg);
+    free(seg->base);
+    free(seg);
+
+    return 0;
+}
+
+/* plain fopen() unless the log file is rotated or compressed */
+static FILE *trace_log_fopen(
+    struct va_trace *pva_trace,
+    const char *fn,
+    int append)
+{
+    static const cookie_io_functions_t funcs = {
+        .write = trace_log_segment_write,
+        .close = trace_log_segment_release,
+    };
+    struct trace_log_segment *seg;
+    size_t len = strlen(fn);
+    FILE *fp;
+
+    if (!pva_trace->trace_max_size && !pva_trace->trace_rotate_period &&
+        !pva_trace->trace_compress)
+        return fopen(fn, append ? "a" : "w");
+
+    seg = calloc(sizeof(struct trace_log_segment), 1);
+    if (!seg)
+        return NULL;
+
+    seg->suffix = "";
+    if (pva_trace->trace_compress) {
+        seg->suffix = ".gz";
+        len -= strlen(seg->suffix);
+    }
+    seg->base = strndup(fn, len);
+    seg->max_size = pva_trace->trace_max_size;
+    seg->period = pva_trace->trace_rotate_period;
+    seg->keep = pva_trace->trace_rotate_keep;
+    seg->binary = pva_trace->trace_binary;
+    /* a new log file starts with the header written by the caller */
+    if (seg->binary && !append)
+        seg->skip = sizeof(VATraceBinaryHeader);
+
+    if (!seg->base || trace_log_segment_open(seg, append) < 0) {
+        free(seg->base);
+        free(seg);
+        return NULL;
+    }
+
+    fp = fopencookie(seg, "w", funcs);
+    if (!fp)
+        trace_log_segment_release(seg);
+
+    return fp;
+}
+#else
+static FILE *trace_log_fopen(
+    struct va_trace *pva_trace,
+    const char *fn,
+    int append)
+{
+    return fopen(fn, append ? "a" : "w");
+}
+#endif
+
+static int open_tracing_log_file(
+    struct va_trace *pva_trace,
+    struct trace_log_file *plog_file,
+    pid_t thd_id)
+{
+    FILE *pfp = NULL;
+    int new_fn_flag = 0;
+
+    if (plog_file->used && plog_file->thread_id != thd_id) {
+        va_errorMessage(pva_trace->dpy, "Try to open a busy log file occupied by other thread\n");
+
+        return -1;
+    }
+
+    if (plog_file->thread_id != thd_id) {
+        char env_value[1024];
+
+        strncpy(env_value, pva_trace->fn_log_env, 1024);
+        env_value[1023] = '\0';
+        FILE_NAME_SUFFIX(env_value, 1024,
+                         "thd-", (unsigned int)thd_id);
+        if (pva_trace->trace_compress)
+            strncat(env_value, ".gz", sizeof(env_value) - strlen(env_value) - 1);
+
+        if (plog_file->fn_log)
+            free(plog_file->fn_log);
+
+        plog_file->fn_log = strdup(env_value);
+        if (!plog_file->fn_log)
+            goto FAIL;
+
+        new_fn_flag = 1;
+    }
+
+    if (!plog_file->used) {
+        pfp = trace_log_fopen(pva_trace, plog_file->fn_log, !new_fn_flag);
+
+        if (!pfp)
+            goto FAIL;
+
+        /* the first log file gets its header once va_TraceInit settled the flags */
+        if (new_fn_flag && (va_trace_flag & VA_TRACE_FLAG_BINARY))
+            write_binary_log_header(pfp);
+
+        va_infoMessage(pva_trace->dpy, "%s %s for the thread 0x%08x\n",
+                       new_fn_flag ? "Open new log file" : "Append to log file",
+                       plog_file->fn_log, thd_id);
+
+        plog_file->fp_log = pfp;
+        plog_file->thread_id = thd_id;
+    }
+
+    plog_file->used++;
+    return 0;
+
+FAIL:
+    if (plog_file->fn_log) {
+        free(plog_file->fn_log);
+        plog_file->fn_log = NULL;
+    }
+
+    return -1;
+}
+
+static int get_log_file_idx_by_thd(
+    struct trace_log_files_manager *plog_files_mgr,
+    pid_t thd_id)
+{
+    struct trace_ptr_table *table = plog_files_mgr->log_file;
+    struct trace_log_file *plog_file = NULL;
+    int first_free_idx = -1;
+    int i = 0;
+
+    /* the files are never released before va_TraceEnd, so the array is
+     * filled from the start */
+    for (i = 0; table && i < table->size; i++) {
+        plog_file = table->ptr[i];
+        if (!plog_file)
+            break;
+
+        if (plog_file->thread_id == thd_id)
+            return i;
+        else if (!plog_file->used && first_free_idx < 0)
+            first_free_idx = i;
+    }
+
+    return first_free_idx < 0 ? i : first_free_idx;
+}
+
+static struct trace_log_file *start_tracing2log_file(
+    struct va_trace *pva_trace)
+{
+    struct trace_log_files_manager *plog_files_mgr = NULL;
+    struct trace_log_file *plog_file = NULL;
+    pid_t thd_id = va_trace_thread_id();
+    int i = 0;
+
+    LOCK_RESOURCE(pva_trace);
+
+    plog_files_mgr = &pva_trace->log_files_manager;
+    if (va_trace_log_binding.pva_trace == pva_trace)
+        plog_file = trace_ptr_table_get(&plog_files_mgr->log_file,
+                                        va_trace_log_binding.idx);
+
+    if (plog_file && plog_file->thread_id == thd_id)
+        i = va_trace_log_binding.idx;
+    else
+        i = get_log_file_idx_by_thd(plog_files_mgr, thd_id);
+
+    plog_file = trace_ptr_table_get(&plog_files_mgr->log_file, i);
+    if (!plog_file) {
+        plog_file = calloc(sizeof(struct trace_log_file), 1);
+        if (plog_file &&
+            trace_ptr_table_set(&plog_files_mgr->log_file, i, plog_file)) {
+            free(plog_file);
+            plog_file = NULL;
+        }
+    }
+
+    if (plog_file) {
+        if (open_tracing_log_file(pva_trace, plog_file, thd_id) < 0) {
+            plog_file = NULL;
+        } else {
+            va_trace_log_binding.pva_trace = pva_trace;
+            va_trace_log_binding.idx = i;
+        }
+    }
+
+    UNLOCK_RESOURCE(pva_trace);
+    return plog_file;
+}
+
+static void stop_tracing2log_file(
+    struct va_trace *pva_trace,
+    struct trace_log_file *plog_file)
+{
+    LOCK_RESOURCE(pva_trace);
+
+    if (--plog_file->used <= 0) {
+        if (plog_file->fp_log) {
+            if (pva_trace->writer)
+                trace_writer_sync(pva_trace->writer);
+            fclose(plog_file->fp_log);
+            plog_file->fp_log = NULL;
+        }
+    }
+
+    UNLOCK_RESOURCE(pva_trace);
+}
+
+/* keep the reference taken by start_tracing2log_file in the context */
+static void add_log_file_to_ctx(
+    struct va_trace *pva_trace,
+    struct trace_context *ptra_ctx,
+    struct trace_log_file *plog_file)
+{
+    LOCK_RESOURCE(pva_trace);
+
+    trace_ptr_table_set(&ptra_ctx->plog_file_list,
+                        trace_ptr_table_find_free(ptra_ctx->plog_file_list),
+                        plog_file);
+
+    UNLOCK_RESOURCE(pva_trace);
+}
+
+static void refresh_log_file(
+    struct va_trace *pva_trace,
+    struct trace_context *ptra_ctx)
+{
+    struct trace_ptr_table *list = NULL;
+    struct trace_log_file *plog_file = NULL;
+    pid_t thd_id = va_trace_thread_id();
+    int i = 0;
+
+    plog_file = ptra_ctx->plog_file;
+    if (plog_file && plog_file->thread_id == thd_id)
+        return;
+
+    /* a context created while LIBVA_TRACE_CONTROL paused the log has no
+     * file yet */
+    if (!plog_file && !(va_trace_flag & VA_TRACE_FLAG_LOG))
+        return;
+
+    /* the context holds a reference on the log file of every thread that
+     * traced it, a file already in the list can't be closed or reassigned */
+    list = VA_TRACE_LOAD_PTR(&ptra_ctx->plog_file_list);
+    for (i = 0; list && i < list->size; i++) {
+        plog_file = VA_TRACE_LOAD_PTR(&list->ptr[i]);
+        if (!plog_file)
+            break;
+
+        if (plog_file->thread_id == thd_id) {
+            ptra_ctx->plog_file = plog_file;
+            return;
+        }
+    }
+
+    /* first call on this thread, take a reference under the lock */
+    plog_file = start_tracing2log_file(pva_trace);
+    if (plog_file) {
+        ptra_ctx->plog_file = plog_file;
+        add_log_file_to_ctx(pva_trace, ptra_ctx, plog_file);
+    }
+}
+
+/* LIBVA_TRACE_MAX_SIZE, LIBVA_TRACE_ROTATE and LIBVA_TRACE_COMPRESS, must be
+ * settled before the first log file is opened */
+static void va_TraceParseRotate(struct va_trace *pva_trace)
+{
+    char env_value[1024];
+    char *end;
+
+    if (va_parseConfig("LIBVA_TRACE_MAX_SIZE", &env_value[0]) == 0) {
+        pva_trace->trace_max_size = strtoull(env_value, &end, 0);
+        switch (*end) {
+        case 'g':
+        case 'G':
+            pva_trace->trace_max_size <<= 10;
+        /* fall through */
+        case 'm':
+        case 'M':
+            pva_trace->trace_max_size <<= 10;
+        /* fall through */
+        case 'k':
+        case 'K':
+            pva_trace->trace_max_size <<= 10;
+        }
+    }
+
+    if (va_parseConfig("LIBVA_TRACE_ROTATE", &env_value[0]) == 0)
+        pva_trace->trace_rotate_period = strtoul(env_value, NULL, 0);
+
+    if (va_parseConfig("LIBVA_TRACE_ROTATE_KEEP", &env_value[0]) == 0)
+        pva_trace->trace_rotate_keep = strtoul(env_value, NULL, 0);
+
+#if defined(__linux__)
+    if (va_parseConfig("LIBVA_TRACE_COMPRESS", NULL) == 0) {
+        pthread_once(&va_trace_zlib_once, va_trace_zlib_load);
+        if (va_trace_zlib.gzdopen)
+            pva_trace->trace_compress = 1;
+        else
+            va_errorMessage(pva_trace->dpy, "Load libz.so.1 failed, LIBVA_TRACE_COMPRESS is off\n");
+    }
+
+    if (pva_trace->trace_max_size || pva_trace->trace_rotate_period)
+        va_infoMessage(pva_trace->dpy, "Rotate log files, max size %llu, period %u s, keep %u segments\n",
+                       pva_trace->trace_max_size, pva_trace->trace_rotate_period,
+                       pva_trace->trace_rotate_keep);
+#else
+    if (pva_trace->trace_max_size || pva_trace->trace_rotate_period) {
+        va_errorMessage(pva_trace->dpy, "Log rotation isn't supported on this platform\n");
+        pva_trace->trace_max_size = 0;
+        pva_trace->trace_rotate_period = 0;
+    }
+#endif
+}
+
+static void va_TraceParseFilter(VADisplay dpy, char *value)
+{
+    char *name, *saveptr = NULL;
+    unsigned int filter = 0;
+    unsigned int i;
+
+    for (name = strtok_r(value, ",", &saveptr); name;
+         name = strtok_r(NULL, ",", &saveptr)) {
+        for (i = 0; i < ARRAY_SIZE(va_trace_categories); i++) {
+            if (strcmp(name, va_trace_categories[i].name) == 0) {
+                filter |= va_trace_categories[i].category;
+                break;
+            }
+        }
+
+        if (i == ARRAY_SIZE(va_trace_categories))
+            va_errorMessage(dpy, "Unknown LIBVA_TRACE_FILTER category %s\n", name);
+    }
+
+    VA_TRACE_STORE(&va_trace_filter, filter);
+
+    va_infoMessage(dpy, "LIBVA_TRACE_FILTER is on, log categories 0x%02x\n", filter);
+}
+
+static void va_TraceParseSample(VADisplay dpy, const char *value)
+{
+    unsigned long first, last, every = 1;
+    char *end;
+
+    first = strtoul(value, &end, 0);
+    if (*end == '-') {
+        last = strtoul(end + 1, &end, 0);
+        if (*end == ':')
+            every = strtoul(end + 1, &end, 0);
     } else {
-        ptra_ctx->trace_surface_fn = fn_env;
-        ptra_ctx->trace_fp_surface = fp;
-        va_infoMessage(pva_trace->dpy, "LIBVA_TRACE_SURFACE is on, save surface into %s\n",
-                       fn_env);
+        every = first;
+        first = 0;
+        last = UINT_MAX;
     }
 
-    return 0;
+    if (*end || !every || last < first) {
+        va_errorMessage(dpy, "Invalid LIBVA_TRACE_SAMPLE %s, trace all frames\n", value);
+        return;
+    }
+
+    VA_TRACE_STORE(&va_trace_sample_first, first);
+    VA_TRACE_STORE(&va_trace_sample_last, last);
+    VA_TRACE_STORE(&va_trace_sample_every, every);
+
+    va_infoMessage(dpy, "LIBVA_TRACE_SAMPLE is on, trace every %lu frame(s) from %lu to %lu\n",
+                   every, first, last);
 }
 
-static int open_tracing_log_file(
+static void va_TraceParseContexts(
     struct va_trace *pva_trace,
-    struct trace_log_file *plog_file,
-    pid_t thd_id)
+    char *value)
 {
-    FILE *pfp = NULL;
-    int new_fn_flag = 0;
+    char *id, *end, *saveptr = NULL;
+    VAContextID *contexts;
 
-    if (plog_file->used && plog_file->thread_id != thd_id) {
-        va_errorMessage(pva_trace->dpy, "Try to open a busy log file occupied by other thread\n");
+    for (id = strtok_r(value, ",", &saveptr); id;
+         id = strtok_r(NULL, ",", &saveptr)) {
+        contexts = realloc(pva_trace->trace_contexts,
+                           (pva_trace->trace_contexts_num + 1) * sizeof(VAContextID));
+        if (!contexts)
+            break;
 
-        return -1;
+        pva_trace->trace_contexts = contexts;
+        pva_trace->trace_contexts[pva_trace->trace_contexts_num] = strtoul(id, &end, 0);
+        if (*end)
+            va_errorMessage(pva_trace->dpy, "Invalid LIBVA_TRACE_CONTEXTS id %s\n", id);
+        else
+            pva_trace->trace_contexts_num++;
     }
 
-    if (plog_file->thread_id != thd_id) {
-        char env_value[1024];
+    va_infoMessage(pva_trace->dpy, "LIBVA_TRACE_CONTEXTS is on, trace %d context(s)\n",
+                   pva_trace->trace_contexts_num);
+}
 
-        strncpy(env_value, pva_trace->fn_log_env, 1024);
-        env_value[1023] = '\0';
-        FILE_NAME_SUFFIX(env_value, 1024,
-                         "thd-", (unsigned int)thd_id);
+static int trace_context_allowed(
+    struct va_trace *pva_trace,
+    VAContextID context)
+{
+    int i;
 
-        if (plog_file->fn_log)
-            free(plog_file->fn_log);
+    if (!pva_trace->trace_contexts)
+        return 1;
 
-        plog_file->fn_log = strdup(env_value);
-        if (!plog_file->fn_log)
-            goto FAIL;
+    for (i = 0; i < pva_trace->trace_contexts_num; i++)
+        if (pva_trace->trace_contexts[i] == context)
+            return 1;
 
-        new_fn_flag = 1;
-    }
+    return 0;
+}
 
-    if (!plog_file->used) {
-        if (new_fn_flag)
-            pfp = fopen(plog_file->fn_log, "w");
+static int trace_frame_sampled(unsigned int frame_no)
+{
+    unsigned int first = VA_TRACE_LOAD(&va_trace_sample_first);
+
+    return frame_no >= first &&
+           frame_no <= VA_TRACE_LOAD(&va_trace_sample_last) &&
+           (frame_no - first) % VA_TRACE_LOAD(&va_trace_sample_every) == 0;
+}
+
+#if defined(__linux__)
+/* LIBVA_TRACE_CONTROL, the control file holds the whole runtime state and is
+ * applied again each time it is written, out of the words
+ *   on                   trace as configured, tracing is paused otherwise
+ *   filter=CATEGORY,...  as LIBVA_TRACE_FILTER, which applies if missing
+ *   sample=SPEC          as LIBVA_TRACE_SAMPLE, which applies if missing
+ *   bufdata, nobufdata   override LIBVA_TRACE_BUFDATA
+ */
+struct trace_control {
+    VADisplay dpy;
+    char *fn;
+    const char *name; /* fn within the watched directory */
+    int flag; /* va_trace_flag while tracing is on */
+    unsigned int filter;
+    unsigned int sample_first;
+    unsigned int sample_last;
+    unsigned int sample_every;
+    int inotify_fd;
+    int wake_fd[2];
+    pthread_t thread;
+};
+
+static void trace_control_apply(struct trace_control *control)
+{
+    VADisplay dpy = control->dpy;
+    char buf[1024], *word, *saveptr = NULL;
+    int flag = control->flag;
+    int on = 0;
+    int fd, len = 0;
+
+    fd = open(control->fn, O_RDONLY);
+    if (fd >= 0) {
+        len = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+    }
+    buf[len > 0 ? len : 0] = '\0';
+
+    VA_TRACE_STORE(&va_trace_filter, control->filter);
+    VA_TRACE_STORE(&va_trace_sample_first, control->sample_first);
+    VA_TRACE_STORE(&va_trace_sample_last, control->sample_last);
+    VA_TRACE_STORE(&va_trace_sample_every, control->sample_every);
+
+    for (word = strtok_r(buf, " \t\r\n", &saveptr); word;
+         word = strtok_r(NULL, " \t\r\n", &saveptr)) {
+        if (strcmp(word, "on") == 0)
+            on = 1;
+        else if (strcmp(word, "off") == 0)
+            on = 0;
+        else if (strncmp(word, "filter=", 7) == 0)
+            va_TraceParseFilter(dpy, word + 7);
+        else if (strncmp(word, "sample=", 7) == 0)
+            va_TraceParseSample(dpy, word + 7);
+        else if (strcmp(word, "bufdata") == 0)
+            flag |= VA_TRACE_FLAG_BUFDATA;
+        else if (strcmp(word, "nobufdata") == 0)
+            flag &= ~VA_TRACE_FLAG_BUFDATA;
         else
-            pfp = fopen(plog_file->fn_log, "a");
+            va_errorMessage(dpy, "Unknown LIBVA_TRACE_CONTROL word %s\n", word);
+    }
 
-        if (!pfp)
-            goto FAIL;
+    /* the hooks pick the whole new state up with the flag word, the
+     * bookkeeping of contexts and buffers keeps running while paused */
+    VA_TRACE_STORE(&va_trace_flag, on ? flag : VA_TRACE_FLAG_CONTROL);
 
-        va_infoMessage(pva_trace->dpy, "%s %s for the thread 0x%08x\n",
-                       new_fn_flag ? "Open new log file" : "Append to log file",
-                       plog_file->fn_log, thd_id);
+    va_infoMessage(dpy, "LIBVA_TRACE_CONTROL %s tracing, va_trace_flag 0x%x\n",
+                   on ? "resumes" : "pauses", on ? flag : VA_TRACE_FLAG_CONTROL);
+}
 
-        plog_file->fp_log = pfp;
-        plog_file->thread_id = thd_id;
+static void *trace_control_thread(void *arg)
+{
+    struct trace_control *control = arg;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    struct pollfd fds[2];
+    int changed;
+    ssize_t len;
+    char *p;
+
+    fds[0].fd = control->inotify_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = control->wake_fd[0];
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents)
+            break;
+
+        len = read(control->inotify_fd, buf, sizeof(buf));
+        if (len <= 0)
+            continue;
+
+        /* the directory is watched so that editors replacing the file and
+         * its first creation are seen too */
+        changed = 0;
+        for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *)p;
+            if (event->len && strcmp(event->name, control->name) == 0)
+                changed = 1;
+        }
+
+        if (changed)
+            trace_control_apply(control);
     }
 
-    plog_file->used++;
-    return 0;
+    return NULL;
+}
+
+static struct trace_control *trace_control_create(
+    VADisplay dpy,
+    const char *fn,
+    int flag)
+{
+    struct trace_control *control = calloc(sizeof(struct trace_control), 1);
+    char *dir = NULL, *slash;
+
+    if (!control)
+        return NULL;
+
+    control->dpy = dpy;
+    control->flag = flag;
+    control->filter = va_trace_filter;
+    control->sample_first = va_trace_sample_first;
+    control->sample_last = va_trace_sample_last;
+    control->sample_every = va_trace_sample_every;
+    control->inotify_fd = -1;
+    control->wake_fd[0] = control->wake_fd[1] = -1;
+
+    control->fn = strdup(fn);
+    dir = strdup(fn);
+    if (!control->fn || !dir)
+        goto FAIL;
+
+    slash = strrchr(dir, '/');
+    if (slash) {
+        control->name = control->fn + (slash - dir) + 1;
+        if (slash == dir)
+            slash++;
+        *slash = '\0';
+    } else {
+        control->name = control->fn;
+        strcpy(dir, ".");
+    }
+
+    control->inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (control->inotify_fd < 0 ||
+        inotify_add_watch(control->inotify_fd, dir,
+                          IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE) < 0 ||
+        pipe2(control->wake_fd, O_CLOEXEC) < 0)
+        goto FAIL;
+
+    /* start paused unless the control file already says on */
+    trace_control_apply(control);
+
+    if (pthread_create(&control->thread, NULL, trace_control_thread, control) != 0)
+        goto FAIL;
+
+    free(dir);
+    return control;
 
 FAIL:
-    if (plog_file->fn_log) {
-        free(plog_file->fn_log);
-        plog_file->fn_log = NULL;
+    va_trace_flag = flag;
+    if (control->inotify_fd >= 0)
+        close(control->inotify_fd);
+    if (control->wake_fd[0] >= 0) {
+        close(control->wake_fd[0]);
+        close(control->wake_fd[1]);
     }
+    free(control->fn);
+    free(control);
+    free(dir);
 
-    return -1;
+    return NULL;
 }
 
-static int get_log_file_idx_by_thd(
-    struct trace_log_files_manager *plog_files_mgr,
-    pid_t thd_id)
+static void trace_control_destroy(struct trace_control *control)
 {
-    struct trace_log_file *plog_file = plog_files_mgr->log_file;
-    int first_free_idx = MAX_TRACE_THREAD_NUM;
-    int i = 0;
+    char c = 0;
 
-    for (i = 0; i < MAX_TRACE_THREAD_NUM; i++) {
-        if (plog_file[i].thread_id == thd_id)
-            break;
-        else if (!plog_file[i].used &&
-                 first_free_idx >= MAX_TRACE_THREAD_NUM)
-            first_free_idx = i;
+    if (write(control->wake_fd[1], &c, 1) == 1)
+        pthread_join(control->thread, NULL);
+
+    close(control->inotify_fd);
+    close(control->wake_fd[0]);
+    close(control->wake_fd[1]);
+    free(control->fn);
+    free(control);
+}
+#else
+static struct trace_control *trace_control_create(
+    VADisplay dpy,
+    const char *fn,
+    int flag)
+{
+    return NULL;
+}
+
+static void trace_control_destroy(struct trace_control *control)
+{
+}
+#endif
+
+/* CRC32C (Castagnoli), reflected polynomial, slicing-by-8 in software and
+ * the SSE4.2 instruction where the CPU has it */
+static uint32_t va_trace_crc32c_table[8][256];
+
+static uint32_t va_trace_crc32c_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    uint32_t (*t)[256] = va_trace_crc32c_table;
+    uint32_t lo, hi;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (len >= 8) {
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^
+              t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+              t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        p += 8;
+        len -= 8;
     }
+#endif
 
-    if (i >= MAX_TRACE_THREAD_NUM)
-        i = first_free_idx;
+    while (len--)
+        crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
 
-    return i;
+    return crc;
 }
 
-static struct trace_log_file *start_tracing2log_file(
-    struct va_trace *pva_trace)
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("sse4.2")))
+static uint32_t va_trace_crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
 {
-    struct trace_log_files_manager *plog_files_mgr = NULL;
-    struct trace_log_file *plog_file = NULL;
-    pid_t thd_id = va_gettid();
-    int i = 0;
+    unsigned long long crc64 = crc, v;
 
-    LOCK_RESOURCE(pva_trace);
+    while (len >= 8) {
+        memcpy(&v, p, 8);
+        crc64 = __builtin_ia32_crc32di(crc64, v);
+        p += 8;
+        len -= 8;
+    }
 
-    plog_files_mgr = &pva_trace->log_files_manager;
-    i = get_log_file_idx_by_thd(plog_files_mgr, thd_id);
-    if (i < MAX_TRACE_THREAD_NUM) {
-        plog_file = &plog_files_mgr->log_file[i];
-        if (open_tracing_log_file(pva_trace, plog_file, thd_id) < 0) {
-            plog_file = NULL;
+    crc = crc64;
+    while (len--)
+        crc = __builtin_ia32_crc32qi(crc, *p++);
+
+    return crc;
+}
+#endif
+
+static uint32_t (*va_trace_crc32c)(uint32_t crc, const unsigned char *p, size_t len) = va_trace_crc32c_sw;
+
+static void va_trace_crc32c_init(void)
+{
+    uint32_t crc;
+    int i, j;
+
+    for (i = 0; i < 256; i++) {
+        crc = i;
+        for (j = 0; j < 8; j++)
+            crc = (crc >> 1) ^ (crc & 1 ? 0x82f63b78 : 0);
+        va_trace_crc32c_table[0][i] = crc;
+    }
+
+    for (i = 0; i < 256; i++) {
+        crc = va_trace_crc32c_table[0][i];
+        for (j = 1; j < 8; j++) {
+            crc = va_trace_crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+            va_trace_crc32c_table[j][i] = crc;
         }
     }
 
-    UNLOCK_RESOURCE(pva_trace);
-    return plog_file;
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (__builtin_cpu_supports("sse4.2"))
+        va_trace_crc32c = va_trace_crc32c_hw;
+#endif
 }
 
-static void stop_tracing2log_file(
-    struct va_trace *pva_trace,
-    struct trace_log_file *plog_file)
+#if !defined(_WIN32)
+static pthread_once_t va_trace_crc32c_once = PTHREAD_ONCE_INIT;
+#endif
+
+/* LIBVA_TRACE_JSON: the VA_TRACE_* call events as a Chrome trace-event file */
+struct trace_json_context {
+    VAContextID context;
+    VASurfaceID render_target;
+    int open; /* picture slice started on the context track */
+};
+
+/* vaEndPicture waiting for the vaSyncSurface of its render target */
+struct trace_json_flow {
+    VASurfaceID surface;
+    unsigned int id;
+};
+
+struct trace_json {
+    char *fn;
+    FILE *fp;
+    pthread_mutex_t mutex;
+    int pid;
+    int context_pid; /* synthetic process holding the context tracks */
+    unsigned int num_events; /* the first one has no leading comma */
+    unsigned int flow_seq;
+
+    struct trace_json_context *contexts;
+    int num_contexts;
+    struct trace_json_flow *flows;
+    int num_flows;
+};
+
+/* leading scalar arguments of the begin and end events */
+static const struct {
+    const char *name;
+    const char *begin_args[4];
+    const char *end_args[4];
+} va_trace_json_events[] = {
+    [CREATE_CONFIG] = { "vaCreateConfig", { "profile", "entrypoint" }, { "config", "status" } },
+    [DESTROY_CONFIG] = { "vaDestroyConfig", { "config" }, { "status" } },
+    [CREATE_CONTEXT] = { "vaCreateContext", { "config", "width", "height", "flag" }, { "context", "status" } },
+    [DESTROY_CONTEXT] = { "vaDestroyContext", { "context" }, { "status" } },
+    [CREATE_BUFFER] = { "vaCreateBuffer", { "context", "type", "size", "num_elements" }, { "buffer", "status" } },
+    [DESTROY_BUFFER] = { "vaDestroyBuffer", { "buffer" }, { "status" } },
+    [CREATE_SURFACE] = { "vaCreateSurfaces", { "width", "height", "format" }, { "status" } },
+    [DESTROY_SURFACE] = { "vaDestroySurfaces", { NULL }, { "status" } },
+    [BEGIN_PICTURE] = { "vaBeginPicture", { "context", "render_target" }, { "status" } },
+    [RENDER_PICTURE] = { "vaRenderPicture", { "context", "num_buffers" }, { "status" } },
+    [END_PICTURE] = { "vaEndPicture", { "context" }, { "status" } },
+    [BUFFER_DATA] = { NULL },
+    [SYNC_SURFACE] = { "vaSyncSurface", { "surface" }, { "status" } },
+    [SYNC_SURFACE2] = { "vaSyncSurface2", { "surface", "timeout_ns" }, { "status" } },
+    [QUERY_SURFACE_ATTR] = { "vaQuerySurfaceAttributes", { "config" }, { NULL } },
+};
+
+/* above PID_MAX_LIMIT, the context tracks never share a pid with a real process */
+#define TRACE_JSON_CONTEXT_PID(pid) ((int)((unsigned int)(pid) | 0x40000000u))
+
+/* calls open on this thread, so every "B" gets its "E" */
+#define TRACE_JSON_STACK_SIZE   8
+
+static VA_TRACE_TLS struct {
+    unsigned short ids[TRACE_JSON_STACK_SIZE];
+    int depth;
+    VAContextID end_context; /* of the vaEndPicture in progress */
+} va_trace_json_thread;
+
+static struct trace_json *trace_json_open(const char *fn_env)
 {
-    LOCK_RESOURCE(pva_trace);
+    static unsigned int num_files;
+    struct trace_json *json;
+    char env_value[1024];
+    unsigned int n;
+    int pid;
 
-    if (--plog_file->used <= 0) {
-        if (plog_file->fp_log) {
-            fclose(plog_file->fp_log);
-            plog_file->fp_log = NULL;
+#if defined(_WIN32)
+    pid = GetCurrentProcessId();
+#else
+    pid = getpid();
+#endif
+
+    /* one file per display */
+    strncpy(env_value, fn_env, 1024);
+    env_value[1023] = '\0';
+    FILE_NAME_SUFFIX(env_value, 1024, "pid-", (unsigned int)pid);
+    n = VA_TRACE_FETCH_ADD(&num_files, 1);
+    if (n)
+        snprintf(env_value + strlen(env_value), sizeof(env_value) - strlen(env_value), ".%u", n);
+
+    json = calloc(1, sizeof(struct trace_json));
+    if (!json)
+        return NULL;
+
+    json->pid = pid;
+    json->context_pid = TRACE_JSON_CONTEXT_PID(pid);
+    json->fn = strdup(env_value);
+    if (json->fn)
+        json->fp = fopen(json->fn, "w");
+    if (!json->fp) {
+        free(json->fn);
+        free(json);
+
+        return NULL;
+    }
+    pthread_mutex_init(&json->mutex, NULL);
+
+    /* JSON array format, still loadable when the closing bracket is missing */
+    fprintf(json->fp, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"libva\"}}", pid);
+    json->num_events = 1;
+
+    return json;
+}
+
+static void trace_json_close(struct trace_json *json)
+{
+    fprintf(json->fp, "\n]\n");
+    fclose(json->fp);
+
+    pthread_mutex_destroy(&json->mutex);
+    free(json->contexts);
+    free(json->flows);
+    free(json->fn);
+    free(json);
+}
+
+/* must be called with json->mutex held */
+static void trace_json_write(
+    struct trace_json *json,
+    const char *name,
+    const char *ph,
+    uint64_t ts,
+    int pid,
+    int tid,
+    const char *extra)
+{
+    fprintf(json->fp, ",\n{\"name\":\"%s\",\"cat\":\"va\",\"ph\":\"%s\",\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%d%s}",
+            name, ph, (unsigned long long)(ts / 1000), (unsigned int)(ts % 1000),
+            pid, tid, extra ? extra : "");
+    json->num_events++;
+}
+
+/* must be called with json->mutex held, the track is named on first use */
+static struct trace_json_context *trace_json_get_context(struct trace_json *json, VAContextID context)
+{
+    struct trace_json_context *contexts;
+    int i;
+
+    for (i = 0; i < json->num_contexts; i++) {
+        if (json->contexts[i].context == context)
+            return &json->contexts[i];
+    }
+
+    contexts = realloc(json->contexts, sizeof(*contexts) * (json->num_contexts + 1));
+    if (!contexts)
+        return NULL;
+    json->contexts = contexts;
+
+    contexts[json->num_contexts].context = context;
+    contexts[json->num_contexts].render_target = VA_INVALID_SURFACE;
+    contexts[json->num_contexts].open = 0;
+
+    if (!json->num_contexts) {
+        fprintf(json->fp, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"args\":{\"name\":\"libva contexts (%d)\"}}", json->context_pid, json->pid);
+        json->num_events++;
+    }
+    fprintf(json->fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"name\":\"VAContext 0x%08x\"}}", json->context_pid, (int)context, context);
+    json->num_events++;
+
+    return &contexts[json->num_contexts++];
+}
+
+/* must be called with json->mutex held, 0 when the surface has no flow */
+static unsigned int trace_json_flow(struct trace_json *json, VASurfaceID surface, unsigned int id)
+{
+    struct trace_json_flow *flows;
+    unsigned int prev;
+    int i;
+
+    for (i = 0; i < json->num_flows; i++) {
+        if (json->flows[i].surface == surface) {
+            prev = json->flows[i].id;
+            if (id)
+                json->flows[i].id = id;
+            else
+                json->flows[i] = json->flows[--json->num_flows];
+
+            return prev;
         }
     }
 
-    UNLOCK_RESOURCE(pva_trace);
+    if (!id)
+        return 0;
+
+    flows = realloc(json->flows, sizeof(*flows) * (json->num_flows + 1));
+    if (!flows)
+        return 0;
+    json->flows = flows;
+
+    flows[json->num_flows].surface = surface;
+    flows[json->num_flows].id = id;
+    json->num_flows++;
+
+    return 0;
 }
 
-static void refresh_log_file(
-    struct va_trace *pva_trace,
-    struct trace_context *ptra_ctx)
+/* monotonic ns, va_trace.c is also built into va_trace_decode, which only
+ * sees the exported symbols of libva */
+static uint64_t va_trace_timestamp(void)
 {
-    struct trace_log_file *plog_file = NULL;
-    pid_t thd_id = va_gettid();
-    int i = 0;
+#if defined(_WIN32)
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (!frequency.QuadPart)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ull +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ull / frequency.QuadPart;
+#else
+    struct timespec ts;
 
-    plog_file = ptra_ctx->plog_file;
-    if (plog_file && plog_file->thread_id != thd_id) {
-        plog_file = start_tracing2log_file(pva_trace);
-        if (plog_file) {
-            int first_free_idx = -1;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
 
-            ptra_ctx->plog_file = plog_file;
+static unsigned long long va_TraceJsonValue(VAEventData *desc)
+{
+    if (!desc->buf)
+        return 0;
 
-            for (i = 0; i < MAX_TRACE_THREAD_NUM; i++) {
-                if (!ptra_ctx->plog_file_list[i]) {
-                    if (first_free_idx < 0)
-                        first_free_idx = i;
-                } else if (ptra_ctx->plog_file_list[i]->thread_id == thd_id)
-                    break;
+    switch (desc->size) {
+    case 1:
+        return *(uint8_t *)desc->buf;
+    case 2:
+        return *(uint16_t *)desc->buf;
+    case 4:
+        return *(uint32_t *)desc->buf;
+    case 8:
+        return *(uint64_t *)desc->buf;
+    default:
+        return 0;
+    }
+}
+
+static void va_TraceJsonEvent(
+    struct trace_json *json,
+    unsigned short id,
+    unsigned short opcode,
+    unsigned int num,
+    VAEventData *desc)
+{
+    uint64_t ts = va_trace_timestamp();
+    int tid = va_trace_thread_id();
+    struct trace_json_context *ctx;
+    const char * const *names;
+    unsigned long long value[4] = { 0 };
+    char args[256], extra[64];
+    unsigned int flow;
+    int len = 0, i, depth;
+
+    if (id >= ARRAY_SIZE(va_trace_json_events) || !va_trace_json_events[id].name)
+        return;
+    if (opcode != TRACE_BEGIN && opcode != TRACE_END)
+        return;
+
+    names = opcode == TRACE_BEGIN ? va_trace_json_events[id].begin_args :
+            va_trace_json_events[id].end_args;
+    len = snprintf(args, sizeof(args), ",\"args\":{");
+    for (i = 0; i < 4 && i < num && names[i]; i++) {
+        value[i] = va_TraceJsonValue(&desc[i]);
+        len += snprintf(args + len, sizeof(args) - len, "%s\"%s\":%llu", i ? "," : "", names[i], value[i]);
+    }
+    snprintf(args + len, sizeof(args) - len, "}");
+
+    pthread_mutex_lock(&json->mutex);
+
+    if (opcode == TRACE_BEGIN) {
+        depth = va_trace_json_thread.depth;
+        if (depth < TRACE_JSON_STACK_SIZE) {
+            trace_json_write(json, va_trace_json_events[id].name, "B", ts, json->pid, tid, args);
+            va_trace_json_thread.ids[depth++] = id;
+        }
+        va_trace_json_thread.depth = depth;
+
+        switch (id) {
+        case BEGIN_PICTURE:
+            ctx = trace_json_get_context(json, value[0]);
+            if (!ctx)
+                break;
+
+            if (ctx->open)
+                trace_json_write(json, "picture", "E", ts, json->context_pid, ctx->context, NULL);
+            ctx->render_target = value[1];
+            ctx->open = 1;
+            snprintf(extra, sizeof(extra), ",\"args\":{\"render_target\":%u}", ctx->render_target);
+            trace_json_write(json, "picture", "B", ts, json->context_pid, ctx->context, extra);
+            break;
+        case END_PICTURE:
+            va_trace_json_thread.end_context = value[0];
+
+            ctx = trace_json_get_context(json, value[0]);
+            if (!ctx || ctx->render_target == VA_INVALID_SURFACE)
+                break;
+
+            flow = ++json->flow_seq;
+            trace_json_flow(json, ctx->render_target, flow);
+            snprintf(extra, sizeof(extra), ",\"id\":%u", flow);
+            trace_json_write(json, "surface", "s", ts, json->pid, tid, extra);
+            break;
+        case SYNC_SURFACE:
+        case SYNC_SURFACE2:
+            flow = trace_json_flow(json, value[0], 0);
+            if (!flow)
+                break;
+
+            snprintf(extra, sizeof(extra), ",\"id\":%u,\"bp\":\"e\"", flow);
+            trace_json_write(json, "surface", "f", ts, json->pid, tid, extra);
+            break;
+        }
+    } else {
+        /* close what is still open above the call, skip an end without begin */
+        for (depth = va_trace_json_thread.depth; depth > 0; depth--) {
+            if (va_trace_json_thread.ids[depth - 1] == id)
+                break;
+        }
+        if (depth) {
+            while (va_trace_json_thread.depth > depth) {
+                va_trace_json_thread.depth--;
+                trace_json_write(json, va_trace_json_events[va_trace_json_thread.ids[va_trace_json_thread.depth]].name,
+                                 "E", ts, json->pid, tid, NULL);
             }
+            trace_json_write(json, va_trace_json_events[id].name, "E", ts, json->pid, tid, args);
+            va_trace_json_thread.depth = depth - 1;
+        }
 
-            if (i > MAX_TRACE_THREAD_NUM
-                && first_free_idx >= 0)
-                ptra_ctx->plog_file_list[first_free_idx] = plog_file;
+        if (id == END_PICTURE) {
+            ctx = trace_json_get_context(json, va_trace_json_thread.end_context);
+            if (ctx && ctx->open) {
+                trace_json_write(json, "picture", "E", ts, json->context_pid, ctx->context, NULL);
+                ctx->open = 0;
+            }
         }
     }
+
+    pthread_mutex_unlock(&json->mutex);
 }
 
 void va_TraceInit(VADisplay dpy)
@@ -779,6 +2751,7 @@ void va_TraceInit(VADisplay dpy)
     char env_value[1024];
     struct va_trace *pva_trace = calloc(sizeof(struct va_trace), 1);
     struct trace_context *trace_ctx = calloc(sizeof(struct trace_context), 1);
+    int log_binary = 0;
 
     if (pva_trace == NULL || trace_ctx == NULL) {
         free(pva_trace);
@@ -793,6 +2766,11 @@ void va_TraceInit(VADisplay dpy)
     pthread_mutex_init(&pva_trace->resource_mutex, NULL);
     pthread_mutex_init(&pva_trace->context_mutex, NULL);
 
+#if !defined(_WIN32)
+    pthread_once(&va_trace_atfork_once, va_trace_register_atfork);
+#endif
+
+    va_TraceParseRotate(pva_trace);
 
     if (va_parseConfig("LIBVA_TRACE", &env_value[0]) == 0) {
         pva_trace->fn_log_env = strdup(env_value);
@@ -805,12 +2783,20 @@ void va_TraceInit(VADisplay dpy)
                 va_errorMessage(dpy, "Open ftrace entry failed (%s)\n", strerror(errno));
             }
         } else {
+            if (va_parseConfig("LIBVA_TRACE_FORMAT", &env_value[0]) == 0 &&
+                strcmp(env_value, "binary") == 0)
+                log_binary = 1;
+            pva_trace->trace_binary = log_binary;
+
             trace_ctx->plog_file = start_tracing2log_file(pva_trace);
             if (trace_ctx->plog_file) {
-                trace_ctx->plog_file_list[0] = trace_ctx->plog_file;
+                add_log_file_to_ctx(pva_trace, trace_ctx, trace_ctx->plog_file);
                 va_trace_flag = VA_TRACE_FLAG_LOG;
+                if (log_binary)
+                    va_trace_flag |= VA_TRACE_FLAG_BINARY;
 
-                va_infoMessage(dpy, "LIBVA_TRACE is on, save log into %s\n",
+                va_infoMessage(dpy, "LIBVA_TRACE is on, save %s log into %s\n",
+                               log_binary ? "binary" : "text",
                                trace_ctx->plog_file->fn_log);
             } else {
                 va_errorMessage(dpy, "Open file %s failed (%s)\n", env_value, strerror(errno));
@@ -818,6 +2804,17 @@ void va_TraceInit(VADisplay dpy)
         }
     }
 
+    if (va_parseConfig("LIBVA_TRACE_JSON", &env_value[0]) == 0) {
+        pva_trace->json = trace_json_open(env_value);
+        if (pva_trace->json) {
+            va_trace_flag |= VA_TRACE_FLAG_JSON;
+            va_infoMessage(dpy, "LIBVA_TRACE_JSON is on, save call events into %s\n",
+                           pva_trace->json->fn);
+        } else {
+            va_errorMessage(dpy, "Open file %s failed (%s)\n", env_value, strerror(errno));
+        }
+    }
+
     /* may re-get the global settings for multiple context */
     if ((va_trace_flag & (VA_TRACE_FLAG_LOG | VA_TRACE_FLAG_FTRACE)) && (va_parseConfig("LIBVA_TRACE_BUFDATA", NULL) == 0)) {
         va_trace_flag |= VA_TRACE_FLAG_BUFDATA;
@@ -825,10 +2822,27 @@ void va_TraceInit(VADisplay dpy)
         va_infoMessage(dpy, "LIBVA_TRACE_BUFDATA is on, dump buffer into log file\n");
     }
 
+    if (va_trace_flag & VA_TRACE_FLAG_BINARY)
+        write_binary_log_header(trace_ctx->plog_file->fp_log);
+
     /* per-context setting */
     if (va_parseConfig("LIBVA_TRACE_CODEDBUF", &env_value[0]) == 0) {
         pva_trace->fn_codedbuf_env = strdup(env_value);
         va_trace_flag |= VA_TRACE_FLAG_CODEDBUF;
+
+        if (va_parseConfig("LIBVA_TRACE_CODEDBUF_FORMAT", &env_value[0]) == 0) {
+            if (strcmp(env_value, "raw") == 0)
+                pva_trace->codedbuf_format = TRACE_CODEDBUF_RAW;
+            else if (strcmp(env_value, "ivf") == 0)
+                pva_trace->codedbuf_format = TRACE_CODEDBUF_IVF;
+            else if (strcmp(env_value, "annexb") == 0)
+                pva_trace->codedbuf_format = TRACE_CODEDBUF_ANNEXB;
+            else if (strcmp(env_value, "length") == 0)
+                pva_trace->codedbuf_format = TRACE_CODEDBUF_LENGTH;
+            else
+                va_errorMessage(dpy, "Unknown LIBVA_TRACE_CODEDBUF_FORMAT %s, pick the container from the profile\n",
+                                env_value);
+        }
     }
 
     if (va_parseConfig("LIBVA_TRACE_SURFACE", &env_value[0]) == 0) {
@@ -852,6 +2866,17 @@ void va_TraceInit(VADisplay dpy)
         if (strstr(env_value, "vppout"))
             va_trace_flag |= VA_TRACE_FLAG_SURFACE_VPPOUT;
 
+        if (va_parseConfig("LIBVA_TRACE_SURFACE_CRC", NULL) == 0) {
+#if defined(_WIN32)
+            va_trace_crc32c_init();
+#else
+            pthread_once(&va_trace_crc32c_once, va_trace_crc32c_init);
+#endif
+            pva_trace->surface_crc = 1;
+
+            va_infoMessage(dpy, "LIBVA_TRACE_SURFACE_CRC is on, save a CRC32C per plane instead of the surface\n");
+        }
+
         if (va_parseConfig("LIBVA_TRACE_SURFACE_GEOMETRY", &env_value[0]) == 0) {
             char *p = env_value, *q;
 
@@ -871,8 +2896,59 @@ void va_TraceInit(VADisplay dpy)
         }
     }
 
+    /* surface dumps always go through the writer thread, the rendering
+     * thread only takes the staging copy, log and codedbuf writes only with
+     * LIBVA_TRACE_ASYNC */
+    if (((va_trace_flag & (VA_TRACE_FLAG_LOG | VA_TRACE_FLAG_CODEDBUF)) &&
+         va_parseConfig("LIBVA_TRACE_ASYNC", &env_value[0]) == 0) ||
+        (va_trace_flag & (VA_TRACE_FLAG_SURFACE | VA_TRACE_FLAG_SURFACE_VPPOUT))) {
+        unsigned int max_frames = TRACE_WRITER_MAX_FRAMES;
+        int block = 1, skip_frames = 0;
+
+        if (va_parseConfig("LIBVA_TRACE_ASYNC", &env_value[0]) == 0) {
+            block = strcmp(env_value, "drop") != 0;
+            skip_frames = !block;
+            pva_trace->trace_async = 1;
+            va_infoMessage(dpy, "LIBVA_TRACE_ASYNC is on, %s log records when the queue is full\n",
+                           block ? "wait for" : "drop");
+        }
+
+        if (va_parseConfig("LIBVA_TRACE_SURFACE_QUEUE", &env_value[0]) == 0 &&
+            strtoul(env_value, NULL, 0) > 0) {
+            max_frames = strtoul(env_value, NULL, 0);
+            skip_frames = 1;
+        }
+
+        pva_trace->writer = trace_writer_create(block, max_frames, skip_frames);
+        if (!pva_trace->writer)
+            va_errorMessage(dpy, "Start trace writer thread failed, trace synchronously\n");
+        if (pva_trace->trace_async)
+            trace_ctx->writer = pva_trace->writer;
+    }
+
+    if (va_trace_flag) {
+        if (va_parseConfig("LIBVA_TRACE_FILTER", &env_value[0]) == 0)
+            va_TraceParseFilter(dpy, env_value);
+
+        if (va_parseConfig("LIBVA_TRACE_SAMPLE", &env_value[0]) == 0)
+            va_TraceParseSample(dpy, env_value);
+
+        if (va_parseConfig("LIBVA_TRACE_CONTEXTS", &env_value[0]) == 0)
+            va_TraceParseContexts(pva_trace, env_value);
+
+        if (va_parseConfig("LIBVA_TRACE_CONTROL", &env_value[0]) == 0) {
+            pva_trace->control = trace_control_create(dpy, env_value, va_trace_flag);
+            if (pva_trace->control)
+                va_infoMessage(dpy, "LIBVA_TRACE_CONTROL is on, control tracing through %s\n",
+                               env_value);
+            else
+                va_errorMessage(dpy, "Watch control file %s failed, trace from the start\n",
+                                env_value);
+        }
+    }
+
     trace_ctx->trace_context = VA_INVALID_ID;
-    pva_trace->ptra_ctx[MAX_TRACE_CTX_NUM] = trace_ctx;
+    pva_trace->ptra_vir_ctx = trace_ctx;
 
     ((VADisplayContextP)dpy)->vatrace = (void *)pva_trace;
 
@@ -889,6 +2965,28 @@ void va_TraceEnd(VADisplay dpy)
     if (!pva_trace)
         return;
 
+    if (pva_trace->control) {
+        trace_control_destroy(pva_trace->control);
+        pva_trace->control = NULL;
+    }
+
+    if (pva_trace->writer) {
+        unsigned long skipped;
+        unsigned long dropped = trace_writer_destroy(pva_trace->writer, &skipped);
+
+        if (dropped)
+            va_infoMessage(dpy, "LIBVA_TRACE_ASYNC dropped %lu log records\n", dropped);
+        if (skipped)
+            va_infoMessage(dpy, "LIBVA_TRACE_SURFACE skipped %lu frames, the writer was behind\n",
+                           skipped);
+        pva_trace->writer = NULL;
+    }
+
+    if (pva_trace->json) {
+        trace_json_close(pva_trace->json);
+        pva_trace->json = NULL;
+    }
+
     if (pva_trace->fn_log_env)
         free(pva_trace->fn_log_env);
 
@@ -898,30 +2996,41 @@ void va_TraceEnd(VADisplay dpy)
     if (pva_trace->fn_surface_env)
         free(pva_trace->fn_surface_env);
 
-    for (i = 0; i < MAX_TRACE_BUF_INFO_HASH_LEVEL; i++)
-        if (pva_trace->buf_manager.pbuf_info[i])
-            free(pva_trace->buf_manager.pbuf_info[i]);
+    if (pva_trace->trace_contexts)
+        free(pva_trace->trace_contexts);
 
-    for (i = 0; i < MAX_TRACE_THREAD_NUM; i++) {
+    trace_id_map_free(&pva_trace->context_map);
+    trace_id_map_free(&pva_trace->config_map);
+    trace_id_map_free(&pva_trace->buf_map);
+
+    for (i = 0; pva_trace->log_files_manager.log_file &&
+         i < pva_trace->log_files_manager.log_file->size; i++) {
         struct trace_log_file *plog_file = NULL;
 
-        plog_file = &pva_trace->log_files_manager.log_file[i];
+        plog_file = pva_trace->log_files_manager.log_file->ptr[i];
         if (plog_file) {
             if (plog_file->fn_log)
                 free(plog_file->fn_log);
 
             if (plog_file->fp_log)
                 fclose(plog_file->fp_log);
+
+            free(plog_file);
         }
     }
+    trace_ptr_table_free(&pva_trace->log_files_manager.log_file);
 
-    for (i = 0; i < MAX_TRACE_CTX_NUM; i++) {
+    for (i = 0; pva_trace->config_info && i < pva_trace->config_info->size; i++)
+        free(pva_trace->config_info->ptr[i]);
+    trace_ptr_table_free(&pva_trace->config_info);
+
+    for (i = 0; pva_trace->ptra_ctx && i < pva_trace->ptra_ctx->size; i++) {
         struct trace_context *trace_ctx = NULL;
 
         if (pva_trace->context_num <= 0)
             break;
 
-        trace_ctx = pva_trace->ptra_ctx[i];
+        trace_ctx = pva_trace->ptra_ctx->ptr[i];
         if (trace_ctx) {
             if (trace_ctx->trace_codedbuf_fn)
                 free(trace_ctx->trace_codedbuf_fn);
@@ -935,11 +3044,17 @@ void va_TraceEnd(VADisplay dpy)
             if (trace_ctx->trace_fp_surface)
                 fclose(trace_ctx->trace_fp_surface);
 
-            free(pva_trace->ptra_ctx[i]);
+            trace_ptr_table_free(&trace_ctx->plog_file_list);
+            free(trace_ctx);
             pva_trace->context_num--;
         }
     }
-    free(pva_trace->ptra_ctx[MAX_TRACE_CTX_NUM]);
+    trace_ptr_table_free(&pva_trace->ptra_ctx);
+
+    if (pva_trace->ptra_vir_ctx) {
+        trace_ptr_table_free(&pva_trace->ptra_vir_ctx->plog_file_list);
+        free(pva_trace->ptra_vir_ctx);
+    }
     // close ftrace file if have
     if (pva_trace->ftrace_fd >= 0) {
         close(pva_trace->ftrace_fd);
@@ -952,6 +3067,97 @@ void va_TraceEnd(VADisplay dpy)
     ((VADisplayContextP)dpy)->vatrace = NULL;
 }
 
+static void va_TraceWriteRecord(
+    struct trace_context *trace_ctx,
+    unsigned int type,
+    const void *head,
+    unsigned int head_size,
+    const void *data,
+    unsigned int data_size)
+{
+    VATraceRecord record;
+    struct trace_chunk *chunk;
+    struct timeval tv;
+    FILE *fp = NULL;
+
+    if (!(va_trace_flag & VA_TRACE_FLAG_BINARY)
+        || !trace_ctx->plog_file
+        || !trace_ctx->plog_file->fp_log)
+        return;
+
+    fp = trace_ctx->plog_file->fp_log;
+
+    record.size = head_size + data_size;
+    record.type = type;
+    record.reserved = 0;
+    record.context = trace_ctx->trace_context;
+    record.thread_id = trace_ctx->plog_file->thread_id;
+    record.timestamp = 0;
+    if (gettimeofday(&tv, NULL) == 0)
+        record.timestamp = (uint64_t)tv.tv_sec * 1000000000 + (uint64_t)tv.tv_usec * 1000;
+
+    if (!trace_ctx->writer) {
+        fwrite(&record, sizeof(record), 1, fp);
+        if (head_size)
+            fwrite(head, head_size, 1, fp);
+        if (data_size)
+            fwrite(data, data_size, 1, fp);
+        return;
+    }
+
+    chunk = trace_chunk_new(fp, sizeof(record) + record.size);
+    if (!chunk)
+        return;
+
+    memcpy(chunk->data, &record, sizeof(record));
+    if (head_size)
+        memcpy(chunk->data + sizeof(record), head, head_size);
+    if (data_size)
+        memcpy(chunk->data + sizeof(record) + head_size, data, data_size);
+    trace_writer_push(trace_ctx->writer, chunk, 1);
+}
+
+/* format prefix and msg into one piece, for binary records and the writer thread */
+static void va_TraceVFormat(
+    struct trace_context *trace_ctx,
+    unsigned int type,
+    const char *prefix,
+    const char *msg,
+    va_list args)
+{
+    char text[1024];
+    char *ptext = text;
+    size_t prefix_len = prefix ? strlen(prefix) : 0;
+    va_list args_copy;
+    int len;
+
+    if (prefix_len)
+        memcpy(text, prefix, prefix_len);
+
+    va_copy(args_copy, args);
+    len = vsnprintf(text + prefix_len, sizeof(text) - prefix_len, msg, args_copy);
+    va_end(args_copy);
+    if (len < 0)
+        return;
+
+    if (prefix_len + len >= sizeof(text)) {
+        ptext = malloc(prefix_len + len + 1);
+        if (!ptext)
+            return;
+        if (prefix_len)
+            memcpy(ptext, prefix, prefix_len);
+        vsnprintf(ptext + prefix_len, len + 1, msg, args);
+    }
+
+    if (va_trace_flag & VA_TRACE_FLAG_BINARY)
+        va_TraceWriteRecord(trace_ctx, type, ptext, prefix_len + len, NULL, 0);
+    else
+        va_TraceFileWrite(trace_ctx, trace_ctx->plog_file->fp_log, ptext, prefix_len + len, 1);
+
+    if (ptext != text)
+        free(ptext);
+}
+
 static void va_TraceVPrint(struct trace_context *trace_ctx, const char *msg, va_list args)
 {
     FILE *fp = NULL;
@@ -962,8 +3168,11 @@ static void va_TraceVPrint(struct trace_context *trace_ctx, const char *msg, va_
 
     fp = trace_ctx->plog_file->fp_log;
     if (msg)  {
-        vfprintf(fp, msg, args);
-    } else
+        if ((va_trace_flag & VA_TRACE_FLAG_BINARY) || trace_ctx->writer)
+            va_TraceVFormat(trace_ctx, VA_TRACE_RECORD_PRINT, NULL, msg, args);
+        else
+            vfprintf(fp, msg, args);
+    } else if (!trace_ctx->writer)
         fflush(fp);
 }
 
@@ -975,17 +3184,69 @@ static void va_TracePrint(struct trace_context *trace_ctx, const char *msg, ...)
     va_end(args);
 }
 
+/* append text that is already formatted, as va_TracePrint would */
+static void va_TraceWriteText(struct trace_context *trace_ctx, const char *text, size_t len)
+{
+    if (!(va_trace_flag & VA_TRACE_FLAG_LOG)
+        || !trace_ctx->plog_file)
+        return;
+
+    if (va_trace_flag & VA_TRACE_FLAG_BINARY)
+        va_TraceWriteRecord(trace_ctx, VA_TRACE_RECORD_PRINT, text, len, NULL, 0);
+    else
+        va_TraceFileWrite(trace_ctx, trace_ctx->plog_file->fp_log, text, len, 1);
+}
+
 static void va_TraceMsg(struct trace_context *trace_ctx, const char *msg, ...)
 {
     va_list args;
     struct timeval tv;
+    int have_tv = 0;
 
     if (!msg) {
         va_TracePrint(trace_ctx, msg);
         return;
     }
 
-    if (gettimeofday(&tv, NULL) == 0)
+    if (!(va_trace_flag & VA_TRACE_FLAG_LOG)
+        || !trace_ctx->plog_file)
+        return;
+
+    /* the prefix is rebuilt from the record header on decode */
+    if (va_trace_flag & VA_TRACE_FLAG_BINARY) {
+        va_start(args, msg);
+        va_TraceVFormat(trace_ctx, VA_TRACE_RECORD_MSG, NULL, msg, args);
+        va_end(args);
+        return;
+    }
+
+    if (trace_ctx->trace_replay_ts) {
+        tv.tv_sec = trace_ctx->trace_replay_ts / 1000000000;
+        tv.tv_usec = (trace_ctx->trace_replay_ts % 1000000000) / 1000;
+        have_tv = 1;
+    } else if (gettimeofday(&tv, NULL) == 0)
+        have_tv = 1;
+
+    /* one queued write per line instead of three */
+    if (trace_ctx->writer) {
+        char prefix[64];
+        int len = 0;
+
+        if (have_tv)
+            len = snprintf(prefix, sizeof(prefix), "[%04d.%06d]",
+                           (unsigned int)tv.tv_sec & 0xffff, (unsigned int)tv.tv_usec);
+        if (trace_ctx->trace_context != VA_INVALID_ID)
+            snprintf(prefix + len, sizeof(prefix) - len, "[ctx 0x%08x]", trace_ctx->trace_context);
+        else
+            snprintf(prefix + len, sizeof(prefix) - len, "[ctx       none]");
+
+        va_start(args, msg);
+        va_TraceVFormat(trace_ctx, VA_TRACE_RECORD_PRINT, prefix, msg, args);
+        va_end(args);
+        return;
+    }
+
+    if (have_tv)
         va_TracePrint(trace_ctx, "[%04d.%06d]",
                       (unsigned int)tv.tv_sec & 0xffff, (unsigned int)tv.tv_usec);
 
@@ -1241,19 +3502,81 @@ static void va_TraceRetrieveImageInfo(TracePictureLayout * pLayout)
     }
 }
 
+/* LIBVA_TRACE_SURFACE_CRC, one line per frame instead of the planes */
+static void va_TraceSurfaceCrc(
+    struct trace_context *trace_ctx,
+    VAImage *image,
+    unsigned char *buffer,
+    TracePictureLayout *layout)
+{
+    char line[256];
+    unsigned char *src;
+    uint32_t crc;
+    unsigned int i, j;
+    int len;
+
+    len = snprintf(line, sizeof(line), "frame %u surface 0x%08x fourcc 0x%08x %ux%u crc32c",
+                   trace_ctx->trace_frame_no - 1, trace_ctx->trace_rendertarget,
+                   layout->fourcc, layout->width, layout->height);
+
+    for (i = 0; i < layout->num_planes && i < 3; i++) {
+        src = buffer + image->offsets[i] +
+              image->pitches[i] * layout->plane_start_y[i] + layout->plane_start_x[i];
+
+        crc = 0xffffffff;
+        if (image->pitches[i] == layout->plane_width[i])
+            crc = va_trace_crc32c(crc, src, (size_t)layout->plane_width[i] * layout->plane_height[i]);
+        else {
+            for (j = 0; j < layout->plane_height[i]; j++) {
+                crc = va_trace_crc32c(crc, src, layout->plane_width[i]);
+                src += image->pitches[i];
+            }
+        }
+
+        len += snprintf(line + len, sizeof(line) - len, " %08x", ~crc);
+    }
+    len += snprintf(line + len, sizeof(line) - len, "\n");
+
+    va_TraceFileWrite(trace_ctx, trace_ctx->trace_fp_surface, line, len, 0);
+    if (!trace_ctx->writer)
+        fflush(trace_ctx->trace_fp_surface);
+}
+
+/* append one plane to the staging copy, in one go when it has no padding */
+static unsigned char *va_TraceSurfacePlane(
+    unsigned char *dst,
+    unsigned char *src,
+    unsigned int stride,
+    unsigned int width,
+    unsigned int height)
+{
+    unsigned int i;
+
+    if (stride == width) {
+        memcpy(dst, src, (size_t)width * height);
+        return dst + (size_t)width * height;
+    }
+
+    for (i = 0; i < height; i++) {
+        memcpy(dst, src, width);
+        dst += width;
+        src += stride;
+    }
+
+    return dst;
+}
+
+/* snapshot the render target through a derived image into a staging copy,
+ * which is written as one block, by the writer thread when there is one */
 static void va_TraceSurface(VADisplay dpy, VAContextID context)
 {
     unsigned int i;
-    unsigned int fourcc; /* following are output argument */
-    unsigned int luma_stride;
-    unsigned int chroma_u_stride;
-    unsigned int chroma_v_stride;
-    unsigned int luma_offset;
-    unsigned int chroma_u_offset;
-    unsigned int chroma_v_offset;
-    unsigned int buffer_name;
+    VAImage image;
     void *buffer = NULL;
-    unsigned char *Y_data, *U_data, *V_data, *tmp;
+    unsigned char *src, *dst;
+    struct trace_chunk *chunk = NULL;
+    size_t frame_size = 0;
+    int reserved = 0;
     VAStatus va_status;
     TracePictureLayout layout = {0};
     DPY2TRACECTX(dpy, context, VA_INVALID_ID);
@@ -1265,87 +3588,99 @@ static void va_TraceSurface(VADisplay dpy, VAContextID context)
 
     va_TraceMsg(trace_ctx, NULL);
 
-    va_status = vaLockSurface(
-                    dpy,
-                    trace_ctx->trace_rendertarget,
-                    &fourcc,
-                    &luma_stride, &chroma_u_stride, &chroma_v_stride,
-                    &luma_offset, &chroma_u_offset, &chroma_v_offset,
-                    &buffer_name, &buffer);
+    /* checksums are never skipped, every frame is compared */
+    if (pva_trace->writer && !pva_trace->surface_crc) {
+        if (trace_writer_reserve_frame(pva_trace->writer) < 0) {
+            va_TraceMsg(trace_ctx, "\tskipped, the surface writer is behind\n");
+            va_TraceMsg(trace_ctx, NULL);
+            return;
+        }
+        reserved = 1;
+    }
 
+    va_status = vaDeriveImage(dpy, trace_ctx->trace_rendertarget, &image);
     if (va_status != VA_STATUS_SUCCESS) {
-        va_TraceMsg(trace_ctx, "Error:vaLockSurface failed\n");
-        return;
+        va_TraceMsg(trace_ctx, "Error:vaDeriveImage failed\n");
+        goto RELEASE;
     }
 
-    va_TraceMsg(trace_ctx, "\tfourcc = 0x%08x\n", fourcc);
-    va_TraceMsg(trace_ctx, "\twidth = %d\n", trace_ctx->trace_frame_width);
-    va_TraceMsg(trace_ctx, "\theight = %d\n", trace_ctx->trace_frame_height);
-    va_TraceMsg(trace_ctx, "\tluma_stride = %d\n", luma_stride);
-    va_TraceMsg(trace_ctx, "\tchroma_u_stride = %d\n", chroma_u_stride);
-    va_TraceMsg(trace_ctx, "\tchroma_v_stride = %d\n", chroma_v_stride);
-    va_TraceMsg(trace_ctx, "\tluma_offset = %d\n", luma_offset);
-    va_TraceMsg(trace_ctx, "\tchroma_u_offset = %d\n", chroma_u_offset);
-    va_TraceMsg(trace_ctx, "\tchroma_v_offset = %d\n", chroma_v_offset);
-
-    if (buffer == NULL) {
-        va_TraceMsg(trace_ctx, "Error:vaLockSurface return NULL buffer\n");
+    va_status = vaMapBuffer(dpy, image.buf, &buffer);
+    if (va_status != VA_STATUS_SUCCESS || buffer == NULL) {
+        va_TraceMsg(trace_ctx, "Error:vaMapBuffer of the derived image failed\n");
         va_TraceMsg(trace_ctx, NULL);
 
-        vaUnlockSurface(dpy, trace_ctx->trace_rendertarget);
-        return;
+        vaDestroyImage(dpy, image.image_id);
+        goto RELEASE;
     }
+
+    va_TraceMsg(trace_ctx, "\tfourcc = 0x%08x\n", image.format.fourcc);
+    va_TraceMsg(trace_ctx, "\twidth = %d\n", trace_ctx->trace_frame_width);
+    va_TraceMsg(trace_ctx, "\theight = %d\n", trace_ctx->trace_frame_height);
+    va_TraceMsg(trace_ctx, "\tluma_stride = %d\n", image.pitches[0]);
+    va_TraceMsg(trace_ctx, "\tchroma_u_stride = %d\n", image.pitches[1]);
+    va_TraceMsg(trace_ctx, "\tchroma_v_stride = %d\n", image.pitches[2]);
+    va_TraceMsg(trace_ctx, "\tluma_offset = %d\n", image.offsets[0]);
+    va_TraceMsg(trace_ctx, "\tchroma_u_offset = %d\n", image.offsets[1]);
+    va_TraceMsg(trace_ctx, "\tchroma_v_offset = %d\n", image.offsets[2]);
     va_TraceMsg(trace_ctx, "\tbuffer location = 0x%p\n", buffer);
     va_TraceMsg(trace_ctx, NULL);
 
-    Y_data = (unsigned char*)buffer;
-    U_data = (unsigned char*)buffer + chroma_u_offset;
-    V_data = (unsigned char*)buffer + chroma_v_offset;
-
     layout.width = trace_ctx->trace_surface_width;
     layout.height = trace_ctx->trace_surface_height;
     layout.start_x = trace_ctx->trace_surface_xoff;
     layout.start_y = trace_ctx->trace_surface_yoff;
-    layout.fourcc = fourcc;
+    layout.fourcc = image.format.fourcc;
 
     va_TraceRetrieveImageInfo(&layout);
 
-    tmp = Y_data + luma_stride * layout.plane_start_y[0];
+    if (pva_trace->surface_crc) {
+        va_TraceSurfaceCrc(trace_ctx, &image, buffer, &layout);
 
-    for (i = 0; i < layout.plane_height[0]; i++) {
-        fwrite(tmp + layout.plane_start_x[0],
-               layout.plane_width[0],
-               1, trace_ctx->trace_fp_surface);
+        vaUnmapBuffer(dpy, image.buf);
+        vaDestroyImage(dpy, image.image_id);
 
-        tmp += luma_stride;
+        va_TraceMsg(trace_ctx, NULL);
+        return;
     }
 
-    if (layout.num_planes > 1) {
-        tmp = U_data + chroma_u_stride * layout.plane_start_y[1];
-        for (i = 0; i < layout.plane_height[1]; i++) {
-            fwrite(tmp + layout.plane_start_x[1],
-                   layout.plane_width[1],
-                   1, trace_ctx->trace_fp_surface);
-            tmp += chroma_u_stride;
-        }
-    }
+    for (i = 0; i < layout.num_planes && i < 3; i++)
+        frame_size += (size_t)layout.plane_width[i] * layout.plane_height[i];
 
-    if (layout.num_planes > 2) {
-        tmp = V_data + chroma_v_stride * layout.plane_start_y[2];
-        for (i = 0; i < layout.plane_height[2]; i++) {
-            fwrite(tmp + layout.plane_start_x[2],
-                   layout.plane_width[2],
-                   1, trace_ctx->trace_fp_surface);
-            tmp += chroma_v_stride;
+    chunk = trace_chunk_new(trace_ctx->trace_fp_surface, frame_size);
+    if (chunk) {
+        chunk->frame = reserved;
+
+        dst = chunk->data;
+        for (i = 0; i < layout.num_planes && i < 3; i++) {
+            src = (unsigned char *)buffer + image.offsets[i] +
+                  image.pitches[i] * layout.plane_start_y[i] + layout.plane_start_x[i];
+            dst = va_TraceSurfacePlane(dst, src, image.pitches[i],
+                                       layout.plane_width[i], layout.plane_height[i]);
         }
-    }
+    } else
+        va_TraceMsg(trace_ctx, "Error:allocate surface copy failed\n");
 
+    /* the surface is free again before any disk I/O */
+    vaUnmapBuffer(dpy, image.buf);
+    vaDestroyImage(dpy, image.image_id);
 
-    fflush(trace_ctx->trace_fp_surface);
+    if (!chunk)
+        goto RELEASE;
 
-    vaUnlockSurface(dpy, trace_ctx->trace_rendertarget);
+    if (reserved)
+        trace_writer_push(pva_trace->writer, chunk, 0);
+    else {
+        fwrite(chunk->data, chunk->size, 1, trace_ctx->trace_fp_surface);
+        fflush(trace_ctx->trace_fp_surface);
+        free(chunk);
+    }
 
     va_TraceMsg(trace_ctx, NULL);
+    return;
+
+RELEASE:
+    if (reserved)
+        trace_writer_release_frame(pva_trace->writer);
 }
 
 
@@ -1355,6 +3690,8 @@ void va_TraceInitialize(
     int *minor_version      /* out */
 )
 {
+    TRACE_FILTER(TRACE_CAT_DISPLAY);
+
     DPY2TRACE_VIRCTX(dpy);
     TRACE_FUNCNAME(idx);
 
@@ -1369,6 +3706,8 @@ void va_TraceTerminate(
     VADisplay dpy
 )
 {
+    TRACE_FILTER(TRACE_CAT_DISPLAY);
+
     DPY2TRACE_VIRCTX(dpy);
     TRACE_FUNCNAME(idx);
     va_TraceMsg(trace_ctx, NULL);
@@ -1389,18 +3728,20 @@ void va_TraceCreateConfig(
 
     DPY2TRACE_VIRCTX(dpy);
 
-    TRACE_FUNCNAME(idx);
+    if (TRACE_CATEGORY_ON(TRACE_CAT_CONTEXT)) {
+        TRACE_FUNCNAME(idx);
 
-    va_TraceMsg(trace_ctx, "\tprofile = %d, %s\n", profile, vaProfileStr(profile));
-    va_TraceMsg(trace_ctx, "\tentrypoint = %d, %s\n", entrypoint, vaEntrypointStr(entrypoint));
-    va_TraceMsg(trace_ctx, "\tnum_attribs = %d\n", num_attribs);
-    if (attrib_list) {
-        for (i = 0; i < num_attribs; i++) {
-            va_TraceMsg(trace_ctx, "\t\tattrib_list[%d].type = 0x%08x, %s\n", i, attrib_list[i].type, vaConfigAttribTypeStr(attrib_list[i].type));
-            va_TraceMsg(trace_ctx, "\t\tattrib_list[%d].value = 0x%08x\n", i, attrib_list[i].value);
+        va_TraceMsg(trace_ctx, "\tprofile = %d, %s\n", profile, vaProfileStr(profile));
+        va_TraceMsg(trace_ctx, "\tentrypoint = %d, %s\n", entrypoint, vaEntrypointStr(entrypoint));
+        va_TraceMsg(trace_ctx, "\tnum_attribs = %d\n", num_attribs);
+        if (attrib_list) {
+            for (i = 0; i < num_attribs; i++) {
+                va_TraceMsg(trace_ctx, "\t\tattrib_list[%d].type = 0x%08x, %s\n", i, attrib_list[i].type, vaConfigAttribTypeStr(attrib_list[i].type));
+                va_TraceMsg(trace_ctx, "\t\tattrib_list[%d].value = 0x%08x\n", i, attrib_list[i].value);
+            }
         }
+        va_TraceMsg(trace_ctx, NULL);
     }
-    va_TraceMsg(trace_ctx, NULL);
 
     add_trace_config_info(pva_trace, *config_id, profile, entrypoint);
 
@@ -1414,10 +3755,12 @@ void va_TraceDestroyConfig(
 {
     DPY2TRACE_VIRCTX(dpy);
 
-    TRACE_FUNCNAME(idx);
+    if (TRACE_CATEGORY_ON(TRACE_CAT_CONTEXT)) {
+        TRACE_FUNCNAME(idx);
 
-    va_TraceMsg(trace_ctx, "\tconfig = 0x%08x\n", config_id);
-    va_TraceMsg(trace_ctx, NULL);
+        va_TraceMsg(trace_ctx, "\tconfig = 0x%08x\n", config_id);
+        va_TraceMsg(trace_ctx, NULL);
+    }
 
     delete_trace_config_info(pva_trace, config_id);
 
@@ -1581,6 +3924,9 @@ void va_TraceCreateSurfaces(
 )
 {
     int i;
+
+    TRACE_FILTER(TRACE_CAT_SURFACES);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -1609,6 +3955,9 @@ void va_TraceDestroySurfaces(
 )
 {
     int i;
+
+    TRACE_FILTER(TRACE_CAT_SURFACES);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -1633,15 +3982,16 @@ static void internal_TraceUpdateContext(
 )
 {
     struct trace_context *trace_ctx = NULL;
+    struct trace_ptr_table *list = NULL;
     int i = 0, delete = 1;
-    pid_t thd_id = va_gettid();
+    pid_t thd_id = va_trace_thread_id();
 
-    if (tra_ctx_idx >= MAX_TRACE_CTX_NUM)
+    if (tra_ctx_idx < 0)
         return;
 
     LOCK_RESOURCE(pva_trace);
 
-    trace_ctx = pva_trace->ptra_ctx[tra_ctx_idx];
+    trace_ctx = trace_ptr_table_get(&pva_trace->ptra_ctx, tra_ctx_idx);
     if (trace_ctx) {
         if (!new_trace_ctx &&
             trace_ctx->created_thd_id != thd_id
@@ -1649,22 +3999,31 @@ static void internal_TraceUpdateContext(
             delete = 0;
         } else {
             pva_trace->context_num--;
-            pva_trace->ptra_ctx[tra_ctx_idx] = NULL;
+            trace_ptr_table_set(&pva_trace->ptra_ctx, tra_ctx_idx, NULL);
+            trace_id_map_remove(&pva_trace->context_map,
+                                trace_ctx->trace_context);
         }
     }
 
     if (new_trace_ctx) {
         new_trace_ctx->created_thd_id = thd_id;
-        pva_trace->ptra_ctx[tra_ctx_idx] = new_trace_ctx;
+        trace_ptr_table_set(&pva_trace->ptra_ctx, tra_ctx_idx, new_trace_ctx);
         pva_trace->context_num++;
+        trace_id_map_insert(&pva_trace->context_map,
+                            new_trace_ctx->trace_context, tra_ctx_idx);
     }
 
     UNLOCK_RESOURCE(pva_trace);
 
     if (trace_ctx && delete) {
-        for (i = 0; i < MAX_TRACE_THREAD_NUM; i++)
-            if (trace_ctx->plog_file_list[i])
-                stop_tracing2log_file(pva_trace, trace_ctx->plog_file_list[i]);
+        list = trace_ctx->plog_file_list;
+        for (i = 0; list && i < list->size && list->ptr[i]; i++)
+            stop_tracing2log_file(pva_trace, list->ptr[i]);
+        trace_ptr_table_free(&trace_ctx->plog_file_list);
+
+        if (pva_trace->writer &&
+            (trace_ctx->trace_fp_codedbuf || trace_ctx->trace_fp_surface))
+            trace_writer_sync(pva_trace->writer);
 
         if (trace_ctx->trace_codedbuf_fn)
             free(trace_ctx->trace_codedbuf_fn);
@@ -1678,8 +4037,6 @@ static void internal_TraceUpdateContext(
         if (trace_ctx->trace_fp_surface)
             fclose(trace_ctx->trace_fp_surface);
 
-        //delete_trace_all_context_buf(pva_trace, context);
-
         free(trace_ctx);
     }
 }
@@ -1697,8 +4054,8 @@ void va_TraceCreateContext(
 {
     struct va_trace *pva_trace = NULL;
     struct trace_context *trace_ctx = NULL;
+    struct trace_config_info *pconfig_info = NULL;
     int tra_ctx_id = 0;
-    int encode = 0, decode = 0, jpeg = 0, vpp = 0;
     int i;
 
     pva_trace = (struct va_trace *)(((VADisplayContextP)dpy)->vatrace);
@@ -1710,10 +4067,14 @@ void va_TraceCreateContext(
         return;
     }
 
+    /* the hooks of a context left out find no trace state and return */
+    if (!trace_context_allowed(pva_trace, *context))
+        return;
+
     LOCK_CONTEXT(pva_trace);
 
     tra_ctx_id = get_free_ctx_idx(pva_trace, *context);
-    if (tra_ctx_id >= MAX_TRACE_CTX_NUM) {
+    if (tra_ctx_id < 0) {
         va_errorMessage(dpy, "Can't get trace context for ctx 0x%08x\n",
                         *context);
 
@@ -1728,15 +4089,18 @@ void va_TraceCreateContext(
         goto FAIL;
     }
 
-    i = get_valid_config_idx(pva_trace, config_id);
-    if (i >= MAX_TRACE_CTX_NUM) {
+    pconfig_info = trace_ptr_table_get(&pva_trace->config_info,
+                                       get_valid_config_idx(pva_trace, config_id));
+    if (!pconfig_info) {
         va_errorMessage(dpy, "Can't get trace config id for ctx 0x%08x cfg %x\n",
                         *context, config_id);
 
         goto FAIL;
     }
-    trace_ctx->trace_profile = pva_trace->config_info[i].trace_profile;
-    trace_ctx->trace_entrypoint = pva_trace->config_info[i].trace_entrypoint;
+    trace_ctx->trace_profile = pconfig_info->trace_profile;
+    trace_ctx->trace_entrypoint = pconfig_info->trace_entrypoint;
+    if (pva_trace->trace_async)
+        trace_ctx->writer = pva_trace->writer;
 
     if (va_trace_flag & VA_TRACE_FLAG_LOG) {
         trace_ctx->plog_file = start_tracing2log_file(pva_trace);
@@ -1749,23 +4113,25 @@ void va_TraceCreateContext(
             va_infoMessage(dpy, "Save context 0x%08x into log file %s\n", *context,
                            trace_ctx->plog_file->fn_log);
 
-        trace_ctx->plog_file_list[0] = trace_ctx->plog_file;
+        add_log_file_to_ctx(pva_trace, trace_ctx, trace_ctx->plog_file);
     }
 
     trace_ctx->trace_context = *context;
-    TRACE_FUNCNAME(idx);
-    va_TraceMsg(trace_ctx, "\tcontext = 0x%08x va_trace_flag 0x%x\n", *context, va_trace_flag);
-    va_TraceMsg(trace_ctx, "\tprofile = %d,%s entrypoint = %d,%s\n", trace_ctx->trace_profile,
-                vaProfileStr(trace_ctx->trace_profile), trace_ctx->trace_entrypoint,
-                vaEntrypointStr(trace_ctx->trace_entrypoint));
-    va_TraceMsg(trace_ctx, "\tconfig = 0x%08x\n", config_id);
-    va_TraceMsg(trace_ctx, "\twidth = %d\n", picture_width);
-    va_TraceMsg(trace_ctx, "\theight = %d\n", picture_height);
-    va_TraceMsg(trace_ctx, "\tflag = 0x%08x\n", flag);
-    va_TraceMsg(trace_ctx, "\tnum_render_targets = %d\n", num_render_targets);
-    if (render_targets) {
-        for (i = 0; i < num_render_targets; i++)
-            va_TraceMsg(trace_ctx, "\t\trender_targets[%d] = 0x%08x\n", i, render_targets[i]);
+    if (TRACE_CATEGORY_ON(TRACE_CAT_CONTEXT)) {
+        TRACE_FUNCNAME(idx);
+        va_TraceMsg(trace_ctx, "\tcontext = 0x%08x va_trace_flag 0x%x\n", *context, va_trace_flag);
+        va_TraceMsg(trace_ctx, "\tprofile = %d,%s entrypoint = %d,%s\n", trace_ctx->trace_profile,
+                    vaProfileStr(trace_ctx->trace_profile), trace_ctx->trace_entrypoint,
+                    vaEntrypointStr(trace_ctx->trace_entrypoint));
+        va_TraceMsg(trace_ctx, "\tconfig = 0x%08x\n", config_id);
+        va_TraceMsg(trace_ctx, "\twidth = %d\n", picture_width);
+        va_TraceMsg(trace_ctx, "\theight = %d\n", picture_height);
+        va_TraceMsg(trace_ctx, "\tflag = 0x%08x\n", flag);
+        va_TraceMsg(trace_ctx, "\tnum_render_targets = %d\n", num_render_targets);
+        if (render_targets) {
+            for (i = 0; i < num_render_targets; i++)
+                va_TraceMsg(trace_ctx, "\t\trender_targets[%d] = 0x%08x\n", i, render_targets[i]);
+        }
     }
 
     trace_ctx->trace_frame_no = 0;
@@ -1774,35 +4140,23 @@ void va_TraceCreateContext(
     trace_ctx->trace_frame_width = picture_width;
     trace_ctx->trace_frame_height = picture_height;
 
+    if (va_trace_flag & VA_TRACE_FLAG_BINARY) {
+        VATraceRecordContext record;
+
+        record.profile = trace_ctx->trace_profile;
+        record.entrypoint = trace_ctx->trace_entrypoint;
+        record.width = picture_width;
+        record.height = picture_height;
+        va_TraceWriteRecord(trace_ctx, VA_TRACE_RECORD_CREATE_CONTEXT,
+                            &record, sizeof(record), NULL, 0);
+    }
+
     if (trace_ctx->trace_surface_width == 0)
         trace_ctx->trace_surface_width = picture_width;
     if (trace_ctx->trace_surface_height == 0)
         trace_ctx->trace_surface_height = picture_height;
 
-    /* avoid to create so many empty files */
-    encode = (trace_ctx->trace_entrypoint == VAEntrypointEncSlice);
-    decode = (trace_ctx->trace_entrypoint == VAEntrypointVLD);
-    jpeg = (trace_ctx->trace_entrypoint == VAEntrypointEncPicture);
-    vpp = (trace_ctx->trace_entrypoint == VAEntrypointVideoProc);
-
-    if ((encode && (va_trace_flag & VA_TRACE_FLAG_SURFACE_ENCODE)) ||
-        (decode && (va_trace_flag & VA_TRACE_FLAG_SURFACE_DECODE)) ||
-        (jpeg && (va_trace_flag & VA_TRACE_FLAG_SURFACE_JPEG)) ||
-        (vpp && (va_trace_flag & VA_TRACE_FLAG_SURFACE_VPPOUT))) {
-        if (open_tracing_specil_file(pva_trace, trace_ctx, 1) < 0) {
-            va_errorMessage(dpy, "Open surface fail failed for ctx 0x%08x\n", *context);
-
-            va_trace_flag &= ~(VA_TRACE_FLAG_SURFACE);
-        }
-    }
-
-    if (encode && (va_trace_flag & VA_TRACE_FLAG_CODEDBUF)) {
-        if (open_tracing_specil_file(pva_trace, trace_ctx, 0) < 0) {
-            va_errorMessage(dpy, "Open codedbuf fail failed for ctx 0x%08x\n", *context);
-
-            va_trace_flag &= ~(VA_TRACE_FLAG_CODEDBUF);
-        }
-    }
+    open_tracing_dump_files(pva_trace, trace_ctx);
 
     internal_TraceUpdateContext(pva_trace, tra_ctx_id, trace_ctx, *context, 0);
 
@@ -1835,12 +4189,15 @@ void va_TraceDestroyContext(
     LOCK_CONTEXT(pva_trace);
 
     ctx_id = get_valid_ctx_idx(pva_trace, context);
-    if (ctx_id < MAX_TRACE_CTX_NUM) {
-        trace_ctx = pva_trace->ptra_ctx[ctx_id];
+    if (ctx_id >= 0) {
+        trace_ctx = trace_ptr_table_get(&pva_trace->ptra_ctx, ctx_id);
 
         if (trace_ctx) {
             refresh_log_file(pva_trace, trace_ctx);
 
+            va_TraceWriteRecord(trace_ctx, VA_TRACE_RECORD_DESTROY_CONTEXT,
+                                NULL, 0, NULL, 0);
+
             internal_TraceUpdateContext(pva_trace,
                                         get_valid_ctx_idx(pva_trace, context),
                                         NULL, context, 0);
@@ -1855,6 +4212,8 @@ void va_TraceCreateMFContext(
     VAMFContextID *mf_context    /* out */
 )
 {
+    TRACE_FILTER(TRACE_CAT_CONTEXT);
+
     DPY2TRACECTX(dpy, VA_INVALID_ID, VA_INVALID_ID);
     TRACE_FUNCNAME(idx);
     if (mf_context) {
@@ -1870,6 +4229,8 @@ void va_TraceMFAddContext(
     VAContextID context
 )
 {
+    TRACE_FILTER(TRACE_CAT_CONTEXT);
+
     DPY2TRACECTX(dpy, mf_context, VA_INVALID_ID);
 
     TRACE_FUNCNAME(idx);
@@ -1883,6 +4244,8 @@ void va_TraceMFReleaseContext(
     VAContextID context
 )
 {
+    TRACE_FILTER(TRACE_CAT_CONTEXT);
+
     DPY2TRACECTX(dpy, mf_context, VA_INVALID_ID);
 
     TRACE_FUNCNAME(idx);
@@ -1899,6 +4262,8 @@ void va_TraceMFSubmit(
 {
     int i;
 
+    TRACE_FILTER(TRACE_CAT_RENDER);
+
     DPY2TRACECTX(dpy, mf_context, VA_INVALID_ID);
 
     TRACE_FUNCNAME(idx);
@@ -1927,7 +4292,8 @@ void va_TraceCreateBuffer(
     add_trace_buf_info(pva_trace, context, *buf_id);
 
     /* only trace CodedBuffer */
-    if (type != VAEncCodedBufferType)
+    if (type != VAEncCodedBufferType ||
+        !TRACE_CATEGORY_ON(TRACE_CAT_BUFFERS) || trace_ctx->trace_frame_skip)
         return;
 
     TRACE_FUNCNAME(idx);
@@ -1954,10 +4320,14 @@ void va_TraceDestroyBuffer(
 
     DPY2TRACECTX(dpy, VA_INVALID_ID, buf_id);
 
-    vaBufferInfo(dpy, trace_ctx->trace_context, buf_id, &type, &size, &num_elements);
-
     delete_trace_buf_info(pva_trace, buf_id);
 
+    if (!(va_trace_flag & VA_TRACE_FLAG_LOG) ||
+        !TRACE_CATEGORY_ON(TRACE_CAT_BUFFERS) || trace_ctx->trace_frame_skip)
+        return;
+
+    vaBufferInfo(dpy, trace_ctx->trace_context, buf_id, &type, &size, &num_elements);
+
     /* only trace CodedBuffer */
     if (type != VAEncCodedBufferType)
         return;
@@ -1986,44 +4356,206 @@ static void mem_put_le32(char *mem, unsigned int val)
     mem[3] = val >> 24;
 }
 
-static void va_TraceCodedBufferIVFHeader(struct trace_context *trace_ctx, void **pbuf)
+static void mem_put_be32(unsigned char *mem, unsigned int val)
 {
-    VACodedBufferSegment *buf_list;
-    unsigned int frame_length = 0;
-    char header[32];
+    mem[0] = val >> 24;
+    mem[1] = val >> 16;
+    mem[2] = val >> 8;
+    mem[3] = val;
+}
 
-    buf_list = (VACodedBufferSegment *)(*pbuf);
+/* IVF fourcc of the profile, 0 when it has no IVF mapping */
+static unsigned int va_TraceIVFFourcc(VAProfile profile)
+{
+    switch (profile) {
+    case VAProfileVP8Version0_3:
+        return 0x30385056; /* VP80 */
+    case VAProfileVP9Profile0:
+    case VAProfileVP9Profile1:
+    case VAProfileVP9Profile2:
+    case VAProfileVP9Profile3:
+        return 0x30395056; /* VP90 */
+    case VAProfileAV1Profile0:
+    case VAProfileAV1Profile1:
+    case VAProfileAV1Profile2:
+        return 0x31305641; /* AV01, low overhead OBUs as the encoder outputs them */
+    default:
+        return 0;
+    }
+}
+
+static int va_TraceIsNALProfile(VAProfile profile)
+{
+    switch (profile) {
+    case VAProfileH264ConstrainedBaseline:
+    case VAProfileH264Main:
+    case VAProfileH264High:
+    case VAProfileH264High10:
+    case VAProfileH264High422:
+    case VAProfileH264MultiviewHigh:
+    case VAProfileH264StereoHigh:
+    case VAProfileHEVCMain:
+    case VAProfileHEVCMain10:
+    case VAProfileHEVCMain12:
+    case VAProfileHEVCMain422_10:
+    case VAProfileHEVCMain422_12:
+    case VAProfileHEVCMain444:
+    case VAProfileHEVCMain444_10:
+    case VAProfileHEVCMain444_12:
+    case VAProfileHEVCSccMain:
+    case VAProfileHEVCSccMain10:
+    case VAProfileHEVCSccMain444:
+    case VAProfileHEVCSccMain444_10:
+    case VAProfileVVCMain10:
+    case VAProfileVVCMultilayerMain10:
+        return 1;
+    default:
+        return 0;
+    }
+}
 
-    if (ftell(trace_ctx->trace_fp_codedbuf) == 0) { /* write ivf header */
-        header[0] = 'D';
-        header[1] = 'K';
-        header[2] = 'I';
-        header[3] = 'F';
-        mem_put_le16(header + 4,  0);                   /* version */
-        mem_put_le16(header + 6,  32);                  /* headersize */
-        mem_put_le32(header + 8,  0x30385056);          /* headersize */
-        /* write width and height of the first rc_param to IVF file header */
-        mem_put_le16(header + 12, trace_ctx->trace_frame_width); /* width */
-        mem_put_le16(header + 14, trace_ctx->trace_frame_height); /* height */
-        mem_put_le32(header + 16, 30);          /* rate */
-        mem_put_le32(header + 20, 1);                   /* scale */
-        mem_put_le32(header + 24, 0xffffffff);          /* length */
-        mem_put_le32(header + 28, 0);                   /* unused */
-        fwrite(header, 1, 32, trace_ctx->trace_fp_codedbuf);
-    }
-
-    /* write frame header */
-    while (buf_list != NULL) {
-        frame_length += buf_list->size;
-        buf_list = (VACodedBufferSegment *) buf_list->next;
+/* container of the coded clip, LIBVA_TRACE_CODEDBUF_FORMAT or picked from the profile */
+static int va_TraceCodedBufferContainer(struct va_trace *pva_trace, struct trace_context *trace_ctx)
+{
+    int ivf = va_TraceIVFFourcc(trace_ctx->trace_profile) != 0;
+    int nal = va_TraceIsNALProfile(trace_ctx->trace_profile);
+
+    switch (pva_trace->codedbuf_format) {
+    case TRACE_CODEDBUF_RAW:
+        return TRACE_CODEDBUF_RAW;
+    case TRACE_CODEDBUF_IVF:
+        return ivf ? TRACE_CODEDBUF_IVF : TRACE_CODEDBUF_RAW;
+    case TRACE_CODEDBUF_ANNEXB:
+    case TRACE_CODEDBUF_LENGTH:
+        return nal ? pva_trace->codedbuf_format : TRACE_CODEDBUF_RAW;
+    default:
+        if (ivf)
+            return TRACE_CODEDBUF_IVF;
+        return nal ? TRACE_CODEDBUF_ANNEXB : TRACE_CODEDBUF_RAW;
+    }
+}
+
+/* turn an Annex-B frame into 4-byte big-endian length prefixed NAL units,
+ * dst needs size + size / 3 + 4 bytes, returns the bytes written */
+static size_t va_TraceAnnexBToLength(unsigned char *dst, const unsigned char *src, size_t size)
+{
+    size_t i = 0, start, end, len = 0;
+
+    /* skip to the first start code */
+    while (i + 3 <= size && !(src[i] == 0 && src[i + 1] == 0 && src[i + 2] == 1))
+        i++;
+
+    while (i + 3 <= size) {
+        start = i + 3;
+        end = start;
+        while (end + 3 <= size && !(src[end] == 0 && src[end + 1] == 0 && src[end + 2] == 1))
+            end++;
+        if (end + 3 > size)
+            end = size;
+        i = end;
+
+        /* trailing zero bytes belong to the next start code */
+        while (end > start && src[end - 1] == 0)
+            end--;
+        if (end == start)
+            continue;
+
+        mem_put_be32(dst + len, end - start);
+        memcpy(dst + len + 4, src + start, end - start);
+        len += 4 + end - start;
+    }
+
+    return len;
+}
+
+/* save one coded frame, the VACodedBufferSegment chain and its container
+ * headers go out with a single write */
+static void va_TraceCodedBufferWrite(
+    struct trace_context *trace_ctx,
+    int container,
+    VACodedBufferSegment *buf_list)
+{
+    struct iovec iov_local[TRACE_CODEDBUF_IOV], *iov = iov_local;
+    VACodedBufferSegment *seg;
+    unsigned char *frame = NULL, *nal = NULL;
+    size_t frame_length = 0, pos = 0;
+    char header[44];
+    int num_segs = 0, iovcnt = 0;
+
+    for (seg = buf_list; seg != NULL; seg = (VACodedBufferSegment *)seg->next) {
+        frame_length += seg->size;
+        num_segs++;
+    }
+
+    if (num_segs + 1 > TRACE_CODEDBUF_IOV) {
+        iov = malloc(sizeof(struct iovec) * (num_segs + 1));
+        if (!iov)
+            return;
+    }
+
+    if (container == TRACE_CODEDBUF_IVF) {
+        char *frame_header = header;
+
+        if (trace_ctx->pts == 0) { /* write ivf header */
+            header[0] = 'D';
+            header[1] = 'K';
+            header[2] = 'I';
+            header[3] = 'F';
+            mem_put_le16(header + 4,  0);                   /* version */
+            mem_put_le16(header + 6,  32);                  /* headersize */
+            mem_put_le32(header + 8,  va_TraceIVFFourcc(trace_ctx->trace_profile)); /* fourcc */
+            /* write width and height of the first rc_param to IVF file header */
+            mem_put_le16(header + 12, trace_ctx->trace_frame_width); /* width */
+            mem_put_le16(header + 14, trace_ctx->trace_frame_height); /* height */
+            mem_put_le32(header + 16, 30);          /* rate */
+            mem_put_le32(header + 20, 1);                   /* scale */
+            mem_put_le32(header + 24, 0xffffffff);          /* length */
+            mem_put_le32(header + 28, 0);                   /* unused */
+            frame_header += 32;
+        }
+
+        /* frame header */
+        mem_put_le32(frame_header, frame_length);
+        mem_put_le32(frame_header + 4, trace_ctx->pts & 0xFFFFFFFF);
+        mem_put_le32(frame_header + 8, 0);
+        trace_ctx->pts++;
+
+        iov[iovcnt].iov_base = header;
+        iov[iovcnt].iov_len = frame_header + 12 - header;
+        iovcnt++;
+    }
+
+    if (container == TRACE_CODEDBUF_LENGTH) {
+        /* start codes may straddle segments, convert the whole frame */
+        frame = malloc(frame_length);
+        nal = malloc(frame_length + frame_length / 3 + 4);
+        if (frame && nal) {
+            for (seg = buf_list; seg != NULL; seg = (VACodedBufferSegment *)seg->next) {
+                memcpy(frame + pos, seg->buf, seg->size);
+                pos += seg->size;
+            }
+
+            iov[iovcnt].iov_base = nal;
+            iov[iovcnt].iov_len = va_TraceAnnexBToLength(nal, frame, frame_length);
+            iovcnt++;
+        }
+    } else {
+        for (seg = buf_list; seg != NULL; seg = (VACodedBufferSegment *)seg->next) {
+            if (!seg->size)
+                continue;
+
+            iov[iovcnt].iov_base = seg->buf;
+            iov[iovcnt].iov_len = seg->size;
+            iovcnt++;
+        }
     }
-    mem_put_le32(header, frame_length);
-    mem_put_le32(header + 4, trace_ctx->pts & 0xFFFFFFFF);
-    mem_put_le32(header + 8, 0);
-    fwrite(header, 1, 12, trace_ctx->trace_fp_codedbuf);
-    trace_ctx->pts++;
 
-    fflush(trace_ctx->trace_fp_codedbuf);
+    va_TraceFileWritev(trace_ctx, trace_ctx->trace_fp_codedbuf, iov, iovcnt);
+
+    free(frame);
+    free(nal);
+    if (iov != iov_local)
+        free(iov);
 }
 
 void va_TraceMapBuffer(
@@ -2038,10 +4570,19 @@ void va_TraceMapBuffer(
     unsigned int num_elements;
 
     VACodedBufferSegment *buf_list;
+    int container;
     int i = 0;
 
+    TRACE_FILTER(TRACE_CAT_BUFFERS);
+
+    if (va_trace_flag == VA_TRACE_FLAG_CONTROL)
+        return;
+
     DPY2TRACECTX(dpy, VA_INVALID_ID, buf_id);
 
+    if (trace_ctx->trace_frame_skip)
+        return;
+
     vaBufferInfo(dpy, trace_ctx->trace_context, buf_id, &type, &size, &num_elements);
 
     /* only trace CodedBuffer */
@@ -2055,10 +4596,11 @@ void va_TraceMapBuffer(
     if ((pbuf == NULL) || (*pbuf == NULL))
         return;
 
-    if (trace_ctx->trace_profile == VAProfileVP8Version0_3) {
+    container = va_TraceCodedBufferContainer(pva_trace, trace_ctx);
+    if (container == TRACE_CODEDBUF_IVF)
         va_TraceMsg(trace_ctx, "\tAdd IVF header information\n");
-        va_TraceCodedBufferIVFHeader(trace_ctx, pbuf);
-    }
+    else if (container == TRACE_CODEDBUF_LENGTH)
+        va_TraceMsg(trace_ctx, "\tReplace the start codes by NAL unit lengths\n");
 
     buf_list = (VACodedBufferSegment *)(*pbuf);
     while (buf_list != NULL) {
@@ -2070,18 +4612,52 @@ void va_TraceMapBuffer(
         va_TraceMsg(trace_ctx, "\t   reserved = 0x%08x\n", buf_list->reserved);
         va_TraceMsg(trace_ctx, "\t   buf = 0x%p\n", buf_list->buf);
 
-        if (trace_ctx->trace_fp_codedbuf) {
-            va_TraceMsg(trace_ctx, "\tDump the content to file\n");
-            fwrite(buf_list->buf, buf_list->size, 1, trace_ctx->trace_fp_codedbuf);
-
-            fflush(trace_ctx->trace_fp_codedbuf);
-        }
-
         buf_list = buf_list->next;
     }
+
+    if (trace_ctx->trace_fp_codedbuf) {
+        va_TraceMsg(trace_ctx, "\tDump the content to file\n");
+        va_TraceCodedBufferWrite(trace_ctx, container, (VACodedBufferSegment *)(*pbuf));
+    }
     va_TraceMsg(trace_ctx, NULL);
 }
 
+/* LIBVA_TRACE_BUFDATA: rows rendered before they are written, a row is at
+ * most "\t\t0x" + 8 offset digits + ":" + 16 * " xx" + "\n" */
+#define TRACE_HEXDUMP_ROW       64
+#define TRACE_HEXDUMP_BLOCK     (1024 * 1024)
+
+/* same text as "\t\t0x%04x:" and " %02x" per byte, with table lookups
+ * instead of printf, returns the length of the row */
+static size_t va_TraceHexRow(char *dst, unsigned int offset, const unsigned char *p, unsigned int n)
+{
+    static const char hex[] = "0123456789abcdef";
+    char *d = dst;
+    int digits = 4;
+    unsigned int i;
+
+    while (digits < 8 && (offset >> (digits * 4)))
+        digits++;
+
+    *d++ = '\t';
+    *d++ = '\t';
+    *d++ = '0';
+    *d++ = 'x';
+    while (digits--)
+        *d++ = hex[(offset >> (digits * 4)) & 0xf];
+    *d++ = ':';
+
+    for (i = 0; i < n; i++) {
+        d[0] = ' ';
+        d[1] = hex[p[i] >> 4];
+        d[2] = hex[p[i] & 0xf];
+        d += 3;
+    }
+    *d++ = '\n';
+
+    return d - dst;
+}
+
 static void va_TraceVABuffers(
     VADisplay dpy,
     VAContextID context,
@@ -2104,17 +4680,29 @@ static void va_TraceVABuffers(
         fp = trace_ctx->plog_file->fp_log;
 
     if ((va_trace_flag & VA_TRACE_FLAG_BUFDATA) && fp) {
-        for (i = 0; i < size; i++) {
-            unsigned char value =  p[i];
-
-            if (i == 0)
-                fprintf(fp, "\t\t0x%04x:", i);
-            else if ((i % 16) == 0)
-                fprintf(fp, "\n\t\t0x%04x:", i);
+        unsigned int rows = (size + 15) / 16;
+        unsigned int max_rows = TRACE_HEXDUMP_BLOCK / TRACE_HEXDUMP_ROW;
+        unsigned int row;
+        size_t len;
+        char *text;
+
+        if (rows > max_rows)
+            rows = max_rows;
+
+        /* render whole blocks of rows and write each in one go */
+        text = malloc((size_t)rows * TRACE_HEXDUMP_ROW);
+        if (!size)
+            va_TracePrint(trace_ctx, "\n");
+        else if (text) {
+            for (i = 0; i < size;) {
+                len = 0;
+                for (row = 0; row < max_rows && i < size; row++, i += 16)
+                    len += va_TraceHexRow(text + len, i, p + i, size - i < 16 ? size - i : 16);
 
-            fprintf(fp, " %02x", value);
+                va_TraceWriteText(trace_ctx, text, len);
+            }
         }
-        fprintf(fp, "\n");
+        free(text);
     }
 
     va_TraceMsg(trace_ctx, NULL);
@@ -4298,9 +6886,9 @@ static void va_TraceVAIQMatrixBufferH264(
     for (i = 0; i < 6; i++) {
         for (j = 0; j < 16; j++) {
             if (fp) {
-                fprintf(fp, "\t%d", p->ScalingList4x4[i][j]);
+                va_TracePrint(trace_ctx, "\t%d", p->ScalingList4x4[i][j]);
                 if ((j + 1) % 8 == 0)
-                    fprintf(fp, "\n");
+                    va_TracePrint(trace_ctx, "\n");
             }
         }
     }
@@ -4309,9 +6897,9 @@ static void va_TraceVAIQMatrixBufferH264(
     for (i = 0; i < 2; i++) {
         for (j = 0; j < 64; j++) {
             if (fp) {
-                fprintf(fp, "\t%d", p->ScalingList8x8[i][j]);
+                va_TracePrint(trace_ctx, "\t%d", p->ScalingList8x8[i][j]);
                 if ((j + 1) % 8 == 0)
-                    fprintf(fp, "\n");
+                    va_TracePrint(trace_ctx, "\n");
             }
         }
     }
@@ -5986,20 +8574,56 @@ static void va_TraceVASliceParameterBufferAV1(
     return;
 }
 
+/* the text of the per-frame calls, at capture time or from a binary record */
+static void va_TracePictureMsg(
+    struct trace_context *trace_ctx,
+    unsigned int type,
+    VAContextID context,
+    const VATraceRecordPicture *record)
+{
+    switch (type) {
+    case VA_TRACE_RECORD_BEGIN_PICTURE:
+        va_TraceMsg(trace_ctx, "==========va_TraceBeginPicture\n");
+        va_TraceMsg(trace_ctx, "\tcontext = 0x%08x\n", context);
+        va_TraceMsg(trace_ctx, "\trender_targets = 0x%08x\n", record->render_target);
+        va_TraceMsg(trace_ctx, "\tframe_count  = #%d\n", trace_ctx->trace_frame_no);
+        va_TraceMsg(trace_ctx, NULL);
+        break;
+    case VA_TRACE_RECORD_RENDER_PICTURE:
+        va_TraceMsg(trace_ctx, "==========va_TraceRenderPicture\n");
+        va_TraceMsg(trace_ctx, "\tcontext = 0x%08x\n", context);
+        va_TraceMsg(trace_ctx, "\tnum_buffers = %d\n", record->num_buffers);
+        break;
+    case VA_TRACE_RECORD_END_PICTURE:
+        va_TraceMsg(trace_ctx, "==========va_TraceEndPicture\n");
+        va_TraceMsg(trace_ctx, "\tcontext = 0x%08x\n", context);
+        va_TraceMsg(trace_ctx, "\trender_targets = 0x%08x\n", record->render_target);
+        va_TraceMsg(trace_ctx, NULL);
+        break;
+    }
+}
+
 void va_TraceBeginPicture(
     VADisplay dpy,
     VAContextID context,
     VASurfaceID render_target
 )
 {
+    VATraceRecordPicture record = { 0 };
     DPY2TRACECTX(dpy, context, VA_INVALID_ID);
 
-    TRACE_FUNCNAME(idx);
+    /* decided once per frame, the other hooks of the frame only test the flag */
+    trace_ctx->trace_frame_skip = !trace_frame_sampled(trace_ctx->trace_frame_no);
 
-    va_TraceMsg(trace_ctx, "\tcontext = 0x%08x\n", context);
-    va_TraceMsg(trace_ctx, "\trender_targets = 0x%08x\n", render_target);
-    va_TraceMsg(trace_ctx, "\tframe_count  = #%d\n", trace_ctx->trace_frame_no);
-    va_TraceMsg(trace_ctx, NULL);
+    record.render_target = render_target;
+    record.logged = TRACE_CATEGORY_ON(TRACE_CAT_RENDER) && !trace_ctx->trace_frame_skip;
+
+    /* binary logs always get the record, the decoder counts the frames */
+    if (va_trace_flag & VA_TRACE_FLAG_BINARY)
+        va_TraceWriteRecord(trace_ctx, VA_TRACE_RECORD_BEGIN_PICTURE,
+                            &record, sizeof(record), NULL, 0);
+    else if (record.logged)
+        va_TracePictureMsg(trace_ctx, VA_TRACE_RECORD_BEGIN_PICTURE, context, &record);
 
     trace_ctx->trace_rendertarget = render_target; /* for surface data dump after vaEndPicture */
 
@@ -6842,9 +9466,9 @@ va_TraceProcFilterParameterBuffer(
 
     /* get buffer type information */
     for (i = 0; i < num_filters; i++) {
-        vaBufferInfo(dpy, context, filters[i], &type, &size, &num_elements);
-
-        if (type != VAProcFilterParameterBufferType) {
+        /* filters are not captured in binary logs, fails while decoding */
+        if (vaBufferInfo(dpy, context, filters[i], &type, &size, &num_elements) != VA_STATUS_SUCCESS ||
+            type != VAProcFilterParameterBufferType) {
             va_TraceMsg(trace_ctx, "\t  filters[%d] = 0x%08x (INVALID)\n", i, filters[i]);
             return;
         } else {
@@ -7047,6 +9671,146 @@ va_TraceNoneBuf(
     }
 }
 
+static void va_TraceRenderBuffer(
+    VADisplay dpy,
+    struct trace_context *trace_ctx,
+    VAContextID context,
+    int index,
+    VABufferID buffer,
+    VABufferType type,
+    unsigned int size,
+    unsigned int num_elements,
+    unsigned char *pbuf
+)
+{
+    unsigned int j;
+
+    va_TraceMsg(trace_ctx, "\t---------------------------\n");
+    va_TraceMsg(trace_ctx, "\tbuffers[%d] = 0x%08x\n", index, buffer);
+    va_TraceMsg(trace_ctx, "\t  type = %s\n", vaBufferTypeStr(type));
+    va_TraceMsg(trace_ctx, "\t  size = %d\n", size);
+    va_TraceMsg(trace_ctx, "\t  num_elements = %d\n", num_elements);
+
+    if (pbuf == NULL)
+        return;
+
+    switch (trace_ctx->trace_profile) {
+    case VAProfileMPEG2Simple:
+    case VAProfileMPEG2Main:
+        for (j = 0; j < num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
+            va_TraceMPEG2Buf(dpy, context, buffer, type, size, num_elements, pbuf + size * j);
+        }
+        break;
+    case VAProfileMPEG4Simple:
+    case VAProfileMPEG4AdvancedSimple:
+    case VAProfileMPEG4Main:
+        for (j = 0; j < num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
+            va_TraceMPEG4Buf(dpy, context, buffer, type, size, num_elements, pbuf + size * j);
+        }
+        break;
+    case VAProfileH264High10:
+    case VAProfileH264High422:
+    case VAProfileH264Main:
+    case VAProfileH264High:
+    case VAProfileH264ConstrainedBaseline:
+        for (j = 0; j < num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
+
+            va_TraceH264Buf(dpy, context, buffer, type, size, num_elements, pbuf + size * j);
+        }
+        break;
+    case VAProfileVC1Simple:
+    case VAProfileVC1Main:
+    case VAProfileVC1Advanced:
+        for (j = 0; j < num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
+
+            va_TraceVC1Buf(dpy, context, buffer, type, size, num_elements, pbuf + size * j);
+        }
+        break;
+    case VAProfileH263Baseline:
+        for (j = 0; j < num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
+
+            va_TraceH263Buf(dpy, context, buffer, type, size, num_elements, pbuf + size * j);
+        }
+        break;
+    case VAProfileJPEGBaseline:
+        for (j = 0; j < num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
+
+            va_TraceJPEGBuf(dpy, context, buffer, type, size, num_elements, pbuf + size * j);
+        }
+        break;
+
+    case VAProfileNone:
+        for (j = 0; j < num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
+
+            va_TraceNoneBuf(dpy, context, buffer, type, size, num_elements, pbuf + size * j);
+        }
+        break;
+
+    case VAProfileVP8Version0_3:
+        for (j = 0; j < num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
+
+            va_TraceVP8Buf(dpy, context, buffer, type, size, num_elements, pbuf + size * j);
+        }
+        break;
+
+    case VAProfileHEVCMain12:
+    case VAProfileHEVCMain422_10:
+    case VAProfileHEVCMain422_12:
+    case VAProfileHEVCMain444:
+    case VAProfileHEVCMain444_10:
+    case VAProfileHEVCMain444_12:
+    case VAProfileHEVCMain:
+    case VAProfileHEVCMain10:
+    case VAProfileHEVCSccMain:
+    case VAProfileHEVCSccMain10:
+    case VAProfileHEVCSccMain444:
+    case VAProfileHEVCSccMain444_10:
+        for (j = 0; j < num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\telement[%d] = \n", j);
+
+            va_TraceHEVCBuf(dpy, context, buffer, type, size, num_elements, pbuf + size * j);
+        }
+        break;
+    case VAProfileVVCMain10:
+    case VAProfileVVCMultilayerMain10:
+        for (j = 0; j < num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\telement[%d] = \n", j);
+
+            va_TraceVVCBuf(dpy, context, buffer, type, size, num_elements, pbuf + size * j);
+        }
+        break;
+    case VAProfileVP9Profile0:
+    case VAProfileVP9Profile1:
+    case VAProfileVP9Profile2:
+    case VAProfileVP9Profile3:
+        for (j = 0; j < num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\telement[%d] = \n", j);
+
+            va_TraceVP9Buf(dpy, context, buffer, type, size, num_elements, pbuf + size * j);
+        }
+        break;
+    case VAProfileAV1Profile0:
+    case VAProfileAV1Profile1:
+    case VAProfileAV1Profile2:
+        for (j = 0; j < num_elements; j++) {
+            va_TraceMsg(trace_ctx, "\telement[%d] = \n", j);
+
+            va_TraceAV1Buf(dpy, context, buffer, type, size, num_elements, pbuf + size * j);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
 void va_TraceRenderPicture(
     VADisplay dpy,
     VAContextID context,
@@ -7054,153 +9818,55 @@ void va_TraceRenderPicture(
     int num_buffers
 )
 {
+    VATraceRecordPicture record = { 0 };
     VABufferType type;
     unsigned int size;
     unsigned int num_elements;
     int i;
+
+    TRACE_FILTER(TRACE_CAT_RENDER);
+
     DPY2TRACECTX(dpy, context, VA_INVALID_ID);
 
-    TRACE_FUNCNAME(idx);
+    if (trace_ctx->trace_frame_skip)
+        return;
 
-    va_TraceMsg(trace_ctx, "\tcontext = 0x%08x\n", context);
-    va_TraceMsg(trace_ctx, "\tnum_buffers = %d\n", num_buffers);
+    record.num_buffers = num_buffers;
+    if (va_trace_flag & VA_TRACE_FLAG_BINARY)
+        va_TraceWriteRecord(trace_ctx, VA_TRACE_RECORD_RENDER_PICTURE,
+                            &record, sizeof(record), NULL, 0);
+    else
+        va_TracePictureMsg(trace_ctx, VA_TRACE_RECORD_RENDER_PICTURE, context, &record);
     if (buffers == NULL)
         return;
 
     for (i = 0; i < num_buffers; i++) {
         unsigned char *pbuf = NULL;
-        unsigned int j;
 
         /* get buffer type information */
         vaBufferInfo(dpy, context, buffers[i], &type, &size, &num_elements);
 
-        va_TraceMsg(trace_ctx, "\t---------------------------\n");
-        va_TraceMsg(trace_ctx, "\tbuffers[%d] = 0x%08x\n", i, buffers[i]);
-        va_TraceMsg(trace_ctx, "\t  type = %s\n", vaBufferTypeStr(type));
-        va_TraceMsg(trace_ctx, "\t  size = %d\n", size);
-        va_TraceMsg(trace_ctx, "\t  num_elements = %d\n", num_elements);
-
         vaMapBuffer(dpy, buffers[i], (void **)&pbuf);
-        if (pbuf == NULL)
-            continue;
-
-        switch (trace_ctx->trace_profile) {
-        case VAProfileMPEG2Simple:
-        case VAProfileMPEG2Main:
-            for (j = 0; j < num_elements; j++) {
-                va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
-                va_TraceMPEG2Buf(dpy, context, buffers[i], type, size, num_elements, pbuf + size * j);
-            }
-            break;
-        case VAProfileMPEG4Simple:
-        case VAProfileMPEG4AdvancedSimple:
-        case VAProfileMPEG4Main:
-            for (j = 0; j < num_elements; j++) {
-                va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
-                va_TraceMPEG4Buf(dpy, context, buffers[i], type, size, num_elements, pbuf + size * j);
-            }
-            break;
-        case VAProfileH264High10:
-        case VAProfileH264High422:
-        case VAProfileH264Main:
-        case VAProfileH264High:
-        case VAProfileH264ConstrainedBaseline:
-            for (j = 0; j < num_elements; j++) {
-                va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
-
-                va_TraceH264Buf(dpy, context, buffers[i], type, size, num_elements, pbuf + size * j);
-            }
-            break;
-        case VAProfileVC1Simple:
-        case VAProfileVC1Main:
-        case VAProfileVC1Advanced:
-            for (j = 0; j < num_elements; j++) {
-                va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
-
-                va_TraceVC1Buf(dpy, context, buffers[i], type, size, num_elements, pbuf + size * j);
-            }
-            break;
-        case VAProfileH263Baseline:
-            for (j = 0; j < num_elements; j++) {
-                va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
-
-                va_TraceH263Buf(dpy, context, buffers[i], type, size, num_elements, pbuf + size * j);
-            }
-            break;
-        case VAProfileJPEGBaseline:
-            for (j = 0; j < num_elements; j++) {
-                va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
-
-                va_TraceJPEGBuf(dpy, context, buffers[i], type, size, num_elements, pbuf + size * j);
-            }
-            break;
-
-        case VAProfileNone:
-            for (j = 0; j < num_elements; j++) {
-                va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
-
-                va_TraceNoneBuf(dpy, context, buffers[i], type, size, num_elements, pbuf + size * j);
-            }
-            break;
-
-        case VAProfileVP8Version0_3:
-            for (j = 0; j < num_elements; j++) {
-                va_TraceMsg(trace_ctx, "\telement[%d] =\n", j);
-
-                va_TraceVP8Buf(dpy, context, buffers[i], type, size, num_elements, pbuf + size * j);
-            }
-            break;
-
-        case VAProfileHEVCMain12:
-        case VAProfileHEVCMain422_10:
-        case VAProfileHEVCMain422_12:
-        case VAProfileHEVCMain444:
-        case VAProfileHEVCMain444_10:
-        case VAProfileHEVCMain444_12:
-        case VAProfileHEVCMain:
-        case VAProfileHEVCMain10:
-        case VAProfileHEVCSccMain:
-        case VAProfileHEVCSccMain10:
-        case VAProfileHEVCSccMain444:
-        case VAProfileHEVCSccMain444_10:
-            for (j = 0; j < num_elements; j++) {
-                va_TraceMsg(trace_ctx, "\telement[%d] = \n", j);
-
-                va_TraceHEVCBuf(dpy, context, buffers[i], type, size, num_elements, pbuf + size * j);
-            }
-            break;
-        case VAProfileVVCMain10:
-        case VAProfileVVCMultilayerMain10:
-            for (j = 0; j < num_elements; j++) {
-                va_TraceMsg(trace_ctx, "\telement[%d] = \n", j);
-
-                va_TraceVVCBuf(dpy, context, buffers[i], type, size, num_elements, pbuf + size * j);
-            }
-            break;
-        case VAProfileVP9Profile0:
-        case VAProfileVP9Profile1:
-        case VAProfileVP9Profile2:
-        case VAProfileVP9Profile3:
-            for (j = 0; j < num_elements; j++) {
-                va_TraceMsg(trace_ctx, "\telement[%d] = \n", j);
-
-                va_TraceVP9Buf(dpy, context, buffers[i], type, size, num_elements, pbuf + size * j);
-            }
-            break;
-        case VAProfileAV1Profile0:
-        case VAProfileAV1Profile1:
-        case VAProfileAV1Profile2:
-            for (j = 0; j < num_elements; j++) {
-                va_TraceMsg(trace_ctx, "\telement[%d] = \n", j);
 
-                va_TraceAV1Buf(dpy, context, buffers[i], type, size, num_elements, pbuf + size * j);
-            }
-            break;
-        default:
-            break;
-        }
+        if (va_trace_flag & VA_TRACE_FLAG_BINARY) {
+            VATraceRecordBuffer record;
+
+            /* keep the raw bytes, va_trace_decode formats them later */
+            record.index = i;
+            record.buffer_id = buffers[i];
+            record.type = type;
+            record.size = size;
+            record.num_elements = num_elements;
+            record.reserved = 0;
+            va_TraceWriteRecord(trace_ctx, VA_TRACE_RECORD_RENDER_BUFFER,
+                                &record, sizeof(record),
+                                pbuf, pbuf ? size * num_elements : 0);
+        } else
+            va_TraceRenderBuffer(dpy, trace_ctx, context, i, buffers[i],
+                                 type, size, num_elements, pbuf);
 
-        vaUnmapBuffer(dpy, buffers[i]);
+        if (pbuf)
+            vaUnmapBuffer(dpy, buffers[i]);
     }
 
     va_TraceMsg(trace_ctx, NULL);
@@ -7212,13 +9878,21 @@ void va_TraceEndPicture(
     int endpic_done
 )
 {
+    VATraceRecordPicture record = { 0 };
+
+    TRACE_FILTER(TRACE_CAT_RENDER);
+
     DPY2TRACECTX(dpy, context, VA_INVALID_ID);
 
-    TRACE_FUNCNAME(idx);
+    if (trace_ctx->trace_frame_skip)
+        return;
 
-    va_TraceMsg(trace_ctx, "\tcontext = 0x%08x\n", context);
-    va_TraceMsg(trace_ctx, "\trender_targets = 0x%08x\n", trace_ctx->trace_rendertarget);
-    va_TraceMsg(trace_ctx, NULL);
+    record.render_target = trace_ctx->trace_rendertarget;
+    if (va_trace_flag & VA_TRACE_FLAG_BINARY)
+        va_TraceWriteRecord(trace_ctx, VA_TRACE_RECORD_END_PICTURE,
+                            &record, sizeof(record), NULL, 0);
+    else
+        va_TracePictureMsg(trace_ctx, VA_TRACE_RECORD_END_PICTURE, context, &record);
 }
 
 void va_TraceEndPictureExt(
@@ -7229,6 +9903,14 @@ void va_TraceEndPictureExt(
 {
     int encode, decode, jpeg, vpp;
     DPY2TRACECTX(dpy, context, VA_INVALID_ID);
+
+    if (trace_ctx->trace_frame_skip)
+        return;
+
+    /* the context may have been created while LIBVA_TRACE_CONTROL paused tracing */
+    if (pva_trace->control)
+        open_tracing_dump_files(pva_trace, trace_ctx);
+
     /* avoid to create so many empty files */
     encode = (trace_ctx->trace_entrypoint == VAEntrypointEncSlice);
     decode = (trace_ctx->trace_entrypoint == VAEntrypointVLD);
@@ -7254,6 +9936,8 @@ void va_TraceSyncSurface(
     VASurfaceID render_target
 )
 {
+    TRACE_FILTER(TRACE_CAT_SYNC);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7270,6 +9954,8 @@ void va_TraceSyncSurface2(
     uint64_t timeout_ns
 )
 {
+    TRACE_FILTER(TRACE_CAT_SYNC);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7288,6 +9974,8 @@ void va_TraceQuerySurfaceAttributes(
     unsigned int       *num_attribs
 )
 {
+    TRACE_FILTER(TRACE_CAT_SURFACES);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7306,6 +9994,8 @@ void va_TraceQuerySurfaceStatus(
     VASurfaceStatus *status    /* out */
 )
 {
+    TRACE_FILTER(TRACE_CAT_SYNC);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7326,6 +10016,8 @@ void va_TraceQuerySurfaceError(
     void **error_info       /*out*/
 )
 {
+    TRACE_FILTER(TRACE_CAT_SYNC);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7351,6 +10043,8 @@ void va_TraceSyncBuffer(
     uint64_t timeout_ns
 )
 {
+    TRACE_FILTER(TRACE_CAT_SYNC);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7367,6 +10061,8 @@ void va_TraceMaxNumDisplayAttributes(
     int number
 )
 {
+    TRACE_FILTER(TRACE_CAT_DISPLAY);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7388,6 +10084,8 @@ void va_TraceQueryDisplayAttributes(
     if (attr_list == NULL || num_attributes == NULL)
         return;
 
+    TRACE_FILTER(TRACE_CAT_DISPLAY);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7438,6 +10136,8 @@ void va_TraceGetDisplayAttributes(
     int num_attributes
 )
 {
+    TRACE_FILTER(TRACE_CAT_DISPLAY);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7453,6 +10153,8 @@ void va_TraceSetDisplayAttributes(
     int num_attributes
 )
 {
+    TRACE_FILTER(TRACE_CAT_DISPLAY);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7469,6 +10171,8 @@ void va_TraceCreateProtectedSession(
     VAProtectedSessionID *protected_session
 )
 {
+    TRACE_FILTER(TRACE_CAT_PROTECTED);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7489,6 +10193,8 @@ void va_TraceDestroyProtectedSession(
     VAProtectedSessionID protected_session
 )
 {
+    TRACE_FILTER(TRACE_CAT_PROTECTED);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7506,6 +10212,8 @@ void va_TraceAttachProtectedSession(
     VAProtectedSessionID protected_session
 )
 {
+    TRACE_FILTER(TRACE_CAT_PROTECTED);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7523,6 +10231,8 @@ void va_TraceDetachProtectedSession(
     VAContextID context
 )
 {
+    TRACE_FILTER(TRACE_CAT_PROTECTED);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7548,6 +10258,8 @@ void va_TraceProtectedSessionExecute(
     bool buf_valid = false;
     VAProtectedSessionExecuteBuffer *execute_buf = NULL;
 
+    TRACE_FILTER(TRACE_CAT_PROTECTED);
+
     /* Try to get buffer info and map the buffer*/
     if (vaBufferInfo(dpy, VA_INVALID_ID, buf_id, &type, &size, &num_elements) == VA_STATUS_SUCCESS) {
         if (type == VAProtectedSessionExecuteBufferType) {
@@ -7628,6 +10340,8 @@ void va_TracePutSurface(
     unsigned int flags /* de-interlacing flags */
 )
 {
+    TRACE_FILTER(TRACE_CAT_DISPLAY);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7652,6 +10366,12 @@ void va_TracePutSurface(
 
 void va_TraceStatus(VADisplay dpy, const char * funcName, VAStatus status)
 {
+    /* nothing to log, don't take the lock for it */
+    if (!(va_trace_flag & VA_TRACE_FLAG_LOG))
+        return;
+
+    TRACE_FILTER(TRACE_CAT_STATUS);
+
     DPY2TRACE_VIRCTX(dpy);
 
     va_TraceMsg(trace_ctx, "=========%s ret = %s, %s \n", funcName, vaStatusStr(status), vaErrorStr(status));
@@ -7672,7 +10392,12 @@ void va_TraceEvent(
     char *p_data;
     int i;
 
-    if (pva_trace == NULL || pva_trace->ftrace_fd < 0) {
+    if (pva_trace == NULL) {
+        return;
+    }
+    if (pva_trace->json)
+        va_TraceJsonEvent(pva_trace->json, id, opcode, num, desc);
+    if (pva_trace->ftrace_fd < 0) {
         return;
     }
     /* trace event header: 32bit va trace id; 32bit event id + size; 32bit opcode */
@@ -7703,6 +10428,85 @@ void va_TraceEvent(
     return;
 }
 
+/* LIBVA_TRACE=FTRACE buffer data: events staged before one writev(), in a
+ * block on the stack when they fit in TRACE_FTRACE_STAGING */
+#define TRACE_FTRACE_BATCH          256
+#define TRACE_FTRACE_STAGING        2048
+
+struct trace_event_batch {
+    struct va_trace *pva_trace;
+    unsigned char *staging; /* events packed back to back */
+    size_t staging_size;
+    size_t used;
+    struct iovec iov[TRACE_FTRACE_BATCH];
+    int num;
+};
+
+/* trace_marker_raw has no write_iter, every iovec reaches it as a write()
+ * of its own and stays one event, a batch costs a single syscall */
+static void va_TraceEventFlush(struct trace_event_batch *batch)
+{
+#if defined(_WIN32)
+    int i;
+
+    for (i = 0; i < batch->num; i++)
+        write(batch->pva_trace->ftrace_fd, batch->iov[i].iov_base, batch->iov[i].iov_len);
+#else
+    trace_writev_all(batch->pva_trace->ftrace_fd, batch->iov, batch->num);
+#endif
+    batch->num = 0;
+    batch->used = 0;
+}
+
+/* staging bytes of the events of one buffer, as va_TraceEventBuffers splits it */
+static size_t va_TraceEventBufferSize(unsigned int total)
+{
+    size_t chunk = VA_TRACE_MAX_SIZE - VA_TRACE_HEADER_SIZE - sizeof(unsigned int);
+
+    if (VA_TRACE_HEADER_SIZE + 3 * sizeof(int) + total <= VA_TRACE_MAX_SIZE)
+        return VA_TRACE_HEADER_SIZE + 3 * sizeof(int) + total;
+
+    return VA_TRACE_HEADER_SIZE + 3 * sizeof(int) +
+           (total + chunk - 1) / chunk * (VA_TRACE_HEADER_SIZE + sizeof(unsigned int)) +
+           total + VA_TRACE_HEADER_SIZE;
+}
+
+/* stage an event laid out as va_TraceEvent writes it, head then payload */
+static void va_TraceEventAppend(
+    struct trace_event_batch *batch,
+    unsigned short opcode,
+    const void *head,
+    unsigned int head_size,
+    const void *payload,
+    unsigned int size)
+{
+    size_t event_size = VA_TRACE_HEADER_SIZE + head_size + size;
+    unsigned char *event;
+    uint32_t header[3];
+
+    if (batch->num == TRACE_FTRACE_BATCH ||
+        batch->used + event_size > batch->staging_size)
+        va_TraceEventFlush(batch);
+
+    /* each iovec is a trace_marker_raw write of its own, so the header and
+     * the payload of an event have to be contiguous */
+    event = batch->staging + batch->used;
+    batch->used += event_size;
+
+    header[0] = VA_TRACE_ID;
+    header[1] = (BUFFER_DATA << 16) | (VA_TRACE_HEADER_SIZE + head_size + size);
+    header[2] = opcode;
+    memcpy(event, header, VA_TRACE_HEADER_SIZE);
+    if (head_size)
+        memcpy(event + VA_TRACE_HEADER_SIZE, head, head_size);
+    if (size)
+        memcpy(event + VA_TRACE_HEADER_SIZE + head_size, payload, size);
+
+    batch->iov[batch->num].iov_base = event;
+    batch->iov[batch->num].iov_len = VA_TRACE_HEADER_SIZE + head_size + size;
+    batch->num++;
+}
+
 void va_TraceEventBuffers(
     VADisplay dpy,
     VAContextID context,
@@ -7710,6 +10514,9 @@ void va_TraceEventBuffers(
     VABufferID *buffers)
 {
     struct va_trace *pva_trace = (struct va_trace *)(((VADisplayContextP)dpy)->vatrace);
+    struct trace_event_batch batch;
+    unsigned char staging[TRACE_FTRACE_STAGING];
+    size_t needed = 0;
     VABufferType type;
     unsigned int size, num;
     int i;
@@ -7717,8 +10524,30 @@ void va_TraceEventBuffers(
     if (pva_trace == NULL || pva_trace->ftrace_fd < 0) {
         return;
     }
+
+    /* size the staging block to the events of this call, small parameter
+     * buffers don't need more than the stack */
     for (i = 0; i < num_buffers; i++) {
-        unsigned char *pbuf = NULL;
+        if (vaBufferInfo(dpy, context, buffers[i], &type, &size, &num) == VA_STATUS_SUCCESS)
+            needed += va_TraceEventBufferSize(size * num);
+    }
+    if (needed > TRACE_FTRACE_BATCH * VA_TRACE_MAX_SIZE)
+        needed = TRACE_FTRACE_BATCH * VA_TRACE_MAX_SIZE;
+
+    batch.staging = staging;
+    batch.staging_size = sizeof(staging);
+    if (needed > sizeof(staging)) {
+        batch.staging = malloc(needed);
+        if (!batch.staging)
+            return;
+        batch.staging_size = needed;
+    }
+    batch.pva_trace = pva_trace;
+    batch.used = 0;
+    batch.num = 0;
+
+    for (i = 0; i < num_buffers; i++) {
+        unsigned char *pbuf = NULL, *p;
         unsigned int total = 0;
         int data[3];
         vaBufferInfo(dpy, context, buffers[i], &type, &size, &num);
@@ -7733,30 +10562,32 @@ void va_TraceEventBuffers(
         /* apeend buffer data */
         if (VA_TRACE_HEADER_SIZE + sizeof(data) + total <= VA_TRACE_MAX_SIZE) {
             /* send in trace info opcode if data is small */
-            VAEventData desc[] = {{data, sizeof(data)}, {pbuf, total}};
-            va_TraceEvent(dpy, BUFFER_DATA, TRACE_INFO, 2, desc);
+            va_TraceEventAppend(&batch, TRACE_INFO, data, sizeof(data), pbuf, total);
         } else {
             // split buffer data to send in multi trace event
-            VAEventData desc[2] = {{data, sizeof(data)}, {NULL, 0}};
             unsigned int write_size = 0;
 
-            va_TraceEvent(dpy, BUFFER_DATA, TRACE_BEGIN, 1, desc);
-            desc[0].buf = &write_size;
-            desc[0].size = sizeof(write_size);
+            va_TraceEventAppend(&batch, TRACE_BEGIN, data, sizeof(data), NULL, 0);
+            p = pbuf;
             while (total > 0) {
                 write_size = total;
                 if (write_size > VA_TRACE_MAX_SIZE - VA_TRACE_HEADER_SIZE - sizeof(unsigned int)) {
                     write_size = VA_TRACE_MAX_SIZE - VA_TRACE_HEADER_SIZE - sizeof(unsigned int);
                 }
-                desc[1].buf = pbuf;
-                desc[1].size = write_size;
-                va_TraceEvent(dpy, BUFFER_DATA, TRACE_DATA, 2, desc);
+                va_TraceEventAppend(&batch, TRACE_DATA, &write_size, sizeof(write_size), p, write_size);
                 total -= write_size;
-                pbuf += write_size;
+                p += write_size;
             }
-            va_TraceEvent(dpy, BUFFER_DATA, TRACE_END, 0, NULL);
+            va_TraceEventAppend(&batch, TRACE_END, NULL, 0, NULL, 0);
         }
+        vaUnmapBuffer(dpy, buffers[i]);
     }
+
+    if (batch.num)
+        va_TraceEventFlush(&batch);
+    if (batch.staging != staging)
+        free(batch.staging);
+
     return;
 }
 
@@ -7769,6 +10600,8 @@ void va_TraceExportSurfaceHandle(
 {
     int i;
 
+    TRACE_FILTER(TRACE_CAT_SURFACES);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7814,6 +10647,8 @@ void va_TraceExportSurfaceHandle(
 
 void va_TraceDeriveImage(VADisplay dpy, VASurfaceID surface, VAImage *image)
 {
+    TRACE_FILTER(TRACE_CAT_SURFACES);
+
     DPY2TRACE_VIRCTX(dpy);
 
     TRACE_FUNCNAME(idx);
@@ -7848,3 +10683,209 @@ void va_TraceDeriveImage(VADisplay dpy, VASurfaceID surface, VAImage *image)
 
     DPY2TRACE_VIRCTX_EXIT(pva_trace);
 }
+
+static struct trace_context *va_TraceDecodeContext(
+    struct va_trace *pva_trace,
+    struct trace_log_file *plog_file,
+    VAContextID context)
+{
+    struct trace_context *trace_ctx = NULL;
+    int idx;
+
+    if (context == VA_INVALID_ID)
+        return pva_trace->ptra_vir_ctx;
+
+    idx = get_free_ctx_idx(pva_trace, context);
+    if (idx < 0)
+        return NULL;
+
+    trace_ctx = trace_ptr_table_get(&pva_trace->ptra_ctx, idx);
+    if (!trace_ctx) {
+        trace_ctx = calloc(sizeof(struct trace_context), 1);
+        if (!trace_ctx)
+            return NULL;
+
+        trace_ctx->plog_file = plog_file;
+        trace_ctx->trace_context = context;
+        trace_ptr_table_set(&pva_trace->ptra_ctx, idx, trace_ctx);
+        pva_trace->context_num++;
+        trace_id_map_insert(&pva_trace->context_map, context, idx);
+    }
+
+    return trace_ctx;
+}
+
+int va_TraceDecode(FILE *in, FILE *out)
+{
+    struct VADisplayContext dpy_ctx;
+    VADisplay dpy = (VADisplay)&dpy_ctx;
+    VATraceBinaryHeader header;
+    VATraceRecord record;
+    struct va_trace *pva_trace = NULL;
+    struct trace_context *trace_ctx = NULL;
+    struct trace_log_file log_file;
+    unsigned char *payload = NULL;
+    uint32_t payload_size = 0;
+    int saved_flag = va_trace_flag;
+    int ret = -1;
+    int i;
+
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        memcmp(header.magic, VA_TRACE_BINARY_MAGIC, sizeof(VA_TRACE_BINARY_MAGIC)) != 0 ||
+        header.version != VA_TRACE_BINARY_VERSION)
+        return -1;
+
+    pva_trace = calloc(sizeof(struct va_trace), 1);
+    trace_ctx = calloc(sizeof(struct trace_context), 1);
+    if (pva_trace == NULL || trace_ctx == NULL) {
+        free(pva_trace);
+        free(trace_ctx);
+
+        return -1;
+    }
+
+    /* replay into the printers through a display carrying only the trace state */
+    memset(&dpy_ctx, 0, sizeof(dpy_ctx));
+    dpy_ctx.vatrace = pva_trace;
+
+    pva_trace->dpy = dpy;
+    pva_trace->ftrace_fd = -1;
+    pthread_mutex_init(&pva_trace->resource_mutex, NULL);
+    pthread_mutex_init(&pva_trace->context_mutex, NULL);
+
+    memset(&log_file, 0, sizeof(log_file));
+    log_file.thread_id = va_trace_thread_id();
+    log_file.used = 1;
+    log_file.fp_log = out;
+
+    trace_ctx->plog_file = &log_file;
+    trace_ctx->trace_context = VA_INVALID_ID;
+    pva_trace->ptra_vir_ctx = trace_ctx;
+
+    va_trace_flag = VA_TRACE_FLAG_LOG | (header.flags & VA_TRACE_FLAG_BUFDATA);
+
+    while (fread(&record, sizeof(header), 1, in) == 1) {
+        /* rotated segments start with their own header */
+        if (memcmp(&record, VA_TRACE_BINARY_MAGIC, sizeof(VA_TRACE_BINARY_MAGIC)) == 0) {
+            memcpy(&header, &record, sizeof(header));
+            if (header.version != VA_TRACE_BINARY_VERSION)
+                goto END;
+            continue;
+        }
+
+        if (fread((char *)&record + sizeof(header), sizeof(record) - sizeof(header), 1, in) != 1)
+            break;
+
+        if (record.size > payload_size) {
+            unsigned char *p = realloc(payload, record.size);
+
+            if (!p)
+                goto END;
+
+            payload = p;
+            payload_size = record.size;
+        }
+
+        if (record.size && fread(payload, record.size, 1, in) != 1)
+            goto END;
+
+        trace_ctx = va_TraceDecodeContext(pva_trace, &log_file, record.context);
+        if (!trace_ctx)
+            continue;
+
+        trace_ctx->trace_replay_ts = record.timestamp;
+
+        switch (record.type) {
+        case VA_TRACE_RECORD_MSG:
+            va_TraceMsg(trace_ctx, "%.*s", (int)record.size, (char *)payload);
+            break;
+        case VA_TRACE_RECORD_PRINT:
+            va_TracePrint(trace_ctx, "%.*s", (int)record.size, (char *)payload);
+            break;
+        case VA_TRACE_RECORD_CREATE_CONTEXT:
+            if (record.size >= sizeof(VATraceRecordContext)) {
+                VATraceRecordContext rec_ctx;
+
+                memcpy(&rec_ctx, payload, sizeof(rec_ctx));
+                trace_ctx->trace_profile = rec_ctx.profile;
+                trace_ctx->trace_entrypoint = rec_ctx.entrypoint;
+                trace_ctx->trace_frame_width = rec_ctx.width;
+                trace_ctx->trace_frame_height = rec_ctx.height;
+                trace_ctx->trace_frame_no = 0;
+                trace_ctx->trace_slice_no = 0;
+            }
+            break;
+        case VA_TRACE_RECORD_DESTROY_CONTEXT:
+            i = get_valid_ctx_idx(pva_trace, record.context);
+            if (i >= 0) {
+                free(trace_ptr_table_get(&pva_trace->ptra_ctx, i));
+                trace_ptr_table_set(&pva_trace->ptra_ctx, i, NULL);
+                pva_trace->context_num--;
+                trace_id_map_remove(&pva_trace->context_map, record.context);
+            }
+            break;
+        case VA_TRACE_RECORD_BEGIN_PICTURE:
+            if (record.size >= sizeof(VATraceRecordPicture)) {
+                VATraceRecordPicture rec_pic;
+
+                memcpy(&rec_pic, payload, sizeof(rec_pic));
+                if (rec_pic.logged)
+                    va_TracePictureMsg(trace_ctx, record.type, record.context, &rec_pic);
+                trace_ctx->trace_rendertarget = rec_pic.render_target;
+            }
+            trace_ctx->trace_frame_no++;
+            trace_ctx->trace_slice_no = 0;
+            break;
+        case VA_TRACE_RECORD_RENDER_PICTURE:
+        case VA_TRACE_RECORD_END_PICTURE:
+            if (record.size >= sizeof(VATraceRecordPicture)) {
+                VATraceRecordPicture rec_pic;
+
+                memcpy(&rec_pic, payload, sizeof(rec_pic));
+                va_TracePictureMsg(trace_ctx, record.type, record.context, &rec_pic);
+            }
+            break;
+        case VA_TRACE_RECORD_RENDER_BUFFER:
+            if (record.size >= sizeof(VATraceRecordBuffer)) {
+                VATraceRecordBuffer rec_buf;
+                unsigned char *pbuf = NULL;
+                uint64_t data_size;
+
+                memcpy(&rec_buf, payload, sizeof(rec_buf));
+                data_size = (uint64_t)rec_buf.size * rec_buf.num_elements;
+                if (data_size && record.size - sizeof(rec_buf) >= data_size)
+                    pbuf = payload + sizeof(rec_buf);
+
+                va_TraceRenderBuffer(dpy, trace_ctx, record.context, rec_buf.index,
+                                     rec_buf.buffer_id, rec_buf.type, rec_buf.size,
+                                     rec_buf.num_elements, pbuf);
+            }
+            break;
+        default:
+            /* skip records added by later versions */
+            break;
+        }
+    }
+
+    if (feof(in))
+        ret = 0;
+
+END:
+    va_TraceMsg(pva_trace->ptra_vir_ctx, NULL);
+
+    for (i = 0; pva_trace->ptra_ctx && i < pva_trace->ptra_ctx->size; i++)
+        free(pva_trace->ptra_ctx->ptr[i]);
+    trace_ptr_table_free(&pva_trace->ptra_ctx);
+    free(pva_trace->ptra_vir_ctx);
+
+    trace_id_map_free(&pva_trace->context_map);
+
+    pthread_mutex_destroy(&pva_trace->resource_mutex);
+    pthread_mutex_destroy(&pva_trace->context_mutex);
+    free(pva_trace);
+    free(payload);
+
+    va_trace_flag = saved_flag;
+
+    return ret;
+}
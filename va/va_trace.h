@@ -45,6 +45,78 @@ extern int va_trace_flag;
 #define VA_TRACE_FLAG_FTRACE          0x40
 #define VA_TRACE_FLAG_FTRACE_BUFDATA  (VA_TRACE_FLAG_FTRACE | \
                                        VA_TRACE_FLAG_BUFDATA)
+#define VA_TRACE_FLAG_BINARY          0x100
+/* LIBVA_TRACE_CONTROL paused tracing, the hooks only keep their bookkeeping */
+#define VA_TRACE_FLAG_CONTROL         0x200
+#define VA_TRACE_FLAG_JSON            0x400
+/* sinks of the VA_TRACE_* call events */
+#define VA_TRACE_FLAG_EVENT           (VA_TRACE_FLAG_FTRACE | \
+                                       VA_TRACE_FLAG_JSON)
+
+/** \brief binary trace layout
+ * LIBVA_TRACE_FORMAT=binary writes a VATraceBinaryHeader followed by
+ * VATraceRecord entries instead of formatted text, fields are in host
+ * byte order. va_trace_decode renders such a file into the text log.
+ * The per-frame calls, vaBeginPicture, vaRenderPicture with the raw bytes
+ * of its buffers and vaEndPicture, are stored as typed records and only
+ * formatted on decode. The other calls are still formatted at capture
+ * time and stored as text records.
+ * A rotated log repeats the header at the start of every segment.
+ * Note: bump VA_TRACE_BINARY_VERSION on any layout change */
+#define VA_TRACE_BINARY_MAGIC         "VATRACE"
+#define VA_TRACE_BINARY_VERSION       2
+
+typedef struct {
+    char magic[8];          /* VA_TRACE_BINARY_MAGIC */
+    uint32_t version;       /* VA_TRACE_BINARY_VERSION */
+    uint32_t flags;         /* va_trace_flag of the capture */
+} VATraceBinaryHeader;
+
+/** \brief binary record types, one per traced entry point that needs
+ * more than text to be replayed */
+enum {
+    VA_TRACE_RECORD_MSG = 0,        /* text line, prefix rebuilt on decode */
+    VA_TRACE_RECORD_PRINT,          /* text without prefix */
+    VA_TRACE_RECORD_CREATE_CONTEXT, /* VATraceRecordContext */
+    VA_TRACE_RECORD_DESTROY_CONTEXT,
+    VA_TRACE_RECORD_BEGIN_PICTURE,  /* VATraceRecordPicture */
+    VA_TRACE_RECORD_RENDER_BUFFER,  /* VATraceRecordBuffer + buffer data */
+    VA_TRACE_RECORD_RENDER_PICTURE, /* VATraceRecordPicture */
+    VA_TRACE_RECORD_END_PICTURE,    /* VATraceRecordPicture */
+};
+
+typedef struct {
+    uint32_t size;          /* payload bytes following this header */
+    uint16_t type;          /* VA_TRACE_RECORD_* */
+    uint16_t reserved;
+    uint32_t context;       /* VAContextID, VA_INVALID_ID if none */
+    uint32_t thread_id;
+    uint64_t timestamp;     /* ns since the epoch */
+} VATraceRecord;
+
+typedef struct {
+    int32_t profile;
+    int32_t entrypoint;
+    uint32_t width;
+    uint32_t height;
+} VATraceRecordContext;
+
+typedef struct {
+    uint32_t index;         /* position in the vaRenderPicture() list */
+    uint32_t buffer_id;
+    uint32_t type;
+    uint32_t size;
+    uint32_t num_elements;
+    uint32_t reserved;      /* data follows, size * num_elements bytes
+                             * unless the buffer could not be mapped */
+} VATraceRecordBuffer;
+
+typedef struct {
+    uint32_t render_target;
+    uint32_t num_buffers;   /* vaRenderPicture */
+    uint32_t logged;        /* vaBeginPicture: 0 when only the frame is counted */
+    uint32_t reserved;
+} VATraceRecordPicture;
 
 
 #define VA_TRACE_LOG(trace_func,...)            \
@@ -103,14 +175,14 @@ typedef struct va_event_data {
 /** \brief VA_TRACE
  * trace interface to send out trace event with empty event data. */
 #define VA_TRACE(dpy,id,op) do {                        \
-        if (va_trace_flag & VA_TRACE_FLAG_FTRACE) {     \
+        if (va_trace_flag & VA_TRACE_FLAG_EVENT) {      \
             va_TraceEvent(dpy, id, op, 0, NULL);        \
         }                                               \
     } while (0)
 /** \brief VA_TRACE_V
  * trace interface to send out trace event with 1 data element from variable. the variable data type could be 8/16/32/64 bitsize */
 #define VA_TRACE_V(dpy,id,op,v) do {                    \
-        if (va_trace_flag & VA_TRACE_FLAG_FTRACE) {     \
+        if (va_trace_flag & VA_TRACE_FLAG_EVENT) {      \
             VAEventData desc[1] = {{&v, sizeof(v)}};    \
             va_TraceEvent(dpy, id, op, 1, desc);        \
         }                                               \
@@ -118,7 +190,7 @@ typedef struct va_event_data {
 /** \brief VA_TRACE_PV
  * trace interface to send out trace event with 2 data element, from pointer and variable. their data size could be 8/16/32/64 bitsize */
 #define VA_TRACE_PV(dpy,id,op,p,v) do {                 \
-        if (va_trace_flag & VA_TRACE_FLAG_FTRACE) {     \
+        if (va_trace_flag & VA_TRACE_FLAG_EVENT) {      \
             VAEventData desc[2] = {{p, sizeof(*p)},     \
                                    {&v, sizeof(v)}};    \
             va_TraceEvent(dpy, id, op, 2, desc);        \
@@ -127,7 +199,7 @@ typedef struct va_event_data {
 /** \brief VA_TRACE_VV
  * trace interface to send out trace event with 2 data element, both from variable. their data size could be 8/16/32/64 bitsize */
 #define VA_TRACE_VV(dpy,id,op,v1,v2) do {               \
-        if (va_trace_flag & VA_TRACE_FLAG_FTRACE) {     \
+        if (va_trace_flag & VA_TRACE_FLAG_EVENT) {      \
             VAEventData desc[2] = {{&v1, sizeof(v1)},   \
                                    {&v2, sizeof(v2)}};  \
             va_TraceEvent(dpy, id, op, 2, desc);        \
@@ -136,7 +208,7 @@ typedef struct va_event_data {
 /** \brief VA_TRACE_VVVV
  * trace interface to send out trace event with 4 data element, all from variable. their data size could be 8/16/32/64 bitsize */
 #define VA_TRACE_VVVV(dpy,id,op,v1,v2,v3,v4) do {       \
-        if (va_trace_flag & VA_TRACE_FLAG_FTRACE) {     \
+        if (va_trace_flag & VA_TRACE_FLAG_EVENT) {      \
             VAEventData desc[4] = { {&v1, sizeof(v1)},  \
                                     {&v2, sizeof(v2)},  \
                                     {&v3, sizeof(v3)},  \
@@ -148,7 +220,7 @@ typedef struct va_event_data {
  * trace interface to send out trace event with a dynamic length array data element, array length from variable.
  * high 16bits of array length is used to set bitssize of array element. */
 #define VA_TRACE_VA(dpy,id,op,n,a) do {                  \
-        if (va_trace_flag & VA_TRACE_FLAG_FTRACE) {      \
+        if (va_trace_flag & VA_TRACE_FLAG_EVENT) {       \
             int num = n | sizeof(*a) << 16;              \
             VAEventData desc[2] = {{&num, sizeof(num)},  \
                                    {a, n * sizeof(*a)}}; \
@@ -159,7 +231,7 @@ typedef struct va_event_data {
  * trace interface to send out trace event with a dynamic length array data element, array length from pointer. need check null before set.
  * high 16bits of array length is used to set bitssize of array element. */
 #define VA_TRACE_PA(dpy,id,op,pn,a) do {                 \
-        if (va_trace_flag & VA_TRACE_FLAG_FTRACE) {      \
+        if (va_trace_flag & VA_TRACE_FLAG_EVENT) {       \
             int num = sizeof(*a) << 16;                  \
             VAEventData desc[2] = {{&num, sizeof(num)},  \
                                    {a, 0}};              \
@@ -174,7 +246,7 @@ typedef struct va_event_data {
  * trace interface to send out trace event with 1 data element and a dynamic length array data element, array length from variable.
  * high 16bits of array length is used to set bitssize of array element. */
 #define VA_TRACE_VVA(dpy,id,op,v,n,a) do {               \
-        if (va_trace_flag & VA_TRACE_FLAG_FTRACE) {      \
+        if (va_trace_flag & VA_TRACE_FLAG_EVENT) {       \
             int num = n | (sizeof(*a) << 16);            \
             VAEventData desc[3] = {{&v, sizeof(v)},      \
                                    {&num, sizeof(num)},  \
@@ -186,7 +258,7 @@ typedef struct va_event_data {
  * trace interface to send out trace event with 2 data element and a dynamic length array data element, array length from variable.
  * high 16bits of array length is used to set bitssize of array element. */
 #define VA_TRACE_VVVA(dpy,id,op,v1,v2,n,a) do {          \
-        if (va_trace_flag & VA_TRACE_FLAG_FTRACE) {      \
+        if (va_trace_flag & VA_TRACE_FLAG_EVENT) {       \
             int num = n | (sizeof(*a) << 16);            \
             VAEventData desc[4] = {{&v1, sizeof(v1)},    \
                                    {&v2, sizeof(v2)},    \
@@ -199,7 +271,7 @@ typedef struct va_event_data {
  * trace interface to send out trace event with 3 data element and a dynamic length array data element, array length from variable.
  * high 16bits of array length is used to set bitssize of array element. */
 #define VA_TRACE_VVVVA(dpy,id,op,v1,v2,v3,n,a) do {      \
-        if (va_trace_flag & VA_TRACE_FLAG_FTRACE) {      \
+        if (va_trace_flag & VA_TRACE_FLAG_EVENT) {       \
             int num = n | (sizeof(*a) << 16);            \
             VAEventData desc[5] = {{&v1, sizeof(v1)},    \
                                    {&v2, sizeof(v2)},    \
@@ -213,7 +285,7 @@ typedef struct va_event_data {
  * trace interface to send out trace event with 4 data elsement and a dynamic length array data element, array length from variable.
  * high 16bits of array length is used to set bitssize of array element. */
 #define VA_TRACE_VVVVVA(dpy,id,op,v1,v2,v3,v4,n,a) do {  \
-        if (va_trace_flag & VA_TRACE_FLAG_FTRACE) {      \
+        if (va_trace_flag & VA_TRACE_FLAG_EVENT) {       \
             int num = n | (sizeof(*a) << 16);            \
             VAEventData desc[6] = {{&v1, sizeof(v1)},    \
                                    {&v2, sizeof(v2)},    \
@@ -242,6 +314,12 @@ void va_TraceInit(VADisplay dpy);
 DLL_HIDDEN
 void va_TraceEnd(VADisplay dpy);
 
+/** \brief va_TraceDecode
+ * render a LIBVA_TRACE_FORMAT=binary log read from in as text into out,
+ * returns 0 on success and -1 if in is not a supported binary trace */
+DLL_HIDDEN
+int va_TraceDecode(FILE *in, FILE *out);
+
 DLL_HIDDEN
 void va_TraceInitialize(
     VADisplay dpy,